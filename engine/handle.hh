@@ -0,0 +1,97 @@
+#ifndef HANDLE_HH
+#define HANDLE_HH
+
+#include <cstdint>
+#include <vector>
+
+// Names an entry of some dense array for as long as the entry lives, even
+// as the array grows or entries are moved around to fill the holes left by
+// removals. index picks a slot in a HandleTable, and generation must match
+// the slot's: removing the entry moves the slot's generation on, so every
+// copy of the handle goes stale instead of quietly naming whatever takes
+// the slot next. Tag only keeps handles of different things apart.
+template <typename Tag>
+struct Handle {
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    uint32_t index = NONE;
+    uint32_t generation = 0;
+
+    // Set, not necessarily still alive; HandleTable::find() tells
+    bool valid() const { return index != NONE; }
+
+    bool operator==(const Handle& other) const {
+        return index == other.index && generation == other.generation;
+    }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+// Where each live handle's entry currently sits in the dense array. The
+// owner of the array calls add() when appending, move() when it relocates
+// an entry and remove() when one goes; lookups are one slot read.
+template <typename Tag>
+class HandleTable {
+public:
+    using HandleType = Handle<Tag>;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    // A new handle for the entry at dense
+    HandleType add(uint32_t dense) {
+        HandleType handle;
+        if (!freeSlots.empty()) {
+            handle.index = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            handle.index = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        slots[handle.index].dense = dense;
+        handle.generation = slots[handle.index].generation;
+        return handle;
+    }
+
+    // The entry of handle now sits at dense
+    void move(HandleType handle, uint32_t dense) {
+        if (find(handle) != NONE) slots[handle.index].dense = dense;
+    }
+
+    // Retires handle; false if it was already stale
+    bool remove(HandleType handle) {
+        if (find(handle) == NONE) return false;
+        Slot& slot = slots[handle.index];
+        slot.generation++;
+        slot.dense = NONE;
+        freeSlots.push_back(handle.index);
+        return true;
+    }
+
+    // Index of the entry in the dense array, or NONE if handle is stale
+    uint32_t find(HandleType handle) const {
+        if (handle.index >= slots.size()) return NONE;
+        const Slot& slot = slots[handle.index];
+        return slot.generation == handle.generation ? slot.dense : NONE;
+    }
+
+    // Drops every entry; handles from before all go stale
+    void clear() {
+        freeSlots.clear();
+        for (uint32_t i = (uint32_t)slots.size(); i-- > 0;) {
+            if (slots[i].dense != NONE) {
+                slots[i].generation++;
+                slots[i].dense = NONE;
+            }
+            freeSlots.push_back(i);
+        }
+    }
+
+private:
+    struct Slot {
+        uint32_t generation = 0;
+        uint32_t dense = NONE;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeSlots;
+};
+
+#endif // HANDLE_HH
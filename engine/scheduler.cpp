@@ -0,0 +1,87 @@
+#include "scheduler.hh"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <ostream>
+
+Scheduler::SystemId Scheduler::add(const std::string& name, double frequency, double budgetMs,
+                                   Task task, int maxBacklog) {
+    System system;
+    system.name = name;
+    system.period = frequency > 0.0 ? 1.0 / frequency : 0.0;
+    system.budgetMs = budgetMs;
+    system.maxBacklog = std::max(maxBacklog, 1);
+    system.task = std::move(task);
+    systems.push_back(std::move(system));
+    return systems.size() - 1;
+}
+
+void Scheduler::tick(double frameSeconds) {
+    for (System& system : systems) {
+        if (!system.enabled) continue;
+        double spentMs = 0.0;
+
+        if (system.period == 0.0) {
+            run(system, (float)frameSeconds, spentMs);
+        } else {
+            system.owed += frameSeconds;
+            double maxOwed = system.period * system.maxBacklog;
+            while (system.owed >= maxOwed + system.period) {
+                system.owed -= system.period;
+                system.stats.dropped++;
+            }
+
+            // Always at least one step, so a budget smaller than one step
+            // slows the system down rather than stopping it
+            bool ran = false;
+            while (system.owed >= system.period) {
+                if (ran && spentMs >= system.budgetMs) {
+                    system.stats.deferred += (uint64_t)(system.owed / system.period);
+                    break;
+                }
+                run(system, (float)system.period, spentMs);
+                system.owed -= system.period;
+                ran = true;
+            }
+            if (!ran) continue;
+        }
+
+        system.stats.lastMs = spentMs;
+        system.stats.worstMs = std::max(system.stats.worstMs, spentMs);
+        if (spentMs > system.budgetMs) system.stats.overruns++;
+    }
+}
+
+void Scheduler::run(System& system, float dt, double& spentMs) {
+    auto start = std::chrono::steady_clock::now();
+    system.task(dt);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spentMs += ms;
+    system.stats.totalMs += ms;
+    system.stats.runs++;
+}
+
+float Scheduler::progress(SystemId id) const {
+    const System& system = systems[id];
+    if (system.period == 0.0) return 1.0f;
+    return (float)std::min(system.owed / system.period, 1.0);
+}
+
+void Scheduler::report(std::ostream& out) const {
+    // Put the caller's formatting back afterwards
+    std::ios::fmtflags flags = out.flags();
+    std::streamsize precision = out.precision();
+    for (const System& system : systems) {
+        const Stats& s = system.stats;
+        std::string rate = system.period > 0.0
+            ? std::to_string((int)std::lround(1.0 / system.period)) + " Hz" : "per frame";
+        out << "  " << std::left << std::setw(12) << system.name << std::right << std::fixed
+            << std::setw(9) << rate << "  budget " << std::setprecision(2) << system.budgetMs << " ms  "
+            << s.runs << " runs, avg " << std::setprecision(3)
+            << (s.runs ? s.totalMs / s.runs : 0.0) << " ms, worst frame " << s.worstMs << " ms, "
+            << s.overruns << " overruns, " << s.deferred << " deferred, " << s.dropped << " dropped\n";
+    }
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,72 @@
+#ifndef SCHEDULER_HH
+#define SCHEDULER_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Runs the game's per-frame systems, each at its own rate and within its
+// own share of the frame, in the order they were added.
+//
+// A system with a frequency is owed the frame's time on every tick() and
+// runs once per period owed, with dt equal to the period, so it sees the
+// same steps whatever the frame rate. Frequency 0 runs once per tick with
+// the frame's time instead. Once a system has used its budget for the
+// frame, the steps it still owes wait for the next frame (an overrun).
+// Past maxBacklog owed steps the oldest are dropped, so a system that
+// cannot keep up slows down instead of falling ever further behind.
+class Scheduler {
+public:
+    using Task = std::function<void(float dt)>;
+    using SystemId = size_t;
+
+    struct Stats {
+        uint64_t runs = 0;
+        uint64_t overruns = 0;   // Frames that ended over budget
+        uint64_t deferred = 0;   // Steps still owed when the budget ran out, summed over frames
+        uint64_t dropped = 0;    // Steps given up past the backlog
+        double lastMs = 0.0;     // Time spent in the last frame it ran
+        double worstMs = 0.0;
+        double totalMs = 0.0;
+    };
+
+    SystemId add(const std::string& name, double frequency, double budgetMs, Task task,
+                 int maxBacklog = 8);
+
+    void setEnabled(SystemId id, bool enabled) { systems[id].enabled = enabled; }
+
+    // Called once per frame with the real time since the last call
+    void tick(double frameSeconds);
+
+    // How far into its next period a system is, 0..1; for drawing what it
+    // moves in between its steps
+    float progress(SystemId id) const;
+
+    const Stats& getStats(SystemId id) const { return systems[id].stats; }
+    const std::string& getName(SystemId id) const { return systems[id].name; }
+    size_t size() const { return systems.size(); }
+
+    // One line per system: rate, budget, runs, time and overruns
+    void report(std::ostream& out) const;
+
+private:
+    struct System {
+        std::string name;
+        double period = 0.0;     // Seconds, 0 for every frame
+        double budgetMs = 0.0;
+        int maxBacklog = 8;
+        Task task;
+        bool enabled = true;
+        double owed = 0.0;       // Time not run yet
+        Stats stats;
+    };
+
+    std::vector<System> systems;
+
+    void run(System& system, float dt, double& spentMs);
+};
+
+#endif // SCHEDULER_HH
@@ -0,0 +1,117 @@
+#include "thread-pool.hh"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+
+// Shared between the caller of parallelFor and the helper tasks it posts.
+// Helpers that only get scheduled after the loop finished still hold a
+// reference, so the state must outlive the call.
+struct ParallelJob {
+    std::function<void(size_t, size_t)> fn;
+    size_t count = 0;
+    size_t grain = 1;
+    size_t chunks = 0;
+    std::atomic<size_t> nextChunk{0};
+    std::atomic<size_t> doneChunks{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    // Pulls chunks until none are left
+    void run() {
+        size_t chunk;
+        while ((chunk = nextChunk.fetch_add(1)) < chunks) {
+            size_t begin = chunk * grain;
+            size_t end = std::min(count, begin + grain);
+            fn(begin, end);
+            if (doneChunks.fetch_add(1) + 1 == chunks) {
+                std::lock_guard<std::mutex> lock(mutex);
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+ThreadPool::ThreadPool(unsigned threadCount) {
+    if (threadCount == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        threadCount = hw > 1 ? hw - 1 : 0;
+    }
+    for (unsigned i = 0; i < threadCount; ++i) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (stopping && tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain,
+                             const std::function<void(size_t, size_t)>& fn) {
+    if (count == 0) return;
+    grain = std::max<size_t>(1, grain);
+    size_t chunks = (count + grain - 1) / grain;
+
+    // Not worth waking anybody up for
+    if (chunks == 1 || workers.empty()) {
+        fn(0, count);
+        return;
+    }
+
+    auto job = std::make_shared<ParallelJob>();
+    job->fn = fn;
+    job->count = count;
+    job->grain = grain;
+    job->chunks = chunks;
+
+    size_t helpers = std::min(chunks - 1, workers.size());
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([job] { job->run(); });
+    }
+
+    job->run();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&] { return job->doneChunks.load() == job->chunks; });
+}
@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by the per-frame systems (renderer,
+// simulation, baking). Work is handed out either as a blocking parallelFor
+// over an index range or as fire-and-forget tasks.
+class ThreadPool {
+public:
+    // threadCount == 0 picks one worker per hardware thread, minus the
+    // caller's own (which always helps out in parallelFor)
+    explicit ThreadPool(unsigned threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads that can run a parallelFor, caller included
+    unsigned concurrency() const { return (unsigned)workers.size() + 1; }
+
+    // Runs fn(begin, end) over [0, count) in chunks of about grain items and
+    // returns once every chunk is done. Safe to call from a worker thread:
+    // the caller keeps pulling chunks itself, so it never waits on a queue.
+    void parallelFor(size_t count, size_t grain,
+                     const std::function<void(size_t, size_t)>& fn);
+
+    // Queues a task to run on some worker later. A pool without workers
+    // (one hardware thread) runs it right away instead.
+    void submit(std::function<void()> task);
+
+    // Process-wide pool, created on first use
+    static ThreadPool& shared();
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void workerLoop();
+};
+
+#endif // THREAD_POOL_HH
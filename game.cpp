@@ -1,5 +1,6 @@
 #include <SDL2/SDL.h>
 #include <iostream>
+#include <filesystem>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -7,7 +8,10 @@
 #include <cstdlib>
 
 #include "Vec2.hh"
+#include "engine/scheduler.hh"
 #include "map/map.hh"
+#include "map/world-stream.hh"
+#include "engine/thread-pool.hh"
 #include "npc/npc.hh"
 #include "player/player.hh"
 #include "npc/Shapes/Rectangle.hh"
@@ -26,6 +30,26 @@ int SCREEN_WIDTH = 1920;
 int SCREEN_HEIGHT = 1080;
 const int MINIMAP_SIZE = 200;
 
+// Rates of the scheduled systems. Physics always advances in steps of
+// exactly 1 / PHYSICS_HZ, however fast frames come, so its results do not
+// depend on the frame rate.
+const double PHYSICS_HZ = 120.0;
+const double CROSSHAIR_HZ = 30.0;
+const double AI_HZ = 10.0;
+const double STREAM_HZ = 10.0;
+
+// Share of a frame each may take before its remaining steps wait for the
+// next frame
+const double UI_BUDGET_MS = 2.0;
+const double CROSSHAIR_BUDGET_MS = 0.5;
+const double PHYSICS_BUDGET_MS = 8.0;
+const double AI_BUDGET_MS = 2.0;
+const double STREAM_BUDGET_MS = 4.0;
+
+// A world cut into chunks by map-convert --world; streamed around the
+// player instead of loaded whole when present
+const char* WORLD_DIR = "map/world";
+
 class Game {
 private:
     SDL_Window* window;
@@ -36,7 +60,10 @@ private:
     std::unique_ptr<StartMenu> startMenu;
 
     Map map;
+    WorldStream world;
+    bool streaming = false;
     Vec2 playerPos;
+    Vec2 prevPlayerPos;     // Before the last step, for drawing in between
     float viewAngle;
 
     const Uint8* keyState;
@@ -48,7 +75,12 @@ private:
     // NPC interaction state
     bool inConversation;
     bool eKeyWasPressed;
-    NPC* currentTalkingNPC;
+    NPCHandle currentTalkingNPC;   // Stays safe to look up as NPCs come and go
+    NPCHandle crosshairNPC;        // As of the last crosshair check
+
+    // Everything that runs per frame, each at its own rate
+    Scheduler scheduler;
+    Scheduler::SystemId physicsSystem = 0;
 
     // View components
     std::unique_ptr<WorldView> worldView;
@@ -63,11 +95,11 @@ public:
           state(GameState::MENU),
 
           playerPos(5, 2.5),
+          prevPlayerPos(5, 2.5),
           viewAngle(0),
           mouseX(SCREEN_WIDTH / 2),
           inConversation(false),
-          eKeyWasPressed(false),
-          currentTalkingNPC(nullptr)
+          eKeyWasPressed(false)
     {
         // ================= SDL INIT =================
         if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -96,7 +128,7 @@ public:
             return;
         }
 
-        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_TARGETTEXTURE);
 
         if (!renderer) {
             std::cerr << "Renderer creation failed: " << SDL_GetError() << std::endl;
@@ -166,11 +198,32 @@ public:
         worldView = std::make_unique<WorldView>(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 
         // ================= MAP LOAD =================
-        std::ifstream testFile("map/town.map");
-        if (testFile.good()) {
+        // The binary map from map-convert opens faster; use it unless
+        // town.map has been edited since it was converted
+        std::error_code fmapMissing, mapMissing;
+        auto fmapTime = std::filesystem::last_write_time("map/town.fmap", fmapMissing);
+        auto mapTime = std::filesystem::last_write_time("map/town.map", mapMissing);
+        bool useFmap = !fmapMissing && (mapMissing || fmapTime >= mapTime);
+        if (!fmapMissing && !useFmap) {
+            std::cout << "map/town.fmap is older than map/town.map - loading the text map "
+                      << "(run map-convert to refresh it)" << std::endl;
+        }
+        std::string mapFile = useFmap ? "map/town.fmap" : "map/town.map";
+        std::ifstream testFile(mapFile);
+        if (std::ifstream(std::string(WORLD_DIR) + "/world.index").good() && world.open(WORLD_DIR)) {
+            // Only the chunks around the player; the rest come and go as
+            // they walk (see stream())
+            streaming = true;
+            map.name = world.getName();
+            world.loadAround(map, playerPos, ThreadPool::shared());
+            std::cout << "Streaming " << world.chunkCount() << " chunks from " << WORLD_DIR
+                      << ", " << world.residentCount() << " resident" << std::endl;
+        } else if (testFile.good()) {
             testFile.close();
-            map = Map::load("map/town.map");
-            std::cout << "Loaded map from town.map" << std::endl;
+            map = Map::load(mapFile);
+            map.bakeDistanceField();
+            map.buildNavMesh();
+            std::cout << "Loaded map from " << mapFile << std::endl;
 
             // ===== DIALOGUE RESOLUTION =====
             std::cout << "\n=== LOADED NPCs ===\n";
@@ -183,6 +236,16 @@ public:
         }
 
         SDL_SetRelativeMouseMode(SDL_FALSE);
+
+        // ================= SYSTEMS =================
+        // The crosshair goes first, so the dialogue keys see what it found
+        scheduler.add("crosshair", CROSSHAIR_HZ, CROSSHAIR_BUDGET_MS, [this](float) { updateTarget(); });
+        scheduler.add("ui", 0.0, UI_BUDGET_MS, [this](float dt) { update(dt); });
+        physicsSystem = scheduler.add("physics", PHYSICS_HZ, PHYSICS_BUDGET_MS, [this](float dt) { step(dt); });
+        scheduler.add("ai", AI_HZ, AI_BUDGET_MS, [this](float dt) { think(dt); });
+        if (streaming) {
+            scheduler.add("stream", STREAM_HZ, STREAM_BUDGET_MS, [this](float) { stream(); });
+        }
     }
 
     ~Game() {
@@ -222,6 +285,7 @@ public:
     }
 
     // MARK: UPDATE 
+    // Once per frame: menus and dialogue. The other systems are below.
     void update(float dt) {
         if (state == GameState::MENU) {
             startMenu->update(dt);
@@ -232,38 +296,35 @@ public:
             return;
         }
 
-        // Find NPC in crosshair
-        const NPC* targetNPCConst =
-            worldView->getNPCInCrosshair(map, playerPos, viewAngle, 3.0f);
+        NPC* targetNPC = map.getNPC(crosshairNPC);
 
-        NPC* targetNPC = nullptr;
-        if (targetNPCConst) {
-            for (auto& npc : map.npcs) {
-                if (&npc == targetNPCConst) {
-                    targetNPC = &npc;
-                    break;
-                }
-            }
+        // The NPC we were talking to may have been removed since
+        NPC* talkingNPC = map.getNPC(currentTalkingNPC);
+        if (inConversation && !talkingNPC) {
+            inConversation = false;
+            currentTalkingNPC = NPCHandle();
+            worldView->setPrompt("", false);
+            playerStatsView->hideNPC();
         }
 
         bool eKeyPressed = keyState[SDL_SCANCODE_E];
 
         if (eKeyPressed && !eKeyWasPressed) {
-            if (inConversation && currentTalkingNPC) {
+            if (inConversation && talkingNPC) {
                 // Advance dialogue
-                bool continues = currentTalkingNPC->advanceConversation();
+                bool continues = talkingNPC->advanceConversation();
                 if (continues) {
                     playerStatsView->setNPCDialogue(
-                        currentTalkingNPC->getCurrentText()
+                        talkingNPC->getCurrentText()
                     );
                     worldView->setPrompt(
-                        currentTalkingNPC->getPrompt(), true
+                        talkingNPC->getPrompt(), true
                     );
                 } else {
                     // End conversation
-                    currentTalkingNPC->endConversation();
+                    talkingNPC->endConversation();
                     inConversation = false;
-                    currentTalkingNPC = nullptr;
+                    currentTalkingNPC = NPCHandle();
                     worldView->setPrompt("", false);
                     playerStatsView->hideNPC();
                 }
@@ -272,7 +333,7 @@ public:
                 // Start new conversation
                 targetNPC->startConversation();
                 inConversation = true;
-                currentTalkingNPC = targetNPC;
+                currentTalkingNPC = targetNPC->handle;
 
                 // ──────────────────────────────────────────────────────────────
                 // Try to load the specific NPC portrait first 
@@ -302,76 +363,17 @@ public:
         }
 
         eKeyWasPressed = eKeyPressed;
+    }
 
-        if (!inConversation) {
-            float moveSpeed = 10.0f * dt;
-
-            Vec2 forward(std::cos(viewAngle), std::sin(viewAngle));
-            Vec2 right(-std::sin(viewAngle), std::cos(viewAngle));
-
-            Vec2 newPos = playerPos;
-
-            if (keyState[SDL_SCANCODE_W]) newPos = newPos + forward * moveSpeed;
-            if (keyState[SDL_SCANCODE_S]) newPos = newPos - forward * moveSpeed;
-            if (keyState[SDL_SCANCODE_A]) newPos = newPos - right * moveSpeed;
-            if (keyState[SDL_SCANCODE_D]) newPos = newPos + right * moveSpeed;
-
-            bool collision = false;
-            const float playerRadius = 0.5f;
-
-            // Check static shapes
-            for (const auto& shape : map.shapes) {
-                float minY, maxY;
-                if (shape->intersectsVerticalLine(newPos.x, minY, maxY)) {
-                    if (newPos.y >= minY - playerRadius &&
-                        newPos.y <= maxY + playerRadius) {
-                        collision = true;
-                        break;
-                    }
-                }
-            }
-
-            // Check NPCs
-            if (!collision) {
-                for (const auto& npc : map.npcs) {
-                    float minY, maxY;
-                    if (npc.shape->intersectsVerticalLine(newPos.x, minY, maxY)) {
-                        if (newPos.y >= minY - playerRadius &&
-                            newPos.y <= maxY + playerRadius) {
-                            collision = true;
-                            break;
-                        }
-                    }
-                }
-            }
-
-            // Check lines - use distance-based collision for open lines
-            if (!collision) {
-                for (size_t lineIdx = 0; lineIdx < map.lines.size(); ++lineIdx) {
-                    const auto& line = map.lines[lineIdx];
-                    float dist = line->getClosestDistanceToPoint(newPos);
-                    if (dist < playerRadius) {
-                        collision = true;
-                        break;
-                    }
-                }
-            }
-
-            if (!collision) {
-                playerPos = newPos;
-            }
-
-            map.update(dt);
+    // Which NPC is in the crosshair, and the prompt for it
+    void updateTarget() {
+        if (state != GameState::PLAYING) return;
 
-            // Simple boundary bounce for NPCs
-            for (auto& npc : map.npcs) {
-                if (npc.shape->position.x < 0 ||
-                    npc.shape->position.x > 50) {
-                    npc.velocity.x *= -1;
-                }
-            }
+        crosshairNPC = worldView->getNPCInCrosshair(map, playerPos, viewAngle, 3.0f);
 
-            // Update prompt based on look-at target
+        // Update prompt based on look-at target
+        if (!inConversation) {
+            NPC* targetNPC = map.getNPC(crosshairNPC);
             if (targetNPC) {
                 worldView->setPrompt(targetNPC->getPrompt(), true);
             } else {
@@ -380,10 +382,47 @@ public:
         }
     }
 
+    // One fixed simulation step: the player's move, then the map
+    void step(float dt) {
+        prevPlayerPos = playerPos;
+        if (state != GameState::PLAYING || inConversation) return;
+
+        float moveSpeed = 10.0f * dt;
+
+        Vec2 forward(std::cos(viewAngle), std::sin(viewAngle));
+        Vec2 right(-std::sin(viewAngle), std::cos(viewAngle));
+
+        Vec2 move;
+
+        if (keyState[SDL_SCANCODE_W]) move = move + forward * moveSpeed;
+        if (keyState[SDL_SCANCODE_S]) move = move - forward * moveSpeed;
+        if (keyState[SDL_SCANCODE_A]) move = move - right * moveSpeed;
+        if (keyState[SDL_SCANCODE_D]) move = move + right * moveSpeed;
+
+        // Swept collision against walls, shapes and NPCs; slides along
+        // whatever is hit instead of dropping the whole move
+        const float playerRadius = 0.5f;
+        playerPos = map.moveCircle(playerPos, move, playerRadius);
+
+        map.update(dt, playerPos);
+    }
+
+    // NPCs looking around
+    void think(float dt) {
+        if (state != GameState::PLAYING) return;
+        map.npcPerception.update(map, playerPos, dt);
+    }
+
+    // Pages world chunks in and out around the player
+    void stream() {
+        world.update(map, playerPos, ThreadPool::shared());
+    }
+
     // MARK: UPDATE 
 
     // ================= RENDER =================
-    void render() {
+    // alpha: how far the time not yet simulated is into the next step
+    void render(float alpha) {
         if (state == GameState::MENU) {
             startMenu->render(renderer);
             SDL_RenderPresent(renderer);
@@ -393,25 +432,31 @@ public:
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
-        worldView->render(renderer, map, playerPos, viewAngle);
+        Vec2 drawPos = prevPlayerPos + (playerPos - prevPlayerPos) * alpha;
+        worldView->render(renderer, map, drawPos, viewAngle, alpha);
         playerStatsView->render(renderer, player.get());
 
         SDL_RenderPresent(renderer);
     }
 
     void run() {
-        Uint32 lastTime = SDL_GetTicks();
+        const double tickSeconds = 1.0 / (double)SDL_GetPerformanceFrequency();
+        Uint64 lastTime = SDL_GetPerformanceCounter();
+
         while (running) {
-            Uint32 currentTime = SDL_GetTicks();
-            float dt = (currentTime - lastTime) / 1000.0f;
+            Uint64 currentTime = SDL_GetPerformanceCounter();
+            double frameTime = (currentTime - lastTime) * tickSeconds;
             lastTime = currentTime;
 
             handleEvents();
-            update(dt);
-            render();
+            scheduler.tick(frameTime);
+            render(scheduler.progress(physicsSystem));
 
             SDL_Delay(16);
         }
+
+        std::cout << "\n=== SYSTEMS ===\n";
+        scheduler.report(std::cout);
     }
 };
 
@@ -0,0 +1,830 @@
+// Offline benchmarks for the map data structures. Needs no SDL, so it
+// builds anywhere the map code does:
+//
+//   make bench
+//   ./map-bench [map file] [extra random shapes]
+//
+// Each benchmark runs the old and the new way of doing the same job on
+// the same data and prints both timings.
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Vec2.hh"
+#include "map/map.hh"
+#include "map/fmap.hh"
+#include "map/geometry-cleanup.hh"
+#include "map/map-parser.hh"
+#include "map/world-stream.hh"
+#include "map/flow-field.hh"
+#include "map/path-service.hh"
+#include "npc/Shapes/Rectangle.hh"
+#include "npc/Shapes/Triangle.hh"
+#include "npc/Shapes/Circle.hh"
+#include "npc/Shapes/Line.hh"
+#include "npc/npc.hh"
+#include "npc/npc-store.hh"
+#include "npc/npc-hash.hh"
+#include "engine/thread-pool.hh"
+
+namespace {
+
+// Keeps the optimiser from dropping work whose result is never used
+volatile float benchSink = 0;
+
+template <typename Fn>
+double timeMs(int reps, Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < reps; ++i) {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / reps;
+}
+
+void report(const std::string& name, double before, double after) {
+    // Formatted apart, so std::cout keeps its own flags and precision
+    std::ostringstream line;
+    line << "  " << std::left << std::setw(34) << name
+         << std::right << std::fixed << std::setprecision(4)
+         << std::setw(10) << before << " ms  ->"
+         << std::setw(10) << after << " ms   ("
+         << std::setprecision(1) << before / after << "x)\n";
+    std::cout << line.str();
+}
+
+// One timing with nothing to compare it to
+void report(const std::string& name, double ms) {
+    std::ostringstream line;
+    line << "  " << std::left << std::setw(34) << name
+         << std::right << std::fixed << std::setprecision(4) << std::setw(10) << ms << " ms\n";
+    std::cout << line.str();
+}
+
+// value with digits after the point, formatted apart like report()
+std::string decimals(double value, int digits) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(digits) << value;
+    return out.str();
+}
+
+// Scatters extra shapes over the map's area so the differences show up
+void addRandomShapes(Map& map, int count, std::mt19937& rng) {
+    std::uniform_real_distribution<float> px(-60.0f, 110.0f), py(-60.0f, 60.0f);
+    std::uniform_real_distribution<float> size(0.2f, 2.0f);
+    for (int i = 0; i < count; ++i) {
+        Vec2 at(px(rng), py(rng));
+        switch (i % 3) {
+            case 0:
+                map.addShape(std::make_shared<Rectangle>(at, size(rng), size(rng)));
+                break;
+            case 1:
+                map.addShape(std::make_shared<Triangle>(
+                    at, at + Vec2(size(rng), 0), at + Vec2(0, size(rng))));
+                break;
+            default:
+                map.addShape(std::make_shared<Circle>(at, size(rng)));
+                break;
+        }
+    }
+}
+
+// Shapes overlapping a 0.5-radius probe, the way Game::update used to scan
+// them: every shape, through shared_ptr and the vtable. Counts all overlaps
+// rather than stopping at the first, so both layouts do identical work.
+int probeVirtual(const Map& map, const Vec2& p) {
+    const float radius = 0.5f;
+    int hits = 0;
+    for (const auto& shape : map.shapes) {
+        float minY, maxY;
+        if (shape->intersectsVerticalLine(p.x, minY, maxY) &&
+            p.y >= minY - radius && p.y <= maxY + radius) {
+            hits++;
+        }
+    }
+    return hits;
+}
+
+// Same test over the typed arrays
+int probeTyped(const Map& map, const Vec2& p) {
+    const float radius = 0.5f;
+    int hits = 0;
+    auto test = [&](const auto& shapes) {
+        for (const auto& shape : shapes) {
+            float minY, maxY;
+            if (shape.intersectsVerticalLine(p.x, minY, maxY) &&
+                p.y >= minY - radius && p.y <= maxY + radius) {
+                hits++;
+            }
+        }
+    };
+    const ShapeStore& store = map.staticShapes;
+    test(store.rects);
+    test(store.tris);
+    test(store.circles);
+    return hits;
+}
+
+// Minimap geometry emission without a renderer: screen-space coordinates
+// are appended to out, as WorldView::render would hand them to SDL
+void drawVirtual(const Map& map, float scale, std::vector<int>& out) {
+    out.clear();
+    for (const auto& shape : map.shapes) {
+        if (auto rect = dynamic_cast<Rectangle*>(shape.get())) {
+            out.push_back((int)(rect->position.x * scale));
+            out.push_back((int)(rect->position.y * scale));
+            out.push_back((int)(rect->width * scale));
+            out.push_back((int)(rect->height * scale));
+        } else if (auto circ = dynamic_cast<Circle*>(shape.get())) {
+            for (int i = 0; i < 8; i++) {
+                float angle = i * M_PI / 4;
+                out.push_back((int)((circ->position.x + circ->radius * std::cos(angle)) * scale));
+                out.push_back((int)((circ->position.y + circ->radius * std::sin(angle)) * scale));
+            }
+        } else if (auto tri = dynamic_cast<Triangle*>(shape.get())) {
+            for (const Vec2* p : {&tri->p1, &tri->p2, &tri->p3}) {
+                out.push_back((int)(p->x * scale));
+                out.push_back((int)(p->y * scale));
+            }
+        }
+    }
+}
+
+void drawTyped(const Map& map, float scale, std::vector<int>& out) {
+    out.clear();
+    const ShapeStore& store = map.staticShapes;
+    for (const auto& rect : store.rects) {
+        out.push_back((int)(rect.position.x * scale));
+        out.push_back((int)(rect.position.y * scale));
+        out.push_back((int)(rect.width * scale));
+        out.push_back((int)(rect.height * scale));
+    }
+    for (const auto& circ : store.circles) {
+        for (int i = 0; i < 8; i++) {
+            float angle = i * M_PI / 4;
+            out.push_back((int)((circ.position.x + circ.radius * std::cos(angle)) * scale));
+            out.push_back((int)((circ.position.y + circ.radius * std::sin(angle)) * scale));
+        }
+    }
+    for (const auto& tri : store.tris) {
+        for (const Vec2* p : {&tri.p1, &tri.p2, &tri.p3}) {
+            out.push_back((int)(p->x * scale));
+            out.push_back((int)(p->y * scale));
+        }
+    }
+}
+
+void benchShapeStorage(const std::string& mapFile, int extraShapes) {
+    std::mt19937 rng(1234);
+    Map map = Map::load(mapFile);
+    addRandomShapes(map, extraShapes, rng);
+    map.buildSpatialIndex();
+
+    std::cout << "Shape storage: " << map.shapes.size() << " shapes ("
+              << map.staticShapes.rects.size() << " rect, "
+              << map.staticShapes.tris.size() << " tri, "
+              << map.staticShapes.circles.size() << " circle)\n";
+
+    std::uniform_real_distribution<float> px(-60.0f, 110.0f), py(-60.0f, 60.0f);
+    std::vector<Vec2> probes(256);
+    for (auto& p : probes) p = Vec2(px(rng), py(rng));
+
+    auto collide = [&](auto probe) {
+        return [&, probe] {
+            int hits = 0;
+            for (const auto& p : probes) hits += probe(map, p);
+            benchSink = benchSink + hits;
+        };
+    };
+    report("collision, 256 probes (scan)",
+           timeMs(20, collide(probeVirtual)),
+           timeMs(20, collide(probeTyped)));
+    report("collision, 256 probes (grid)",
+           timeMs(20, collide(probeVirtual)),
+           timeMs(20, collide([](const Map& m, const Vec2& p) { return m.circleHitsStatic(p, 0.5f); })));
+
+    std::vector<int> primitives;
+    primitives.reserve(map.shapes.size() * 16);
+    report("minimap draw emission",
+           timeMs(50, [&] { drawVirtual(map, 4.0f, primitives); benchSink = benchSink + primitives.size(); }),
+           timeMs(50, [&] { drawTyped(map, 4.0f, primitives); benchSink = benchSink + primitives.size(); }));
+}
+
+void benchDistanceField(const std::string& mapFile, int extraShapes) {
+    std::mt19937 rng(99);
+    Map map = Map::load(mapFile);
+    addRandomShapes(map, extraShapes, rng);
+    map.buildSpatialIndex();
+
+    auto start = std::chrono::steady_clock::now();
+    map.bakeDistanceField();
+    double bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Distance field: baked in " << decimals(bakeMs, 1) << " ms\n";
+
+    std::uniform_real_distribution<float> px(-60.0f, 110.0f), py(-60.0f, 60.0f);
+    std::vector<Vec2> probes(4096);
+    for (auto& p : probes) p = Vec2(px(rng), py(rng));
+
+    report("wall clearance, 4096 probes",
+           timeMs(20, [&] {
+               float sum = 0;
+               for (const auto& p : probes) sum += map.distanceToWalls(p, DistanceField::DEFAULT_MAX_DISTANCE);
+               benchSink = benchSink + sum;
+           }),
+           timeMs(20, [&] {
+               float sum = 0;
+               for (const auto& p : probes) sum += map.distanceField.sample(p);
+               benchSink = benchSink + sum;
+           }));
+}
+
+void benchNPCIntegration(size_t count) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> pos(-100.0f, 100.0f), vel(-2.0f, 2.0f);
+
+    // Old layout: one NPC object each, position behind a shared_ptr<Shape>
+    std::vector<NPC> objects;
+    objects.reserve(count);
+    Map map;
+    for (size_t i = 0; i < count; ++i) {
+        Vec2 p(pos(rng), pos(rng)), v(vel(rng), vel(rng));
+        objects.emplace_back(std::make_shared<Circle>(p, 0.3f), v, "crowd");
+    }
+    map.spawnCrowd(Vec2(-100, -100), Vec2(100, 100), count, 1.5f, 0.3f);
+
+    std::cout << "NPC integration: " << count << " NPCs, "
+              << ThreadPool::shared().concurrency() << " threads\n";
+    const float dt = 1.0f / 60.0f;
+    double before = timeMs(20, [&] {
+        for (auto& npc : objects) npc.update(dt);
+        benchSink = benchSink + objects[0].shape->position.x;
+    });
+    report("integrate, store on one thread", before, timeMs(20, [&] {
+        map.npcStore.integrateRange(dt, 0, map.npcStore.size());
+        benchSink = benchSink + map.npcStore.posX[0];
+    }));
+    report("integrate, store on the pool", before, timeMs(20, [&] {
+        map.npcStore.integrate(dt, ThreadPool::shared());
+        benchSink = benchSink + map.npcStore.posX[0];
+    }));
+}
+
+// Counts the overlapping pairs in store the old way, testing every pair
+size_t countOverlapsBrute(const NPCStore& store) {
+    size_t overlaps = 0;
+    for (size_t i = 0; i < store.size(); ++i) {
+        for (size_t j = i + 1; j < store.size(); ++j) {
+            float dx = store.posX[i] - store.posX[j], dy = store.posY[i] - store.posY[j];
+            float reach = store.radius[i] + store.radius[j];
+            overlaps += dx * dx + dy * dy < reach * reach;
+        }
+    }
+    return overlaps;
+}
+
+size_t countOverlapsHashed(const NPCStore& store, NPCHash& hash, float radius) {
+    hash.build(store, 2.0f * radius);
+    size_t overlaps = 0;
+    for (uint32_t i = 0; i < store.size(); ++i) {
+        hash.forEachNear(store.position(i), 2.0f * radius, [&](uint32_t j) {
+            if (j <= i) return;
+            float dx = store.posX[i] - store.posX[j], dy = store.posY[i] - store.posY[j];
+            float reach = store.radius[i] + store.radius[j];
+            overlaps += dx * dx + dy * dy < reach * reach;
+        });
+    }
+    return overlaps;
+}
+
+void benchNPCCollision(const std::string& mapFile, size_t count) {
+    Map map = Map::load(mapFile);
+    map.bakeDistanceField();
+    Vec2 lo(-60.0f, -60.0f), hi(110.0f, 60.0f);
+    map.spawnCrowd(lo, hi, count, 1.5f, 0.3f);
+
+    std::cout << "NPC collision: " << count << " NPCs among "
+              << map.segments.size() << " wall segments\n";
+
+    NPCHash hash;
+    size_t bruteOverlaps = 0, hashedOverlaps = 0;
+    double brute = timeMs(1, [&] { bruteOverlaps = countOverlapsBrute(map.npcStore); });
+    report("overlapping pairs, hashed", brute, timeMs(10, [&] {
+        hashedOverlaps = countOverlapsHashed(map.npcStore, hash, 0.3f);
+    }));
+    if (bruteOverlaps != hashedOverlaps) {
+        std::cout << "  MISMATCH: " << bruteOverlaps << " vs " << hashedOverlaps << " pairs\n";
+    }
+
+    // At a fixed crowd density the whole step should grow about linearly
+    Map base = Map::load(mapFile);
+    base.bakeDistanceField();
+    for (size_t n = count / 2; n <= count * 4; n *= 2) {
+        Map crowd = base;
+        float scale = std::sqrt((float)n / count);
+        crowd.spawnCrowd(lo * scale, hi * scale, n, 1.5f, 0.3f);
+        double step = timeMs(10, [&] { crowd.update(1.0f / 60.0f); });
+        report("update, " + std::to_string(n) + " NPCs", step);
+    }
+}
+
+void benchNPCAvoidance(size_t count) {
+    std::cout << "NPC avoidance: " << count << " NPCs, "
+              << ThreadPool::shared().concurrency() << " threads\n";
+
+    // The neighbour cap bounds the cost per body, whatever the density
+    for (size_t cap : { 4, 10, 16 }) {
+        Map map;
+        map.spawnCrowd(Vec2(-50, -50), Vec2(50, 50), count, 1.5f, 0.3f);
+        map.npcAvoidance.maxNeighbors = cap;
+        NPCLod all;
+        all.scheduleAll(map.npcStore, 1.0f / 60.0f);
+        double step = timeMs(20, [&] {
+            map.npcAvoidance.solve(map.npcStore, all.getAwake(), all.getInteracting(),
+                                   all.getSteps(), ThreadPool::shared());
+            benchSink = benchSink + map.npcStore.velX[0];
+        });
+        report("solve, " + std::to_string(cap) + " neighbours max", step);
+    }
+}
+
+void benchNPCLod(const std::string& mapFile, size_t count) {
+    std::cout << "NPC simulation LOD: player at the center, growing crowd at constant density, "
+              << ThreadPool::shared().concurrency() << " threads\n";
+    Map base = Map::load(mapFile);
+    base.bakeDistanceField();
+    Vec2 lo(-60.0f, -60.0f), hi(110.0f, 60.0f);
+    Vec2 focus = (lo + hi) * 0.5f;
+
+    // With LOD the step should follow the bodies around the player, which
+    // stay about the same in number, rather than the population
+    for (size_t n = count; n <= count * 8; n *= 2) {
+        float scale = std::sqrt((float)n / count);
+        Vec2 half = (hi - lo) * (0.5f * scale);
+        Map full = base;
+        full.spawnCrowd(focus - half, focus + half, n, 1.5f, 0.3f);
+        Map tiered = full;
+
+        double before = timeMs(10, [&] { full.update(1.0f / 60.0f); });
+        double after = timeMs(32, [&] { tiered.update(1.0f / 60.0f, focus); });
+        report("update, " + std::to_string(n) + " NPCs", before, after);
+    }
+}
+
+void benchPerception(const std::string& mapFile, int extraShapes, size_t count) {
+    std::mt19937 rng(4321);
+    Map map = Map::load(mapFile);
+    addRandomShapes(map, extraShapes, rng);
+    map.buildSpatialIndex();
+    map.bakeDistanceField();
+    map.spawnCrowd(Vec2(-60.0f, -60.0f), Vec2(110.0f, 60.0f), count, 1.5f, 0.3f);
+    Vec2 player(25.0f, 0.0f);
+    const NPCStore& store = map.npcStore;
+
+    std::cout << "NPC perception: " << count << " NPCs looking for the player past "
+              << map.shapes.size() << " shapes\n";
+
+    // Everyone in range and looking every way, so both sides cast the same rays
+    NPCPerception& perception = map.npcPerception;
+    perception.fieldOfView = 2.0f * (float)M_PI;
+    float range = perception.viewDistance;
+
+    // One Map::castRay per NPC, as each would do on its own
+    double single = timeMs(5, [&] {
+        for (uint32_t i = 0; i < store.size(); ++i) {
+            Vec2 offset = player - store.position(i);
+            float dist = offset.length();
+            if (dist > range) continue;
+            RayHit hit;
+            Vec2 dir = dist > 1e-6f ? offset * (1.0f / dist) : Vec2(1.0f, 0.0f);
+            benchSink = benchSink + (map.castRay(store.position(i), dir, dist, hit) ? 1.0f : 0.0f);
+        }
+    });
+
+    size_t batchSeen = 0;
+    perception.raysPerStep = count;
+    double batched = timeMs(5, [&] {
+        perception.update(map, player, 1.0f / 60.0f);
+    });
+    for (uint32_t i = 0; i < store.size(); ++i) batchSeen += perception.getAwareness(i).sees;
+    report("line of sight, one batch", single, batched);
+    std::cout << "  (" << perception.getLastRays() << " rays, " << batchSeen << " see the player)\n";
+
+    // Spread over frames, a step costs what the budget allows
+    perception.raysPerStep = 512;
+    double sliced = timeMs(60, [&] { perception.update(map, player, 1.0f / 60.0f); });
+    report("step, 512 rays budget", sliced);
+}
+
+void benchPathfinding(const std::string& mapFile, size_t agents) {
+    Map map = Map::load(mapFile);
+    map.bakeDistanceField();
+
+    auto start = std::chrono::steady_clock::now();
+    map.buildNavMesh();
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Navigation mesh: " << map.navMesh->getRegions().size() << " regions, built in "
+              << decimals(buildMs, 1) << " ms\n";
+
+    // A second's worth of re-paths: agents milling about the square, each
+    // heading for one of a few doors
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> px(-4.0f, 4.0f), py(-4.0f, 4.0f);
+    const Vec2 doors[] = { Vec2(90.0f, -20.0f), Vec2(-40.0f, -40.0f), Vec2(25.0f, 40.0f), Vec2(60.0f, 35.0f) };
+    std::vector<std::pair<Vec2, Vec2>> trips;
+    for (size_t i = 0; i < agents; ++i) {
+        trips.push_back({Vec2(px(rng), py(rng)), doors[i % 4]});
+    }
+
+    std::vector<Vec2> path;
+    size_t searches = 0;
+    report(std::to_string(agents) + " paths, cached service",
+           timeMs(5, [&] {
+               for (const auto& trip : trips) map.navMesh->findPath(trip.first, trip.second, path);
+               benchSink = benchSink + path.size();
+           }),
+           timeMs(5, [&] {
+               PathService service(ThreadPool::shared());
+               std::vector<std::shared_ptr<const PathResult>> results;
+               for (const auto& trip : trips) {
+                   results.push_back(service.request(map.navMesh, trip.first, trip.second));
+               }
+               for (const auto& result : results) {
+                   while (!result->ready()) std::this_thread::yield();
+               }
+               benchSink = benchSink + results.back()->points.size();
+               searches = service.getSearches();
+           }));
+    std::cout << "  (" << searches << " searches for " << agents << " requests)\n";
+}
+
+void benchFlowField(const std::string& mapFile, size_t agents) {
+    Map map = Map::load(mapFile);
+    map.bakeDistanceField();
+    map.buildNavMesh();
+
+    FlowFieldCache flows;
+    auto start = std::chrono::steady_clock::now();
+    flows.build(map, ThreadPool::shared());
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Flow fields: " << flows.getGrid()->width << "x" << flows.getGrid()->height
+              << " grid, built in " << decimals(buildMs, 1) << " ms\n";
+
+    // Everybody heading for the same house
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> px(-40.0f, 100.0f), py(-20.0f, 25.0f);
+    std::vector<Vec2> starts(agents);
+    for (auto& p : starts) p = Vec2(px(rng), py(rng));
+    const Vec2 goal(85.0f, -35.0f);
+
+    std::vector<Vec2> path;
+    report(std::to_string(agents) + " agents to one goal",
+           timeMs(3, [&] {
+               for (const auto& p : starts) map.navMesh->findPath(p, goal, path);
+               benchSink = benchSink + path.size();
+           }),
+           timeMs(3, [&] {
+               FlowFieldCache fresh = flows;   // Same grid, no fields yet
+               auto field = fresh.get(goal, ThreadPool::shared());
+               Vec2 sum;
+               for (const auto& p : starts) sum = sum + field->direction(p);
+               benchSink = benchSink + sum.x;
+           }));
+}
+
+// A multi-megabyte map: the town, count shapes, as many walls and a tenth
+// as many NPCs
+Map makeBigMap(const std::string& mapFile, int count) {
+    Map big = Map::load(mapFile);
+    std::mt19937 rng(5);
+    addRandomShapes(big, count, rng);
+    std::uniform_real_distribution<float> px(-60.0f, 110.0f), py(-60.0f, 60.0f), step(-2.0f, 2.0f);
+    for (int i = 0; i < count; ++i) {
+        std::vector<Vec2> points(2 + i % 3);
+        points[0] = Vec2(px(rng), py(rng));
+        for (size_t k = 1; k < points.size(); ++k) points[k] = points[k - 1] + Vec2(step(rng), step(rng));
+        big.lines.push_back(std::make_shared<Line>(points));
+    }
+    for (int i = 0; i < count / 10; ++i) {
+        auto shape = std::make_shared<Circle>(Vec2(px(rng), py(rng)), 0.5f);
+        big.addNPC(NPC(shape, Vec2(step(rng), step(rng)), "walker_" + std::to_string(i)));
+    }
+    return big;
+}
+
+// The text map reader as it was: an istringstream per line and per
+// coordinate. Returns the records it read.
+size_t parseWithStreams(const std::string& path) {
+    std::ifstream file(path);
+    std::vector<std::shared_ptr<Shape>> shapes;
+    std::vector<std::shared_ptr<Line>> lines;
+    std::vector<NPC> npcs;
+    std::string line;
+    std::getline(file, line);
+
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream iss(line);
+        std::string type;
+        std::getline(iss, type, ',');
+        char comma;
+
+        if (type == "RECT") {
+            float x, y, w, h;
+            iss >> x >> comma >> y >> comma >> w >> comma >> h;
+            if (iss) shapes.push_back(std::make_shared<Rectangle>(Vec2(x, y), w, h));
+        } else if (type == "TRI") {
+            float x1, y1, x2, y2, x3, y3;
+            iss >> x1 >> comma >> y1 >> comma >> x2 >> comma >> y2 >> comma >> x3 >> comma >> y3;
+            if (iss) shapes.push_back(std::make_shared<Triangle>(Vec2(x1, y1), Vec2(x2, y2), Vec2(x3, y3)));
+        } else if (type == "CIRC") {
+            float x, y, r;
+            iss >> x >> comma >> y >> comma >> r;
+            if (iss) shapes.push_back(std::make_shared<Circle>(Vec2(x, y), r));
+        } else if (type == "NPC_CIRC") {
+            float x, y, r, vx, vy;
+            std::string id;
+            iss >> x >> comma >> y >> comma >> r >> comma >> vx >> comma >> vy;
+            if (iss >> comma) std::getline(iss, id);
+            if (iss) npcs.push_back(NPC(std::make_shared<Circle>(Vec2(x, y), r), Vec2(vx, vy), id));
+        } else if (type == "LINE") {
+            std::vector<Vec2> points;
+            std::string coord;
+            while (std::getline(iss, coord, ',')) {
+                float x, y;
+                std::istringstream xIss(coord);
+                xIss >> x;
+                if (xIss) {
+                    std::getline(iss, coord, ',');
+                    std::istringstream yIss(coord);
+                    yIss >> y;
+                    if (yIss) points.push_back(Vec2(x, y));
+                }
+            }
+            if (points.size() >= 2) lines.push_back(std::make_shared<Line>(points));
+        }
+    }
+    return shapes.size() + lines.size() + npcs.size();
+}
+
+void benchTextParser(const Map& big) {
+    std::string textFile = std::filesystem::temp_directory_path().string() + "/map-bench-text.map";
+    big.save(textFile);
+    std::cout << "Text map parser: " << std::filesystem::file_size(textFile) / 1024 << " KB, "
+              << big.shapes.size() + big.lines.size() + big.npcs.size() << " records\n";
+
+    report("parse, streams vs from_chars",
+           timeMs(3, [&] { benchSink = benchSink + parseWithStreams(textFile); }),
+           timeMs(3, [&] {
+               MapText text;
+               parseMapFile(textFile, text);
+               benchSink = benchSink + text.shapes.size() + text.lines.size() + text.npcs.size();
+           }));
+
+    // The same text on one thread and in chunks on the pool
+    std::ifstream file(textFile, std::ios::binary);
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    report("parse, 1 vs " + std::to_string(ThreadPool::shared().concurrency()) + " threads",
+           timeMs(3, [&] {
+               MapText text;
+               parseMapText(buffer, text);
+               benchSink = benchSink + text.lines.size();
+           }),
+           timeMs(3, [&] {
+               MapText text;
+               parseMapText(buffer, text, ThreadPool::shared());
+               benchSink = benchSink + text.lines.size();
+           }));
+    std::filesystem::remove(textFile);
+}
+
+void benchMapFormats(const Map& big) {
+    std::string dir = std::filesystem::temp_directory_path().string();
+    std::string textFile = dir + "/map-bench.map";
+    std::string binaryFile = dir + "/map-bench.fmap";
+    big.save(textFile);
+    big.save(binaryFile);
+    std::cout << "Map formats: " << big.shapes.size() << " shapes, " << big.lines.size() << " lines, "
+              << std::filesystem::file_size(textFile) / 1024 << " KB text, "
+              << std::filesystem::file_size(binaryFile) / 1024 << " KB .fmap\n";
+
+    // Map::load talks on stdout; keep it out of the table
+    std::ostringstream quiet;
+    std::streambuf* out = std::cout.rdbuf(quiet.rdbuf());
+    double text = timeMs(3, [&] { benchSink = benchSink + Map::load(textFile).shapes.size(); });
+    double binary = timeMs(3, [&] { benchSink = benchSink + Map::load(binaryFile).shapes.size(); });
+    double mapped = timeMs(20, [&] {
+        FmapFile file;
+        size_t count = 0;
+        if (file.open(binaryFile)) file.section<FmapRect>(FMAP_RECTS, count);
+        benchSink = benchSink + count;
+    });
+    std::cout.rdbuf(out);
+
+    report("load, text vs .fmap", text, binary);
+    report("open, text load vs mapped .fmap", text, mapped);
+    std::filesystem::remove(textFile);
+    std::filesystem::remove(binaryFile);
+}
+
+void benchWorldStream(int count) {
+    // A world much wider than what is around the player: count shapes and
+    // as many walls over 2 km square
+    const float size = 2000.0f;
+    Map wide;
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> pos(0.0f, size), extent(0.2f, 2.0f), step(-3.0f, 3.0f);
+    for (int i = 0; i < count; ++i) {
+        Vec2 at(pos(rng), pos(rng));
+        wide.addShape(std::make_shared<Rectangle>(at, extent(rng), extent(rng)));
+        wide.lines.push_back(std::make_shared<Line>(std::vector<Vec2>{ at, at + Vec2(step(rng), step(rng)) }));
+    }
+    std::string dir = std::filesystem::temp_directory_path().string() + "/map-bench.world";
+    std::string whole = std::filesystem::temp_directory_path().string() + "/map-bench-world.fmap";
+    writeWorld(wide, dir, 64.0f);
+    wide.save(whole);
+
+    std::ostringstream quiet;
+    std::streambuf* out = std::cout.rdbuf(quiet.rdbuf());
+    double load = timeMs(3, [&] { benchSink = benchSink + Map::load(whole).shapes.size(); });
+
+    // Walk straight across, updating every metre
+    Map map;
+    WorldStream world;
+    world.open(dir);
+    world.loadAround(map, Vec2(0.0f, size * 0.5f), ThreadPool::shared());
+    double worst = 0.0, total = 0.0;
+    size_t updates = 0, maxShapes = 0;
+    for (float x = 0.0f; x <= size; x += 1.0f) {
+        Vec2 focus(x, size * 0.5f);
+        double ms = timeMs(1, [&] { world.update(map, focus, ThreadPool::shared()); });
+        worst = std::max(worst, ms);
+        total += ms;
+        ++updates;
+        maxShapes = std::max(maxShapes, map.shapes.size());
+    }
+    std::cout.rdbuf(out);
+
+    std::cout << "World streaming: " << world.chunkCount() << " chunks of 64 m, at most "
+              << maxShapes << " of " << count << " shapes resident\n";
+    report("whole load vs worst update", load, worst);
+    report("whole load vs mean update", load, total / updates);
+    std::filesystem::remove_all(dir);
+    std::filesystem::remove(whole);
+}
+
+void benchGeometryCleanup(const std::string& mapFile, size_t rays) {
+    // The town's walls as a builder session leaves them: every segment
+    // drawn again as short, slightly overlapping pieces, some twice
+    Map drawn = Map::load(mapFile);
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f), jitter(-0.003f, 0.003f);
+    std::vector<std::shared_ptr<Line>> pieces;
+    for (const auto& line : drawn.lines) {
+        const auto& pts = line->getPoints();
+        for (size_t i = 0; i + 1 < pts.size(); ++i) {
+            for (float t = 0.0f; t < 1.0f;) {
+                float end = std::min(1.0f, t + 0.05f + 0.1f * unit(rng));
+                Vec2 p = pts[i] + (pts[i + 1] - pts[i]) * t + Vec2(jitter(rng), jitter(rng));
+                Vec2 q = pts[i] + (pts[i + 1] - pts[i]) * end + Vec2(jitter(rng), jitter(rng));
+                pieces.push_back(std::make_shared<Line>(std::vector<Vec2>{ p, q }));
+                if (unit(rng) < 0.2f) pieces.push_back(std::make_shared<Line>(std::vector<Vec2>{ q, p }));
+                t = end < 1.0f ? end - 0.02f * unit(rng) : end;
+            }
+        }
+    }
+    drawn.lines = pieces;
+    drawn.buildSpatialIndex();
+
+    Map cleaned = drawn;
+    CleanupStats stats;
+    double cleanMs = timeMs(1, [&] { stats = cleanupLines(cleaned.lines); });
+    cleaned.buildSpatialIndex();
+    std::cout << "Geometry cleanup: " << stats.segmentsBefore << " segments in " << stats.linesBefore
+              << " lines -> " << stats.segmentsAfter << " in " << stats.linesAfter << ", "
+              << decimals(cleanMs, 2) << " ms\n";
+
+    std::uniform_real_distribution<float> px(-50.0f, 100.0f), py(-50.0f, 50.0f), angle(0.0f, 6.2831853f);
+    std::vector<Vec2> origins(rays), dirs(rays);
+    for (size_t i = 0; i < rays; ++i) {
+        float a = angle(rng);
+        origins[i] = Vec2(px(rng), py(rng));
+        dirs[i] = Vec2(std::cos(a), std::sin(a));
+    }
+    auto cast = [&](const Map& map) {
+        RayHit hit;
+        int hits = 0;
+        for (size_t i = 0; i < rays; ++i) hits += map.castRay(origins[i], dirs[i], 60.0f, hit);
+        benchSink = benchSink + hits;
+    };
+    report(std::to_string(rays) + " rays, drawn vs cleaned", timeMs(5, [&] { cast(drawn); }),
+           timeMs(5, [&] { cast(cleaned); }));
+    report("clearance, drawn vs cleaned",
+           timeMs(5, [&] { for (size_t i = 0; i < rays; ++i) benchSink = benchSink + drawn.distanceToWalls(origins[i], 5.0f); }),
+           timeMs(5, [&] { for (size_t i = 0; i < rays; ++i) benchSink = benchSink + cleaned.distanceToWalls(origins[i], 5.0f); }));
+}
+
+// Removing an NPC while bodies added since the last step have no LOD or
+// perception entries yet (as WorldStream does) must leave every other
+// body its own state. Prints the outcome; false if it does not.
+bool checkNPCRemoval() {
+    Map map;
+    std::vector<NPCHandle> handles;
+    auto add = [&](float x) {
+        handles.push_back(map.addNPC(NPC(std::make_shared<Circle>(Vec2(x, 0.0f), 0.3f), Vec2(), "check")));
+    };
+    for (int i = 0; i < 12; ++i) add(10.0f + 20.0f * i);
+    for (int frame = 0; frame < 7; ++frame) map.update(1.0f / 60.0f, Vec2());
+
+    // Each body watches the next one
+    for (size_t k = 0; k + 1 < handles.size(); ++k) {
+        map.npcPerception.setTarget(map.getNPC(handles[k])->body, map.getNPC(handles[k + 1])->body);
+    }
+    std::vector<float> owed;
+    for (NPCHandle h : handles) owed.push_back(map.npcLod.getPending(map.getNPC(h)->body));
+
+    add(500.0f);
+    add(600.0f);
+    map.removeNPC(handles[0]);
+
+    bool ok = true;
+    for (size_t k = 1; k < owed.size(); ++k) {
+        uint32_t body = map.getNPC(handles[k])->body;
+        if (map.npcLod.getPending(body) != owed[k]) ok = false;
+        if (k + 1 < owed.size() &&
+            map.npcPerception.getAwareness(body).target != map.getNPC(handles[k + 1])->body) ok = false;
+    }
+    for (size_t k = owed.size(); k < handles.size(); ++k) {
+        uint32_t body = map.getNPC(handles[k])->body;
+        if (map.npcLod.getPending(body) != 0.0f || map.npcPerception.getAwareness(body).target != UINT32_MAX) {
+            ok = false;
+        }
+    }
+    std::cout << "NPC removal keeps LOD and perception state: " << (ok ? "ok" : "FAILED") << "\n";
+    return ok;
+}
+
+// Rounding the end of a wall: every cell the goal can be reached from
+// needs a way downhill, and an agent starting behind the wall has to get
+// to the goal by following the field
+bool checkFlowAroundWallEnd() {
+    Map map;
+    map.lines.push_back(std::make_shared<Line>(std::vector<Vec2>{ Vec2(0.0f, -10.0f), Vec2(0.0f, -0.1f) }));
+    map.lines.push_back(std::make_shared<Line>(std::vector<Vec2>{ Vec2(-10.0f, -10.0f), Vec2(10.0f, -10.0f) }));
+    map.buildSpatialIndex();
+    FlowFieldCache flows;
+    // Agents thin enough for the cells either side of the wall to be open
+    flows.build(map, ThreadPool::shared(), 0.5f, 0.2f);
+    const Vec2 goal(5.0f, -5.0f);
+    auto field = flows.get(goal, ThreadPool::shared());
+    const FlowGrid& g = *flows.getGrid();
+
+    bool ok = field != nullptr;
+    for (int y = 0; ok && y < g.height; ++y) {
+        for (int x = 0; x < g.width; ++x) {
+            Vec2 p = g.origin + Vec2((x + 0.5f) * g.cellSize, (y + 0.5f) * g.cellSize);
+            if (std::isfinite(field->distance(p)) && field->direction(p).length() == 0.0f &&
+                g.cellAt(p) != field->getGoalCell()) ok = false;
+        }
+    }
+    Vec2 p(-1.0f, -5.0f);
+    for (int step = 0; ok && step < 2000 && g.cellAt(p) != field->getGoalCell(); ++step) {
+        p = p + field->direction(p) * 0.05f;
+    }
+    ok = ok && g.cellAt(p) == field->getGoalCell();
+    std::cout << "Flow field leads round a wall end: " << (ok ? "ok" : "FAILED") << "\n";
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string mapFile = argc > 1 ? argv[1] : "map/town.map";
+    int extraShapes = argc > 2 ? std::atoi(argv[2]) : 20000;
+
+    if (!checkNPCRemoval() || !checkFlowAroundWallEnd()) return 1;
+    benchShapeStorage(mapFile, extraShapes);
+    benchDistanceField(mapFile, extraShapes);
+    benchNPCIntegration(100000);
+    benchNPCCollision(mapFile, 20000);
+    benchNPCLod(mapFile, 10000);
+    benchPerception(mapFile, extraShapes / 10, 20000);
+    benchNPCAvoidance(10000);
+    benchPathfinding(mapFile, 500);
+    benchFlowField(mapFile, 20000);
+    Map big = makeBigMap(mapFile, extraShapes * 5);
+    benchTextParser(big);
+    benchMapFormats(big);
+    benchWorldStream(extraShapes * 10);
+    benchGeometryCleanup(mapFile, 20000);
+    return 0;
+}
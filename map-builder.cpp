@@ -3,7 +3,6 @@
 #include <vector>
 #include <memory>
 #include <fstream>
-#include <sstream>
 #include <cmath>
 #include "Vec2.hh"
 #include "npc/Shape.hh"
@@ -12,6 +11,10 @@
 #include "npc/Shapes/Circle.hh"
 #include "npc/Shapes/Line.hh"
 #include "npc/npc.hh"
+#include "map/distance-field.hh"
+#include "map/geometry-cleanup.hh"
+#include "map/map-parser.hh"
+#include "engine/thread-pool.hh"
 
 const int WINDOW_WIDTH = 1400;
 const int WINDOW_HEIGHT = 800;
@@ -56,6 +59,12 @@ private:
     // Map name
     std::string mapName;
     
+    // The preview sphere-traces a distance field of the static geometry,
+    // rebaked whenever a shape or line is added or removed
+    DistanceField previewField;
+    bool previewFieldDirty = true;
+    std::vector<uint8_t> previewDone;
+    
 public:
     MapBuilder() : window(nullptr), renderer(nullptr), running(true),
                    currentTool(Tool::RECTANGLE), isDragging(false),
@@ -99,6 +108,7 @@ public:
         std::cout << "  E - Edit selected NPC ID" << std::endl;
         std::cout << "  S - Save map" << std::endl;
         std::cout << "  L - Load map" << std::endl;
+        std::cout << "  K - Clean up walls (weld, merge and join lines)" << std::endl;
         std::cout << "  Arrow Keys - Pan camera" << std::endl;
         std::cout << "  +/- - Zoom in/out" << std::endl;
         std::cout << "  ESC - Quit" << std::endl;
@@ -187,6 +197,7 @@ public:
                             // Finish the line
                             if (currentLinePoints.size() >= 2) {
                                 lines.push_back(std::make_shared<Line>(currentLinePoints));
+                                previewFieldDirty = true;
                                 std::cout << "Line created with " << currentLinePoints.size() << " points" << std::endl;
                             }
                             currentLinePoints.clear();
@@ -200,6 +211,7 @@ public:
                     case SDLK_e: editNPCProperties(selectedNPC); break;
                     case SDLK_s: saveMap(); break;
                     case SDLK_l: loadMap(); break;
+                    case SDLK_k: cleanupWalls(); break;
                     case SDLK_LEFT: cameraOffset.x += 20; break;
                     case SDLK_RIGHT: cameraOffset.x -= 20; break;
                     case SDLK_UP: cameraOffset.y += 20; break;
@@ -225,6 +237,7 @@ public:
                                 shapes.push_back(std::make_shared<Triangle>(
                                     trianglePoints[0], trianglePoints[1], trianglePoints[2]
                                 ));
+                                previewFieldDirty = true;
                                 std::cout << "Triangle created!" << std::endl;
                                 trianglePoints.clear();
                             }
@@ -235,6 +248,7 @@ public:
                                 if (shapes[i]->intersectsVerticalLine(worldPos.x, minY, maxY)) {
                                     if (worldPos.y >= minY && worldPos.y <= maxY) {
                                         shapes.erase(shapes.begin() + i);
+                                        previewFieldDirty = true;
                                         std::cout << "Shape deleted" << std::endl;
                                         break;
                                     }
@@ -285,6 +299,7 @@ public:
                         
                         if (w > 0.1f && h > 0.1f) {
                             shapes.push_back(std::make_shared<Rectangle>(Vec2(x, y), w, h));
+                            previewFieldDirty = true;
                             std::cout << "Rectangle created at (" << x << ", " << y << ") size " << w << "x" << h << std::endl;
                         }
                     } else if (currentTool == Tool::CIRCLE || currentTool == Tool::NPC) {
@@ -315,6 +330,7 @@ public:
                                 std::cout << "NPC created with ID: " << npcId << std::endl;
                             } else {
                                 shapes.push_back(circle);
+                                previewFieldDirty = true;
                                 std::cout << "Circle created at (" << center.x << ", " << center.y << ") radius " << radius << std::endl;
                             }
                         }
@@ -339,25 +355,38 @@ public:
         file << "MAP:" << mapName << "\n";
         
         for (const auto& shape : shapes) {
-            if (auto rect = dynamic_cast<Rectangle*>(shape.get())) {
-                file << "RECT," << rect->position.x << "," << rect->position.y << ","
-                     << rect->width << "," << rect->height << "\n";
-            } else if (auto tri = dynamic_cast<Triangle*>(shape.get())) {
-                file << "TRI," << tri->p1.x << "," << tri->p1.y << ","
-                     << tri->p2.x << "," << tri->p2.y << ","
-                     << tri->p3.x << "," << tri->p3.y << "\n";
-            } else if (auto circ = dynamic_cast<Circle*>(shape.get())) {
-                file << "CIRC," << circ->position.x << "," << circ->position.y << ","
-                     << circ->radius << "\n";
+            switch (shape->getKind()) {
+                case ShapeKind::RECTANGLE: {
+                    const auto& rect = static_cast<const Rectangle&>(*shape);
+                    file << "RECT," << rect.position.x << "," << rect.position.y << ","
+                         << rect.width << "," << rect.height << "\n";
+                    break;
+                }
+                case ShapeKind::TRIANGLE: {
+                    const auto& tri = static_cast<const Triangle&>(*shape);
+                    file << "TRI," << tri.p1.x << "," << tri.p1.y << ","
+                         << tri.p2.x << "," << tri.p2.y << ","
+                         << tri.p3.x << "," << tri.p3.y << "\n";
+                    break;
+                }
+                case ShapeKind::CIRCLE: {
+                    const auto& circ = static_cast<const Circle&>(*shape);
+                    file << "CIRC," << circ.position.x << "," << circ.position.y << ","
+                         << circ.radius << "\n";
+                    break;
+                }
+                case ShapeKind::LINE:
+                    break;
             }
         }
         
         // Save NPCs with only id
         for (const auto& npc : npcs) {
-            if (auto circ = dynamic_cast<Circle*>(npc.shape.get())) {
+            if (npc.shape->getKind() == ShapeKind::CIRCLE) {
+                const auto& circ = static_cast<const Circle&>(*npc.shape);
                 file << "NPC_CIRC," 
-                     << circ->position.x << "," << circ->position.y << ","
-                     << circ->radius << "," 
+                     << circ.position.x << "," << circ.position.y << ","
+                     << circ.radius << "," 
                      << npc.velocity.x << "," << npc.velocity.y << ","
                      << npc.id << "\n";
             }
@@ -375,6 +404,13 @@ public:
         std::cout << "Map saved to " << filename << std::endl;
     }
     
+    void cleanupWalls() {
+        CleanupStats stats = cleanupLines(lines);
+        previewFieldDirty = true;
+        std::cout << "Walls cleaned: " << stats.segmentsBefore << " segments in " << stats.linesBefore
+                  << " lines -> " << stats.segmentsAfter << " in " << stats.linesAfter << std::endl;
+    }
+    
     void loadMap() {
         std::cout << "Enter map filename (without .map extension): ";
         std::string filename;
@@ -384,91 +420,18 @@ public:
         
         filename = "map/" + filename + ".map";
         
-        std::ifstream file(filename);
-        if (!file.good()) {
-            std::cout << "File not found: " << filename << std::endl;
+        MapText text;
+        if (!parseMapFile(filename, text)) {
+            std::cout << "Could not load " << filename << std::endl;
             return;
         }
         
-        shapes.clear();
-        npcs.clear();
-        lines.clear();
+        mapName = std::move(text.name);
+        shapes = std::move(text.shapes);
+        npcs = std::move(text.npcs);
+        lines = std::move(text.lines);
         selectedNPC = -1;
-        
-        std::string line;
-        if (std::getline(file, line)) {
-            if (line.substr(0, 4) == "MAP:") {
-                mapName = line.substr(4);
-            }
-        }
-        
-        while (std::getline(file, line)) {
-            if (line.empty() || line[0] == '#') continue;
-            
-            std::istringstream iss(line);
-            std::string type;
-            std::getline(iss, type, ',');
-            
-            char comma;
-            
-            if (type == "RECT") {
-                float x, y, w, h;
-                iss >> x >> comma >> y >> comma >> w >> comma >> h;
-                if (iss) {
-                    shapes.push_back(std::make_shared<Rectangle>(Vec2(x, y), w, h));
-                }
-            } else if (type == "TRI") {
-                float x1, y1, x2, y2, x3, y3;
-                iss >> x1 >> comma >> y1 >> comma >> x2 >> comma >> y2 >> comma >> x3 >> comma >> y3;
-                if (iss) {
-                    shapes.push_back(std::make_shared<Triangle>(Vec2(x1,y1), Vec2(x2,y2), Vec2(x3,y3)));
-                }
-            } else if (type == "CIRC") {
-                float x, y, r;
-                iss >> x >> comma >> y >> comma >> r;
-                if (iss) {
-                    shapes.push_back(std::make_shared<Circle>(Vec2(x, y), r));
-                }
-            } else if (type == "NPC_CIRC") {
-                float x, y, r, vx, vy;
-                std::string npcId;
-                
-                iss >> x >> comma >> y >> comma >> r >> comma >> vx >> comma >> vy;
-                
-                // Optional id
-                if (iss >> comma) {
-                    std::getline(iss, npcId);
-                    // Clean whitespace
-                    npcId.erase(0, npcId.find_first_not_of(" \t\r\n"));
-                    npcId.erase(npcId.find_last_not_of(" \t\r\n") + 1);
-                }
-                
-                if (iss) {
-                    auto shape = std::make_shared<Circle>(Vec2(x, y), r);
-                    NPC newNPC(shape, Vec2(vx, vy), npcId);
-                    npcs.push_back(newNPC);
-                }
-            } else if (type == "LINE") {
-                std::vector<Vec2> linePoints;
-                std::string coord;
-                while (std::getline(iss, coord, ',')) {
-                    float x, y;
-                    std::istringstream coordIss(coord);
-                    coordIss >> x;
-                    if (coordIss) {
-                        std::getline(iss, coord, ',');
-                        std::istringstream yIss(coord);
-                        yIss >> y;
-                        if (yIss) {
-                            linePoints.push_back(Vec2(x, y));
-                        }
-                    }
-                }
-                if (linePoints.size() >= 2) {
-                    lines.push_back(std::make_shared<Line>(linePoints));
-                }
-            }
-        }
+        previewFieldDirty = true;
         
         std::cout << "Map loaded from " << filename << std::endl;
         std::cout << "Loaded " << shapes.size() << " shapes and " << npcs.size() << " NPCs" << std::endl;
@@ -500,28 +463,40 @@ public:
         // Draw shapes
         SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
         for (const auto& shape : shapes) {
-            if (auto rect = dynamic_cast<Rectangle*>(shape.get())) {
-                Vec2 tl = worldToScreen(Vec2(rect->position.x, rect->position.y + rect->height));
-                Vec2 br = worldToScreen(Vec2(rect->position.x + rect->width, rect->position.y));
-                SDL_Rect r = {(int)tl.x, (int)tl.y, (int)(br.x - tl.x), (int)(br.y - tl.y)};
-                SDL_RenderDrawRect(renderer, &r);
-            } else if (auto circ = dynamic_cast<Circle*>(shape.get())) {
-                Vec2 center = worldToScreen(circ->position);
-                int r = (int)(circ->radius * zoom);
-                for (int i = 0; i < 32; i++) {
-                    float angle1 = i * 2 * M_PI / 32;
-                    float angle2 = (i + 1) * 2 * M_PI / 32;
-                    SDL_RenderDrawLine(renderer,
-                        center.x + r * std::cos(angle1), center.y - r * std::sin(angle1),
-                        center.x + r * std::cos(angle2), center.y - r * std::sin(angle2));
+            switch (shape->getKind()) {
+                case ShapeKind::RECTANGLE: {
+                    const auto& rect = static_cast<const Rectangle&>(*shape);
+                    Vec2 tl = worldToScreen(Vec2(rect.position.x, rect.position.y + rect.height));
+                    Vec2 br = worldToScreen(Vec2(rect.position.x + rect.width, rect.position.y));
+                    SDL_Rect r = {(int)tl.x, (int)tl.y, (int)(br.x - tl.x), (int)(br.y - tl.y)};
+                    SDL_RenderDrawRect(renderer, &r);
+                    break;
                 }
-            } else if (auto tri = dynamic_cast<Triangle*>(shape.get())) {
-                Vec2 p1 = worldToScreen(tri->p1);
-                Vec2 p2 = worldToScreen(tri->p2);
-                Vec2 p3 = worldToScreen(tri->p3);
-                SDL_RenderDrawLine(renderer, p1.x, p1.y, p2.x, p2.y);
-                SDL_RenderDrawLine(renderer, p2.x, p2.y, p3.x, p3.y);
-                SDL_RenderDrawLine(renderer, p3.x, p3.y, p1.x, p1.y);
+                case ShapeKind::CIRCLE: {
+                    const auto& circ = static_cast<const Circle&>(*shape);
+                    Vec2 center = worldToScreen(circ.position);
+                    int r = (int)(circ.radius * zoom);
+                    for (int i = 0; i < 32; i++) {
+                        float angle1 = i * 2 * M_PI / 32;
+                        float angle2 = (i + 1) * 2 * M_PI / 32;
+                        SDL_RenderDrawLine(renderer,
+                            center.x + r * std::cos(angle1), center.y - r * std::sin(angle1),
+                            center.x + r * std::cos(angle2), center.y - r * std::sin(angle2));
+                    }
+                    break;
+                }
+                case ShapeKind::TRIANGLE: {
+                    const auto& tri = static_cast<const Triangle&>(*shape);
+                    Vec2 p1 = worldToScreen(tri.p1);
+                    Vec2 p2 = worldToScreen(tri.p2);
+                    Vec2 p3 = worldToScreen(tri.p3);
+                    SDL_RenderDrawLine(renderer, p1.x, p1.y, p2.x, p2.y);
+                    SDL_RenderDrawLine(renderer, p2.x, p2.y, p3.x, p3.y);
+                    SDL_RenderDrawLine(renderer, p3.x, p3.y, p1.x, p1.y);
+                    break;
+                }
+                case ShapeKind::LINE:
+                    break;
             }
         }
         
@@ -562,9 +537,10 @@ public:
                 SDL_SetRenderDrawColor(renderer, 255, 100, 100, 255); // red
             }
             
-            if (auto circ = dynamic_cast<Circle*>(npc.shape.get())) {
-                Vec2 center = worldToScreen(circ->position);
-                int r = (int)(circ->radius * zoom);
+            if (npc.shape->getKind() == ShapeKind::CIRCLE) {
+                const auto& circ = static_cast<const Circle&>(*npc.shape);
+                Vec2 center = worldToScreen(circ.position);
+                int r = (int)(circ.radius * zoom);
                 for (int j = 0; j < 32; j++) {
                     float angle1 = j * 2 * M_PI / 32;
                     float angle2 = (j + 1) * 2 * M_PI / 32;
@@ -574,7 +550,7 @@ public:
                 }
                 
                 // Velocity arrow
-                Vec2 arrowEnd = worldToScreen(Vec2(circ->position.x + npc.velocity.x, circ->position.y + npc.velocity.y));
+                Vec2 arrowEnd = worldToScreen(Vec2(circ.position.x + npc.velocity.x, circ.position.y + npc.velocity.y));
                 SDL_RenderDrawLine(renderer, center.x, center.y, arrowEnd.x, arrowEnd.y);
             }
         }
@@ -648,39 +624,38 @@ public:
         SDL_SetRenderDrawColor(renderer, 100, 100, 150, 255);
         SDL_RenderDrawLine(renderer, previewX, previewY, previewX + previewWidth, previewY);
         
+        if (previewFieldDirty) {
+            previewField.bake(lines, shapes, DistanceField::DEFAULT_CELL_SIZE,
+                              DistanceField::DEFAULT_MAX_DISTANCE, ThreadPool::shared());
+            previewFieldDirty = false;
+        }
+        
+        // Static geometry comes from the field in a handful of steps per
+        // column; NPCs are few and tested exactly, up to the first wall
+        previewDone.assign(previewWidth, 0);
         for (int i = 0; i < previewWidth; i++) {
             float screenPercent = (float)i / previewWidth;
             float angle = viewAngle + (screenPercent - 0.5f) * M_PI;
+            Vec2 dir(std::cos(angle), std::sin(angle));
             
-            Vec2 rayDir(std::cos(angle), std::sin(angle));
-            bool hit = false;
-            
-            for (float dist = 0.1f; dist < 50.0f && !hit; dist += 0.5f) {
-                Vec2 checkPos = playerPos + rayDir * dist;
-                
-                for (const auto& shape : shapes) {
-                    float minY, maxY;
-                    if (shape->intersectsVerticalLine(checkPos.x, minY, maxY)) {
-                        if (checkPos.y >= minY && checkPos.y <= maxY) {
-                            hit = true;
-                            break;
-                        }
-                    }
-                }
-                
-                for (const auto& npc : npcs) {
-                    float minY, maxY;
-                    if (npc.shape->intersectsVerticalLine(checkPos.x, minY, maxY)) {
-                        if (checkPos.y >= minY && checkPos.y <= maxY) {
-                            hit = true;
-                            break;
-                        }
-                    }
+            float reach = 50.0f;
+            float t;
+            Vec2 normal;
+            if (previewField.traceRay(playerPos, dir, reach, t)) {
+                previewDone[i] = 1;
+                reach = t;
+            }
+            for (const auto& npc : npcs) {
+                if (npc.shape->intersectRay(playerPos, dir, reach, t, normal)) {
+                    previewDone[i] = 1;
+                    break;
                 }
             }
-            
-            if (hit) {
-                SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+        }
+        
+        SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+        for (int i = 0; i < previewWidth; i++) {
+            if (previewDone[i]) {
                 SDL_RenderDrawPoint(renderer, previewX + i, previewY);
             }
         }
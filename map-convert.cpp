@@ -0,0 +1,83 @@
+// Converts maps between the text format and the binary .fmap format. The
+// output format follows the output file name:
+//
+//   make convert
+//   ./map-convert map/town.map map/town.fmap
+//   ./map-convert map/town.fmap town-copy.map
+//
+// or cuts a map into a directory of chunks for WorldStream:
+//
+//   ./map-convert --world 64 big.map map/big.world
+//
+// --clean welds, merges and joins the walls on the way (see
+// cleanupLines()):
+//
+//   ./map-convert --clean map/town.map map/town.fmap
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "map/map.hh"
+#include "map/fmap.hh"
+#include "map/geometry-cleanup.hh"
+#include "map/world-stream.hh"
+
+int main(int argc, char* argv[]) {
+    float chunkSize = 0.0f;
+    bool clean = false;
+    bool badOption = false;
+    int first = 1;
+    for (; first < argc && std::string(argv[first]).compare(0, 2, "--") == 0; ++first) {
+        std::string option = argv[first];
+        if (option == "--clean") {
+            clean = true;
+        } else if (option == "--world" && first + 1 < argc) {
+            chunkSize = (float)std::atof(argv[++first]);
+            badOption |= !(chunkSize > 0.0f);
+        } else {
+            badOption = true;
+        }
+    }
+    if (argc - first != 2 || badOption) {
+        std::cerr << "usage: " << argv[0] << " [--clean] <input .map|.fmap> <output .map|.fmap>\n"
+                  << "       " << argv[0] << " [--clean] --world <chunk size> <input .map|.fmap> <output directory>"
+                  << std::endl;
+        return 1;
+    }
+    std::string input = argv[first];
+    std::string output = argv[first + 1];
+
+    Map map = Map::load(input);
+    if (map.shapes.empty() && map.lines.empty() && map.npcs.empty()) {
+        std::cerr << "Nothing loaded from " << input << std::endl;
+        return 1;
+    }
+
+    if (clean) {
+        CleanupStats stats = cleanupLines(map.lines);
+        std::cout << "Cleaned walls: " << stats.linesBefore << " lines, " << stats.segmentsBefore
+                  << " segments -> " << stats.linesAfter << " lines, " << stats.segmentsAfter << " segments ("
+                  << stats.verticesWelded << " vertices welded, " << stats.merged << " pieces merged, "
+                  << stats.degenerate << " empty dropped)" << std::endl;
+    }
+
+    if (chunkSize > 0.0f) {
+        if (!writeWorld(map, output, chunkSize)) return 1;
+        WorldStream check;
+        if (!check.open(output)) return 1;
+        std::cout << "Wrote " << check.chunkCount() << " chunks to " << output << std::endl;
+        return 0;
+    }
+
+    if (!map.save(output)) return 1;
+
+    // Read it back so a bad write shows up here rather than in the game
+    if (isFmap(output)) {
+        FmapFile check;
+        if (!check.open(output)) {
+            std::cerr << "Wrote an unreadable file: " << check.getError() << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Wrote " << output << std::endl;
+    return 0;
+}
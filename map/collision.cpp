@@ -0,0 +1,235 @@
+#include "collision.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+float dot(const Vec2& a, const Vec2& b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+void record(SweepHit& hit, float time, const Vec2& normal) {
+    if (hit.hit && time >= hit.time) return;
+    hit.hit = true;
+    hit.time = time;
+    hit.normal = normal;
+}
+
+// Earliest t in [0, 1] at which start + delta * t is within radius of
+// center. Starting inside counts only when moving further in.
+void sweepPointCircle(const Vec2& start, const Vec2& delta,
+                      const Vec2& center, float radius, SweepHit& hit) {
+    Vec2 toStart = start - center;
+    float c = dot(toStart, toStart) - radius * radius;
+    float b = dot(toStart, delta);
+
+    if (c < 0.0f) {
+        if (b < 0.0f) {
+            record(hit, 0.0f, toStart.normalized());
+        }
+        return;
+    }
+
+    float a = dot(delta, delta);
+    if (a < 1e-12f || b >= 0.0f) return;
+
+    float disc = b * b - a * c;
+    if (disc < 0.0f) return;
+
+    float t = (-b - std::sqrt(disc)) / a;
+    if (t <= hit.time && t <= 1.0f) {
+        Vec2 contact = start + delta * t;
+        record(hit, std::max(0.0f, t), (contact - center).normalized());
+    }
+}
+
+void record(Contact& contact, float depth, const Vec2& normal) {
+    if (contact.hit && depth <= contact.depth) return;
+    contact.hit = true;
+    contact.depth = depth;
+    contact.normal = normal;
+}
+
+Vec2 closestOnSegment(const Vec2& p, const Vec2& a, const Vec2& b) {
+    Vec2 edge = b - a;
+    float lenSq = dot(edge, edge);
+    if (lenSq < 1e-12f) return a;
+    float u = std::clamp(dot(p - a, edge) / lenSq, 0.0f, 1.0f);
+    return a + edge * u;
+}
+
+} // namespace
+
+void sweepCircleSegment(const Vec2& start, const Vec2& delta, float r,
+                        const Vec2& a, const Vec2& b, SweepHit& hit) {
+    Vec2 edge = b - a;
+    float lenSq = dot(edge, edge);
+    if (lenSq < 1e-12f) {
+        sweepPointCircle(start, delta, a, r, hit);
+        return;
+    }
+
+    // Flat side of the capsule, on whichever side we start from
+    Vec2 normal = Vec2(-edge.y, edge.x) * (1.0f / std::sqrt(lenSq));
+    float startDist = dot(start - a, normal);
+    if (startDist < 0.0f) {
+        normal = normal * -1.0f;
+        startDist = -startDist;
+    }
+
+    float along = dot(start - a, edge) / lenSq;
+    if (startDist < r && along >= 0.0f && along <= 1.0f) {
+        // Already touching the flat side
+        if (dot(delta, normal) < 0.0f) {
+            record(hit, 0.0f, normal);
+        }
+        return;
+    }
+
+    float approach = dot(delta, normal);
+    if (approach < 0.0f && startDist >= r) {
+        float t = (r - startDist) / approach;
+        if (t <= 1.0f && t <= hit.time) {
+            Vec2 contact = start + delta * t;
+            float u = dot(contact - a, edge) / lenSq;
+            if (u >= 0.0f && u <= 1.0f) {
+                record(hit, t, normal);
+                return;  // The side is always reached before the caps
+            }
+        }
+    }
+
+    // Rounded caps at the ends
+    sweepPointCircle(start, delta, a, r, hit);
+    sweepPointCircle(start, delta, b, r, hit);
+}
+
+void sweepCircleCircle(const Vec2& start, const Vec2& delta, float r,
+                       const Vec2& center, float radius, SweepHit& hit) {
+    sweepPointCircle(start, delta, center, radius + r, hit);
+}
+
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Rectangle& rect, SweepHit& hit) {
+    Vec2 p0 = rect.position;
+    Vec2 p1(p0.x + rect.width, p0.y);
+    Vec2 p2(p0.x + rect.width, p0.y + rect.height);
+    Vec2 p3(p0.x, p0.y + rect.height);
+    sweepCircleSegment(start, delta, r, p0, p1, hit);
+    sweepCircleSegment(start, delta, r, p1, p2, hit);
+    sweepCircleSegment(start, delta, r, p2, p3, hit);
+    sweepCircleSegment(start, delta, r, p3, p0, hit);
+}
+
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Triangle& tri, SweepHit& hit) {
+    sweepCircleSegment(start, delta, r, tri.p1, tri.p2, hit);
+    sweepCircleSegment(start, delta, r, tri.p2, tri.p3, hit);
+    sweepCircleSegment(start, delta, r, tri.p3, tri.p1, hit);
+}
+
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Circle& circle, SweepHit& hit) {
+    sweepCircleCircle(start, delta, r, circle.position, circle.radius, hit);
+}
+
+void contactCircleSegment(const Vec2& center, float r,
+                          const Vec2& a, const Vec2& b, Contact& contact) {
+    Vec2 offset = center - closestOnSegment(center, a, b);
+    float distSq = dot(offset, offset);
+    if (distSq >= r * r) return;
+
+    float dist = std::sqrt(distSq);
+    Vec2 normal;
+    if (dist > 1e-6f) {
+        normal = offset * (1.0f / dist);
+    } else {
+        // Center right on the line: pick a side
+        Vec2 edge = (b - a).normalized();
+        normal = edge.length() > 0.0f ? Vec2(-edge.y, edge.x) : Vec2(1.0f, 0.0f);
+    }
+    record(contact, r - dist, normal);
+}
+
+void contactCircleCircle(const Vec2& center, float r,
+                         const Vec2& other, float radius, Contact& contact) {
+    Vec2 offset = center - other;
+    float reach = r + radius;
+    float distSq = dot(offset, offset);
+    if (distSq >= reach * reach) return;
+
+    float dist = std::sqrt(distSq);
+    Vec2 normal = dist > 1e-6f ? offset * (1.0f / dist) : Vec2(1.0f, 0.0f);
+    record(contact, reach - dist, normal);
+}
+
+void contactCircleShape(const Vec2& center, float r,
+                        const Rectangle& rect, Contact& contact) {
+    float minX = rect.position.x, maxX = minX + rect.width;
+    float minY = rect.position.y, maxY = minY + rect.height;
+
+    bool inside = center.x > minX && center.x < maxX &&
+                  center.y > minY && center.y < maxY;
+    if (!inside) {
+        Vec2 closest(std::clamp(center.x, minX, maxX), std::clamp(center.y, minY, maxY));
+        Vec2 offset = center - closest;
+        float distSq = dot(offset, offset);
+        if (distSq >= r * r) return;
+        float dist = std::sqrt(distSq);
+        if (dist > 1e-6f) {
+            record(contact, r - dist, offset * (1.0f / dist));
+            return;
+        }
+    }
+
+    // Out through the nearest side
+    float left = center.x - minX, right = maxX - center.x;
+    float top = center.y - minY, bottom = maxY - center.y;
+    float nearest = std::min(std::min(left, right), std::min(top, bottom));
+    Vec2 normal = nearest == left  ? Vec2(-1.0f, 0.0f)
+                : nearest == right ? Vec2(1.0f, 0.0f)
+                : nearest == top   ? Vec2(0.0f, -1.0f)
+                                   : Vec2(0.0f, 1.0f);
+    record(contact, r + std::max(0.0f, nearest), normal);
+}
+
+void contactCircleShape(const Vec2& center, float r,
+                        const Triangle& tri, Contact& contact) {
+    const Vec2* corners[3] = { &tri.p1, &tri.p2, &tri.p3 };
+
+    // Nearest point on the outline
+    Vec2 nearest;
+    float nearestSq = INFINITY;
+    for (int i = 0; i < 3; ++i) {
+        Vec2 p = closestOnSegment(center, *corners[i], *corners[(i + 1) % 3]);
+        Vec2 offset = center - p;
+        float distSq = dot(offset, offset);
+        if (distSq < nearestSq) {
+            nearestSq = distSq;
+            nearest = p;
+        }
+    }
+
+    // Inside when the center is on the same side of all three edges
+    float signs[3];
+    for (int i = 0; i < 3; ++i) {
+        const Vec2& a = *corners[i];
+        const Vec2& b = *corners[(i + 1) % 3];
+        signs[i] = (b.x - a.x) * (center.y - a.y) - (b.y - a.y) * (center.x - a.x);
+    }
+    bool inside = (signs[0] > 0 && signs[1] > 0 && signs[2] > 0) ||
+                  (signs[0] < 0 && signs[1] < 0 && signs[2] < 0);
+
+    float dist = std::sqrt(nearestSq);
+    if (!inside) {
+        if (dist >= r || dist <= 1e-6f) return;
+        record(contact, r - dist, (center - nearest) * (1.0f / dist));
+    } else if (dist > 1e-6f) {
+        record(contact, r + dist, (nearest - center) * (1.0f / dist));
+    }
+}
+
+void contactCircleShape(const Vec2& center, float r,
+                        const Circle& circle, Contact& contact) {
+    contactCircleCircle(center, r, circle.position, circle.radius, contact);
+}
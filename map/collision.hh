@@ -0,0 +1,56 @@
+#ifndef COLLISION_HH
+#define COLLISION_HH
+
+#include "../Vec2.hh"
+#include "../npc/Shapes/Rectangle.hh"
+#include "../npc/Shapes/Triangle.hh"
+#include "../npc/Shapes/Circle.hh"
+
+// First contact of a circle swept along a straight move
+struct SweepHit {
+    bool hit = false;
+    float time = 1.0f;   // Fraction of the move done at contact, in [0, 1]
+    Vec2 normal;         // Unit contact normal, pointing away from the obstacle
+};
+
+// Narrow-phase sweeps of a circle (center start, radius r) moving by delta.
+// Each one only replaces hit when it finds an earlier contact, so they can
+// be chained over many candidates. A circle that already overlaps an
+// obstacle at the start only reports contact if the move goes deeper, so a
+// stuck mover can always back out.
+void sweepCircleSegment(const Vec2& start, const Vec2& delta, float r,
+                        const Vec2& a, const Vec2& b, SweepHit& hit);
+void sweepCircleCircle(const Vec2& start, const Vec2& delta, float r,
+                       const Vec2& center, float radius, SweepHit& hit);
+
+// Solid shapes are swept against their outline
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Rectangle& rect, SweepHit& hit);
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Triangle& tri, SweepHit& hit);
+void sweepCircleShape(const Vec2& start, const Vec2& delta, float r,
+                      const Circle& circle, SweepHit& hit);
+
+// Overlap of a circle at rest: how far it has sunk into an obstacle
+struct Contact {
+    bool hit = false;
+    float depth = 0.0f;  // Distance to move along normal to just touch
+    Vec2 normal;         // Unit direction out of the obstacle
+};
+
+// Narrow-phase overlap tests of a circle (center, radius r). Each one only
+// replaces contact when it finds a deeper overlap, so they chain like the
+// sweeps. Solid shapes push a circle whose center is inside out through
+// the nearest side.
+void contactCircleSegment(const Vec2& center, float r,
+                          const Vec2& a, const Vec2& b, Contact& contact);
+void contactCircleCircle(const Vec2& center, float r,
+                         const Vec2& other, float radius, Contact& contact);
+void contactCircleShape(const Vec2& center, float r,
+                        const Rectangle& rect, Contact& contact);
+void contactCircleShape(const Vec2& center, float r,
+                        const Triangle& tri, Contact& contact);
+void contactCircleShape(const Vec2& center, float r,
+                        const Circle& circle, Contact& contact);
+
+#endif // COLLISION_HH
@@ -0,0 +1,262 @@
+#include "distance-field.hh"
+#include "grid-fit.hh"
+#include "segment-buffer.hh"
+#include "../engine/thread-pool.hh"
+#include "../npc/Shapes/Rectangle.hh"
+#include "../npc/Shapes/Triangle.hh"
+#include "../npc/Shapes/Circle.hh"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Same idea as the spatial grid's cap: a stray far-away point makes the
+// cells bigger rather than the raster huge
+const double MAX_SAMPLES = 1 << 23;
+
+// Raster samples per tile side; a tile is one unit of parallel work and
+// gathers its own short list of nearby geometry
+const int TILE = 8;
+
+float segmentDistance(const Vec2& p, const Vec2& a, const Vec2& b) {
+    Vec2 ab = b - a, ap = p - a;
+    float lenSq = ab.x * ab.x + ab.y * ab.y;
+    float t = lenSq > 0.0f ? std::max(0.0f, std::min(1.0f, (ap.x * ab.x + ap.y * ab.y) / lenSq)) : 0.0f;
+    return (ap - ab * t).length();
+}
+
+float signedDistance(const Shape& shape, const Vec2& p) {
+    switch (shape.getKind()) {
+        case ShapeKind::RECTANGLE: {
+            const auto& rect = static_cast<const Rectangle&>(shape);
+            Vec2 half(std::abs(rect.width) * 0.5f, std::abs(rect.height) * 0.5f);
+            Vec2 center = rect.position + Vec2(rect.width * 0.5f, rect.height * 0.5f);
+            float dx = std::abs(p.x - center.x) - half.x;
+            float dy = std::abs(p.y - center.y) - half.y;
+            float outside = Vec2(std::max(dx, 0.0f), std::max(dy, 0.0f)).length();
+            return outside + std::min(std::max(dx, dy), 0.0f);
+        }
+        case ShapeKind::CIRCLE: {
+            const auto& circle = static_cast<const Circle&>(shape);
+            return (p - circle.position).length() - circle.radius;
+        }
+        case ShapeKind::TRIANGLE: {
+            const auto& tri = static_cast<const Triangle&>(shape);
+            float d = std::min({segmentDistance(p, tri.p1, tri.p2),
+                                segmentDistance(p, tri.p2, tri.p3),
+                                segmentDistance(p, tri.p3, tri.p1)});
+            auto side = [&](const Vec2& a, const Vec2& b) {
+                return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+            };
+            float s1 = side(tri.p1, tri.p2), s2 = side(tri.p2, tri.p3), s3 = side(tri.p3, tri.p1);
+            bool inside = (s1 >= 0 && s2 >= 0 && s3 >= 0) || (s1 <= 0 && s2 <= 0 && s3 <= 0);
+            return inside ? -d : d;
+        }
+        default:
+            return DistanceField::DEFAULT_MAX_DISTANCE * 1e3f;
+    }
+}
+
+struct Box {
+    Vec2 min, max;
+};
+
+bool boxesOverlap(const Box& a, const Box& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+           a.min.y <= b.max.y && a.max.y >= b.min.y;
+}
+
+float boxDistanceSq(const Box& box, const Vec2& p) {
+    float dx = std::max({box.min.x - p.x, 0.0f, p.x - box.max.x});
+    float dy = std::max({box.min.y - p.y, 0.0f, p.y - box.max.y});
+    return dx * dx + dy * dy;
+}
+
+} // namespace
+
+void DistanceField::clear() {
+    values.clear();
+    width = height = 0;
+}
+
+void DistanceField::bake(const std::vector<std::shared_ptr<Line>>& lines,
+                         const std::vector<std::shared_ptr<Shape>>& shapes,
+                         float size, float maxDist, ThreadPool& pool) {
+    clear();
+    maxDistance = maxDist > 0 ? maxDist : DEFAULT_MAX_DISTANCE;
+
+    SegmentBuffer walls;
+    std::vector<Box> wallBoxes;
+    for (const auto& line : lines) {
+        const auto& pts = line->getPoints();
+        for (size_t j = 0; j + 1 < pts.size(); ++j) {
+            walls.push(pts[j], pts[j + 1], 0);
+            wallBoxes.push_back({Vec2(std::min(pts[j].x, pts[j + 1].x), std::min(pts[j].y, pts[j + 1].y)),
+                                 Vec2(std::max(pts[j].x, pts[j + 1].x), std::max(pts[j].y, pts[j + 1].y))});
+        }
+    }
+    std::vector<const Shape*> solids;
+    std::vector<Box> solidBoxes;
+    for (const auto& shape : shapes) {
+        if (shape->getKind() == ShapeKind::LINE) continue;
+        Box box;
+        shape->getBounds(box.min, box.max);
+        solids.push_back(shape.get());
+        solidBoxes.push_back(box);
+    }
+    if (wallBoxes.empty() && solidBoxes.empty()) return;
+
+    Box bounds = !wallBoxes.empty() ? wallBoxes[0] : solidBoxes[0];
+    for (const auto* boxes : {&wallBoxes, &solidBoxes}) {
+        for (const Box& box : *boxes) {
+            bounds.min.x = std::min(bounds.min.x, box.min.x);
+            bounds.min.y = std::min(bounds.min.y, box.min.y);
+            bounds.max.x = std::max(bounds.max.x, box.max.x);
+            bounds.max.y = std::max(bounds.max.y, box.max.y);
+        }
+    }
+
+    float spanX = bounds.max.x - bounds.min.x + 2 * maxDistance;
+    float spanY = bounds.max.y - bounds.min.y + 2 * maxDistance;
+    cellSize = fitCellSize(spanX, spanY, size > 0 ? size : DEFAULT_CELL_SIZE, MAX_SAMPLES);
+    if (cellSize == 0.0f) {
+        std::cerr << "Map bounds are not finite or too far apart - no distance field" << std::endl;
+        return;
+    }
+    invCellSize = 1.0f / cellSize;
+    errorBound = cellSize * 1.4143f;
+    origin = Vec2(bounds.min.x - maxDistance, bounds.min.y - maxDistance);
+    width = (int)std::ceil(spanX * invCellSize) + 1;
+    height = (int)std::ceil(spanY * invCellSize) + 1;
+    values.assign((size_t)width * height, maxDistance);
+
+    int tilesX = (width + TILE - 1) / TILE;
+    int tilesY = (height + TILE - 1) / TILE;
+    float maxDistSq = maxDistance * maxDistance;
+
+    auto signedDistanceTo = [&](const SegmentBuffer& nearWalls, const std::vector<uint32_t>& nearSolids,
+                                const Vec2& p) {
+        float d = std::sqrt(nearWalls.minDistanceSq(p, 0, nearWalls.size(), maxDistSq));
+        for (uint32_t i : nearSolids) {
+            // A shape can't beat d if its bounding box doesn't
+            if (d > 0.0f && boxDistanceSq(solidBoxes[i], p) >= d * d) continue;
+            d = std::min(d, signedDistance(*solids[i], p));
+        }
+        return d;
+    };
+
+    // Bucket every wall and shape into the tiles within maxDistance of it,
+    // so each tile starts from a short candidate list instead of the whole
+    // map. Items [0, walls) are walls, the rest are shapes.
+    const uint32_t wallCount = (uint32_t)wallBoxes.size();
+    const size_t itemCount = wallBoxes.size() + solidBoxes.size();
+    const float tileSize = TILE * cellSize;
+    auto forEachTile = [&](size_t item, auto&& fn) {
+        const Box& box = item < wallCount ? wallBoxes[item] : solidBoxes[item - wallCount];
+        auto tileOf = [&](float v, float o, int count) {
+            return std::max(0, std::min(count - 1, (int)std::floor((v - o) / tileSize)));
+        };
+        int tx0 = tileOf(box.min.x - maxDistance, origin.x, tilesX);
+        int tx1 = tileOf(box.max.x + maxDistance, origin.x, tilesX);
+        int ty0 = tileOf(box.min.y - maxDistance, origin.y, tilesY);
+        int ty1 = tileOf(box.max.y + maxDistance, origin.y, tilesY);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) fn(ty * tilesX + tx);
+        }
+    };
+    std::vector<uint32_t> tileStart((size_t)tilesX * tilesY + 1, 0), tileItems;
+    for (size_t i = 0; i < itemCount; ++i) {
+        forEachTile(i, [&](int tile) { tileStart[tile + 1]++; });
+    }
+    for (size_t t = 1; t < tileStart.size(); ++t) tileStart[t] += tileStart[t - 1];
+    tileItems.resize(tileStart.back());
+    std::vector<uint32_t> cursor(tileStart.begin(), tileStart.end() - 1);
+    for (size_t i = 0; i < itemCount; ++i) {
+        forEachTile(i, [&](int tile) { tileItems[cursor[tile]++] = (uint32_t)i; });
+    }
+
+    pool.parallelFor((size_t)tilesX * tilesY, 4, [&](size_t begin, size_t end) {
+        SegmentBuffer nearWalls;
+        std::vector<uint32_t> nearSolids;
+
+        // Candidates of a tile within reach of it, as a wall buffer for the
+        // SIMD kernel and a shape index list
+        auto gather = [&](size_t tile, const Box& tileBox, float reach) {
+            Box area = {tileBox.min - Vec2(reach, reach), tileBox.max + Vec2(reach, reach)};
+            nearWalls.clear();
+            nearSolids.clear();
+            for (uint32_t k = tileStart[tile]; k < tileStart[tile + 1]; ++k) {
+                uint32_t i = tileItems[k];
+                if (i < wallCount) {
+                    if (boxesOverlap(wallBoxes[i], area)) nearWalls.push(walls.a(i), walls.b(i), 0);
+                } else if (boxesOverlap(solidBoxes[i - wallCount], area)) {
+                    nearSolids.push_back(i - wallCount);
+                }
+            }
+        };
+
+        for (size_t tile = begin; tile < end; ++tile) {
+            int x0 = (int)(tile % tilesX) * TILE, y0 = (int)(tile / tilesX) * TILE;
+            int x1 = std::min(x0 + TILE, width), y1 = std::min(y0 + TILE, height);
+            Box tileBox = {Vec2(origin.x + x0 * cellSize, origin.y + y0 * cellSize),
+                           Vec2(origin.x + (x1 - 1) * cellSize, origin.y + (y1 - 1) * cellSize)};
+
+            if (tileStart[tile] == tileStart[tile + 1]) continue;
+
+            // Everything bucketed here is within maxDistance of the tile, but
+            // in cluttered areas far less matters: no sample in the tile is
+            // further from the geometry than the center is, plus the half
+            // diagonal, so nothing beyond that distance can be the nearest
+            gather(tile, tileBox, maxDistance);
+            Vec2 center = (tileBox.min + tileBox.max) * 0.5f;
+            float halfDiagonal = (tileBox.max - center).length();
+            float reach = std::max(0.0f, signedDistanceTo(nearWalls, nearSolids, center)) + halfDiagonal;
+            if (reach < maxDistance) gather(tile, tileBox, reach);
+
+            for (int y = y0; y < y1; ++y) {
+                for (int x = x0; x < x1; ++x) {
+                    Vec2 p(origin.x + x * cellSize, origin.y + y * cellSize);
+                    float d = signedDistanceTo(nearWalls, nearSolids, p);
+                    values[(size_t)y * width + x] = std::max(-maxDistance, std::min(maxDistance, d));
+                }
+            }
+        }
+    });
+}
+
+float DistanceField::sample(const Vec2& p) const {
+    float gx = (p.x - origin.x) * invCellSize;
+    float gy = (p.y - origin.y) * invCellSize;
+    int x = (int)std::floor(gx), y = (int)std::floor(gy);
+    if (x < 0 || y < 0 || x >= width - 1 || y >= height - 1) return maxDistance;
+
+    float fx = gx - x, fy = gy - y;
+    float top = at(x, y) + (at(x + 1, y) - at(x, y)) * fx;
+    float bottom = at(x, y + 1) + (at(x + 1, y + 1) - at(x, y + 1)) * fx;
+    return top + (bottom - top) * fy;
+}
+
+Vec2 DistanceField::gradient(const Vec2& p) const {
+    float h = cellSize;
+    Vec2 g(sample(p + Vec2(h, 0)) - sample(p - Vec2(h, 0)),
+           sample(p + Vec2(0, h)) - sample(p - Vec2(0, h)));
+    float len = g.length();
+    return len > 1e-6f ? g * (1.0f / len) : Vec2(0, 0);
+}
+
+bool DistanceField::traceRay(const Vec2& start, const Vec2& dir, float maxT, float& t) const {
+    if (empty()) return false;
+
+    // Steps by the guaranteed clearance, so it cannot jump over a thin wall;
+    // stopping at half a cell of clearance keeps every step at least that long
+    const float stopDistance = cellSize * 0.5f;
+    t = 0.0f;
+    while (t < maxT) {
+        float d = lowerBound(start + dir * t);
+        if (d < stopDistance) return true;
+        t += d;
+    }
+    t = maxT;
+    return false;
+}
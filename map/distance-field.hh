@@ -0,0 +1,62 @@
+#ifndef DISTANCE_FIELD_HH
+#define DISTANCE_FIELD_HH
+
+#include "../Vec2.hh"
+#include "../npc/Shape.hh"
+#include "../npc/Shapes/Line.hh"
+#include <memory>
+#include <vector>
+
+class ThreadPool;
+
+// Signed distance to the static map geometry, baked onto a regular raster.
+// Positive outside, negative inside solid shapes; polylines have no inside.
+// Values are clamped to +-maxDistance, and everything off the raster reads
+// as maxDistance (the raster is padded by that much around the geometry).
+//
+// sample() interpolates bilinearly, which can be off from the true distance
+// by up to a cell diagonal; lowerBound() subtracts that, so it is safe for
+// "is anything within r" tests and for stepping rays.
+class DistanceField {
+public:
+    static constexpr float DEFAULT_CELL_SIZE = 0.25f;
+    static constexpr float DEFAULT_MAX_DISTANCE = 8.0f;
+
+    // Rasterizes the distance to lines and shapes. Tiles of the raster are
+    // filled in parallel on pool.
+    void bake(const std::vector<std::shared_ptr<Line>>& lines,
+              const std::vector<std::shared_ptr<Shape>>& shapes,
+              float cellSize, float maxDistance, ThreadPool& pool);
+    void clear();
+
+    bool empty() const { return values.empty(); }
+    float getCellSize() const { return cellSize; }
+    float getMaxDistance() const { return maxDistance; }
+
+    // Interpolated signed distance at p
+    float sample(const Vec2& p) const;
+
+    // Never more than the true distance at p
+    float lowerBound(const Vec2& p) const { return sample(p) - errorBound; }
+
+    // Direction of steepest increase (away from the nearest surface)
+    Vec2 gradient(const Vec2& p) const;
+
+    // Sphere traces a ray (dir unit length). On a hit, t is how far the ray
+    // is guaranteed clear: the surface lies within a few cells past it.
+    // Returns false if the ray reaches maxT without coming close to anything.
+    bool traceRay(const Vec2& start, const Vec2& dir, float maxT, float& t) const;
+
+private:
+    Vec2 origin;
+    int width = 0, height = 0;
+    float cellSize = DEFAULT_CELL_SIZE;
+    float invCellSize = 1.0f / DEFAULT_CELL_SIZE;
+    float maxDistance = DEFAULT_MAX_DISTANCE;
+    float errorBound = 0.0f;
+    std::vector<float> values;   // Row-major, width * height samples
+
+    float at(int x, int y) const { return values[(size_t)y * width + x]; }
+};
+
+#endif // DISTANCE_FIELD_HH
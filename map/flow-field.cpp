@@ -0,0 +1,360 @@
+#include "flow-field.hh"
+#include "grid-fit.hh"
+#include "map.hh"
+#include "../engine/thread-pool.hh"
+#include "../npc/npc-store.hh"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+namespace {
+
+// Same idea as the distance field's cap: a stray far-away point makes the
+// cells bigger rather than the raster huge
+const double MAX_CELLS = 1 << 21;
+
+// Open ground kept around the geometry
+const float MARGIN = 4.0f;
+
+// Raster rows per parallel chunk
+const size_t ROW_GRAIN = 16;
+
+// Bodies per parallel chunk when steering
+const size_t STEER_GRAIN = 8192;
+
+// The 8 steps, clockwise from east; odd ones are diagonal
+const int STEP_X[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+const int STEP_Y[8] = { 0, 1, 1, 1, 0, -1, -1, -1 };
+const float STEP_LENGTH[8] = { 1.0f, 1.41421f, 1.0f, 1.41421f, 1.0f, 1.41421f, 1.0f, 1.41421f };
+
+float side(const Vec2& a, const Vec2& b, const Vec2& p) {
+    return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+bool segmentsCross(const Vec2& p, const Vec2& q, const Vec2& a, const Vec2& b) {
+    float s1 = side(p, q, a), s2 = side(p, q, b);
+    float s3 = side(a, b, p), s4 = side(a, b, q);
+    return ((s1 > 0) != (s2 > 0)) && ((s3 > 0) != (s4 > 0));
+}
+
+} // namespace
+
+int FlowGrid::cellAt(const Vec2& p) const {
+    if (empty()) return -1;
+    int x = (int)std::floor((p.x - origin.x) / cellSize);
+    int y = (int)std::floor((p.y - origin.y) / cellSize);
+    if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+    return y * width + x;
+}
+
+Vec2 FlowField::direction(const Vec2& p) const {
+    int cell = grid->cellAt(p);
+    if (cell < 0) return Vec2();
+    if (cell == goalCell) return (goal - p).normalized();
+    uint8_t k = next[cell];
+    if (k == NO_DIRECTION) return Vec2();
+    return Vec2((float)STEP_X[k], (float)STEP_Y[k]) * (1.0f / STEP_LENGTH[k]);
+}
+
+float FlowField::distance(const Vec2& p) const {
+    int cell = grid->cellAt(p);
+    return cell < 0 ? INFINITY : cost[cell];
+}
+
+void FlowField::steer(NPCStore& store, float speed, ThreadPool& pool) const {
+    pool.parallelFor(store.size(), STEER_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (store.cold[i] != NPCStore::NONE) continue;
+            Vec2 dir = direction(store.position((uint32_t)i));
+            store.prefVelX[i] = dir.x * speed;
+            store.prefVelY[i] = dir.y * speed;
+        }
+    });
+}
+
+void FlowField::integrate(const FlowField* warm) {
+    const FlowGrid& g = *grid;
+    size_t count = (size_t)g.width * g.height;
+
+    // Upper bounds: anything is at most as far from the new goal as it is
+    // from the old one plus the walk between the two goals. Cells whose
+    // bound is already exact never enter the queue, and neither does
+    // anything whose way runs through them: a goal moving deeper into a
+    // room only revisits the room, while one moving into the open still
+    // revisits about half the map.
+    if (warm && warm->grid == grid && std::isfinite(warm->cost[goalCell])) {
+        float between = warm->cost[goalCell];
+        cost.resize(count);
+        for (size_t i = 0; i < count; ++i) cost[i] = warm->cost[i] + between;
+    } else {
+        cost.assign(count, INFINITY);
+    }
+
+    using Open = std::pair<float, int>;
+    std::priority_queue<Open, std::vector<Open>, std::greater<Open>> open;
+    cost[goalCell] = 0.0f;
+    open.push({0.0f, goalCell});
+
+    while (!open.empty()) {
+        auto [here, cell] = open.top();
+        open.pop();
+        if (here > cost[cell]) continue;
+
+        int x = cell % g.width, y = cell / g.width;
+        uint8_t allowed = g.links[cell];
+        for (int k = 0; k < 8; ++k) {
+            if (!(allowed & (1 << k))) continue;
+            int n = (y + STEP_Y[k]) * g.width + x + STEP_X[k];
+            float through = here + STEP_LENGTH[k] * g.cellSize;
+            if (through < cost[n]) {
+                cost[n] = through;
+                open.push({through, n});
+            }
+        }
+    }
+}
+
+void FlowField::buildDirections(ThreadPool& pool) {
+    const FlowGrid& g = *grid;
+    next.assign((size_t)g.width * g.height, NO_DIRECTION);
+
+    // Downhill is the neighbour Dijkstra came from
+    pool.parallelFor(g.height, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (int x = 0; x < g.width; ++x) {
+                size_t cell = y * g.width + x;
+                if (!std::isfinite(cost[cell]) || (int)cell == goalCell) continue;
+                uint8_t allowed = g.links[cell];
+                float best = cost[cell];
+                for (int k = 0; k < 8; ++k) {
+                    if (!(allowed & (1 << k))) continue;
+                    size_t n = (y + STEP_Y[k]) * g.width + x + STEP_X[k];
+                    float via = cost[n] + STEP_LENGTH[k] * g.cellSize;
+                    if (via <= best) {
+                        best = via;
+                        next[cell] = (uint8_t)k;
+                    }
+                }
+            }
+        }
+    });
+}
+
+void FlowFieldCache::clear() {
+    grid.reset();
+    entries.clear();
+    pending = Pending();
+}
+
+void FlowFieldCache::build(const Map& map, ThreadPool& pool, float cellSize, float agentRadius) {
+    clear();
+
+    Vec2 lo(INFINITY, INFINITY), hi(-INFINITY, -INFINITY);
+    auto grow = [&](const Vec2& min, const Vec2& max) {
+        lo = Vec2(std::min(lo.x, min.x), std::min(lo.y, min.y));
+        hi = Vec2(std::max(hi.x, max.x), std::max(hi.y, max.y));
+    };
+    for (size_t i = 0; i < map.segments.size(); ++i) {
+        grow(map.segments.a(i), map.segments.a(i));
+        grow(map.segments.b(i), map.segments.b(i));
+    }
+    for (const auto& shape : map.shapes) {
+        Vec2 min, max;
+        shape->getBounds(min, max);
+        grow(min, max);
+    }
+    if (lo.x > hi.x) return;
+
+    lo = lo - Vec2(MARGIN, MARGIN);
+    hi = hi + Vec2(MARGIN, MARGIN);
+    float fitted = fitCellSize(hi.x - lo.x, hi.y - lo.y, cellSize, MAX_CELLS);
+    if (fitted == 0.0f) {
+        std::cerr << "Map bounds are not finite or too far apart - no flow field" << std::endl;
+        return;
+    }
+    cellSize = fitted;
+
+    auto g = std::make_shared<FlowGrid>();
+    g->origin = lo;
+    g->cellSize = cellSize;
+    g->width = std::max(1, (int)std::ceil((hi.x - lo.x) / cellSize));
+    g->height = std::max(1, (int)std::ceil((hi.y - lo.y) / cellSize));
+    size_t count = (size_t)g->width * g->height;
+
+    auto center = [&](int x, int y) {
+        return g->origin + Vec2((x + 0.5f) * cellSize, (y + 0.5f) * cellSize);
+    };
+
+    std::vector<uint8_t> open(count);
+    pool.parallelFor(g->height, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (int x = 0; x < g->width; ++x) {
+                open[y * g->width + x] = map.circleClearOfStatic(center(x, (int)y), agentRadius);
+            }
+        }
+    });
+
+    g->links.assign(count, 0);
+    pool.parallelFor(g->height, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (int y = (int)begin; y < (int)end; ++y) {
+            for (int x = 0; x < g->width; ++x) {
+                size_t cell = (size_t)y * g->width + x;
+                if (!open[cell]) continue;
+
+                Vec2 from = center(x, y);
+                uint8_t allowed = 0;
+                // Straight steps first: the diagonals depend on them
+                for (int k : { 0, 2, 4, 6, 1, 3, 5, 7 }) {
+                    int nx = x + STEP_X[k], ny = y + STEP_Y[k];
+                    if (nx < 0 || ny < 0 || nx >= g->width || ny >= g->height) continue;
+                    if (!open[(size_t)ny * g->width + nx]) continue;
+                    if ((k & 1) && !((allowed >> (k - 1)) & 1 && (allowed >> ((k + 1) & 7)) & 1)) continue;
+
+                    Vec2 to = center(nx, ny);
+                    Vec2 min(std::min(from.x, to.x), std::min(from.y, to.y));
+                    Vec2 max(std::max(from.x, to.x), std::max(from.y, to.y));
+                    bool blocked = map.grid.forEachSegment(min, max, [&](uint32_t s) {
+                        return segmentsCross(from, to, map.segments.a(s), map.segments.b(s));
+                    });
+                    if (!blocked) allowed |= (uint8_t)(1 << k);
+                }
+                g->links[cell] = allowed;
+            }
+        }
+    });
+
+    // A diagonal only counts if it is allowed back too. The side steps
+    // checked above are the source cell's, so round a wall end the corner
+    // can be cut one way and not the other; the search runs out from the
+    // goal while agents walk in to it, and a one-way diagonal would give a
+    // cell a cost that none of its own steps can make good.
+    std::vector<uint8_t> oneWay(count);
+    pool.parallelFor(g->height, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (int y = (int)begin; y < (int)end; ++y) {
+            for (int x = 0; x < g->width; ++x) {
+                size_t cell = (size_t)y * g->width + x;
+                uint8_t allowed = g->links[cell];
+                for (int k = 1; k < 8; k += 2) {
+                    if (!(allowed & (1 << k))) continue;
+                    size_t n = (size_t)(y + STEP_Y[k]) * g->width + x + STEP_X[k];
+                    if (!(g->links[n] & (1 << ((k + 4) & 7)))) oneWay[cell] |= (uint8_t)(1 << k);
+                }
+            }
+        }
+    });
+    for (size_t cell = 0; cell < count; ++cell) g->links[cell] &= (uint8_t)~oneWay[cell];
+
+    grid = g;
+}
+
+FlowFieldCache::Entry* FlowFieldCache::find(int goalCell) {
+    for (auto& entry : entries) {
+        if (entry.field->goalCell == goalCell) return &entry;
+    }
+    return nullptr;
+}
+
+FlowFieldCache::Entry* FlowFieldCache::nearest(int goalCell) {
+    Entry* best = nullptr;
+    int bestSteps = REUSE_CELLS + 1;
+    int gx = goalCell % grid->width, gy = goalCell / grid->width;
+    for (auto& entry : entries) {
+        int cell = entry.field->goalCell;
+        int steps = std::max(std::abs(cell % grid->width - gx), std::abs(cell / grid->width - gy));
+        if (steps < bestSteps) {
+            bestSteps = steps;
+            best = &entry;
+        }
+    }
+    return best;
+}
+
+void FlowFieldCache::insert(std::shared_ptr<FlowField> field) {
+    if (entries.size() >= MAX_FIELDS) {
+        auto oldest = std::min_element(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.lastUsed < b.lastUsed; });
+        entries.erase(oldest);
+    }
+    entries.push_back({std::move(field), ++clock});
+}
+
+void FlowFieldCache::collectPending() {
+    if (!pending.field || !pending.done->load(std::memory_order_acquire)) return;
+    if (pending.field->grid == grid && !find(pending.field->goalCell)) {
+        insert(pending.field);
+    }
+    pending = Pending();
+}
+
+std::shared_ptr<const FlowField> FlowFieldCache::get(const Vec2& goal, ThreadPool& pool) {
+    if (!grid) return nullptr;
+    collectPending();
+
+    int goalCell = grid->cellAt(goal);
+    if (goalCell < 0 || grid->links[goalCell] == 0) return nullptr;
+
+    if (Entry* entry = find(goalCell)) {
+        entry->lastUsed = ++clock;
+        return entry->field;
+    }
+
+    auto field = std::make_shared<FlowField>();
+    field->grid = grid;
+    field->goal = goal;
+    field->goalCell = goalCell;
+
+    Entry* near = nearest(goalCell);
+    if (!near) {
+        field->integrate(nullptr);
+        field->buildDirections(pool);
+        insert(field);
+        return field;
+    }
+
+    // Close enough: make do with the near field while this one builds.
+    // The task owns everything it touches, so the cache can go away first.
+    near->lastUsed = ++clock;
+    std::shared_ptr<const FlowField> warm = near->field;
+    if (!pending.field) {
+        pending.field = field;
+        pending.done = std::make_shared<std::atomic<bool>>(false);
+        auto done = pending.done;
+        pool.submit([field, warm, done, &pool] {
+            field->integrate(warm.get());
+            field->buildDirections(pool);
+            done->store(true, std::memory_order_release);
+        });
+        collectPending();
+    }
+    return warm;
+}
+
+void FlowFieldCache::prepare(const std::vector<Vec2>& goals, ThreadPool& pool) {
+    if (!grid) return;
+
+    // Distinct missing goal cells, one new field each
+    std::vector<std::shared_ptr<FlowField>> fields;
+    for (const Vec2& goal : goals) {
+        int goalCell = grid->cellAt(goal);
+        if (goalCell < 0 || grid->links[goalCell] == 0 || find(goalCell)) continue;
+        bool queued = false;
+        for (const auto& field : fields) queued |= field->goalCell == goalCell;
+        if (queued) continue;
+
+        auto field = std::make_shared<FlowField>();
+        field->grid = grid;
+        field->goal = goal;
+        field->goalCell = goalCell;
+        fields.push_back(field);
+    }
+
+    pool.parallelFor(fields.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            fields[i]->integrate(nullptr);
+            fields[i]->buildDirections(pool);
+        }
+    });
+    for (auto& field : fields) insert(field);
+}
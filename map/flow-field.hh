@@ -0,0 +1,119 @@
+#ifndef FLOW_FIELD_HH
+#define FLOW_FIELD_HH
+
+#include "../Vec2.hh"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Map;
+class NPCStore;
+class ThreadPool;
+
+// Which of its 8 neighbours each cell of a regular grid over the map can
+// step to. A cell is open when an agent of the given radius fits at its
+// center, and a step is allowed when it crosses no wall from map.lines
+// (diagonals also need both side steps, so they never cut corners).
+struct FlowGrid {
+    Vec2 origin;
+    int width = 0, height = 0;
+    float cellSize = 0.5f;
+    std::vector<uint8_t> links;   // Row-major, bit k = step k is allowed (both ways)
+
+    bool empty() const { return links.empty(); }
+    int cellAt(const Vec2& p) const;   // -1 if off the grid
+};
+
+// Steering toward one goal: the integration field (walking distance from
+// every cell to the goal, by Dijkstra over the grid) and the direction
+// field derived from it (which neighbour is downhill). Steering is then a
+// single lookup per agent, however many share the goal.
+class FlowField {
+public:
+    static constexpr uint8_t NO_DIRECTION = 0xff;
+
+    // Unit direction to walk at p: straight at the goal within its cell,
+    // zero off the grid or where the goal cannot be reached
+    Vec2 direction(const Vec2& p) const;
+
+    // Walking distance from p to the goal, INFINITY if unreachable
+    float distance(const Vec2& p) const;
+
+    int getGoalCell() const { return goalCell; }
+    const Vec2& getGoal() const { return goal; }
+
+    // Sets the preferred velocity of every crowd body (cold == NONE) in
+    // store along the field at speed, in parallel chunks on pool
+    void steer(NPCStore& store, float speed, ThreadPool& pool) const;
+
+private:
+    friend class FlowFieldCache;
+
+    std::shared_ptr<const FlowGrid> grid;
+    Vec2 goal;
+    int goalCell = -1;
+    std::vector<float> cost;
+    std::vector<uint8_t> next;    // Downhill step per cell, or NO_DIRECTION
+
+    // Dijkstra from the goal. When warm is given (a field for a goal a few
+    // cells away), its costs plus the distance between the goals seed the
+    // search as upper bounds, so only cells that get closer are revisited.
+    void integrate(const FlowField* warm);
+    void buildDirections(ThreadPool& pool);
+};
+
+// Flow fields per goal cell over one grid of the map. get() hands back the
+// field for a goal, building it right away if nothing cached is close.
+// When a cached field's goal is only a few cells off (the usual case when
+// chasing a moving target), that field is handed out for now and the
+// exact one is built in the background, warm-started from it, to be
+// picked up by a later get(). The least recently used fields are dropped
+// past MAX_FIELDS.
+class FlowFieldCache {
+public:
+    static constexpr float DEFAULT_CELL_SIZE = 0.5f;
+    static constexpr float DEFAULT_AGENT_RADIUS = 0.3f;
+    static constexpr size_t MAX_FIELDS = 8;
+
+    // Goals at most this many cells from a cached one reuse its field
+    // until their own is ready
+    static constexpr int REUSE_CELLS = 4;
+
+    // Rasterizes the map; rows are done in parallel on pool
+    void build(const Map& map, ThreadPool& pool,
+               float cellSize = DEFAULT_CELL_SIZE, float agentRadius = DEFAULT_AGENT_RADIUS);
+    void clear();
+
+    // Field leading to goal, or null if goal is off the grid or blocked
+    std::shared_ptr<const FlowField> get(const Vec2& goal, ThreadPool& pool);
+
+    // Builds the fields for several goals at once, one per pool thread
+    void prepare(const std::vector<Vec2>& goals, ThreadPool& pool);
+
+    const FlowGrid* getGrid() const { return grid.get(); }
+
+private:
+    struct Entry {
+        std::shared_ptr<FlowField> field;
+        uint64_t lastUsed = 0;
+    };
+
+    // A field being built on the pool; done is set once it is complete
+    struct Pending {
+        std::shared_ptr<FlowField> field;
+        std::shared_ptr<std::atomic<bool>> done;
+    };
+
+    std::shared_ptr<FlowGrid> grid;
+    std::vector<Entry> entries;
+    Pending pending;
+    uint64_t clock = 0;
+
+    void collectPending();
+    Entry* find(int goalCell);
+    Entry* nearest(int goalCell);
+    void insert(std::shared_ptr<FlowField> field);
+};
+
+#endif // FLOW_FIELD_HH
@@ -0,0 +1,290 @@
+#include "fmap.hh"
+#include "map.hh"
+#include "map-parser.hh"
+#include "../npc/Shapes/Rectangle.hh"
+#include "../npc/Shapes/Triangle.hh"
+#include "../npc/Shapes/Circle.hh"
+#include "../npc/Shapes/Line.hh"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Record size of each known section kind, 0 for unknown ones (skipped, so
+// a newer file with extra sections still loads)
+size_t recordSize(uint32_t kind) {
+    switch (kind) {
+        case FMAP_STRINGS: return 1;
+        case FMAP_POINTS: return sizeof(FmapPoint);
+        case FMAP_POLYLINES: return sizeof(FmapPolyline);
+        case FMAP_RECTS: return sizeof(FmapRect);
+        case FMAP_TRIANGLES: return sizeof(FmapTriangle);
+        case FMAP_CIRCLES: return sizeof(FmapCircle);
+        case FMAP_NPCS: return sizeof(FmapNPC);
+    }
+    return 0;
+}
+
+// Builds the string table while writing
+struct StringTable {
+    std::string bytes;
+
+    FmapString add(const std::string& s) {
+        FmapString ref = { (uint32_t)bytes.size(), (uint32_t)s.size() };
+        bytes += s;
+        return ref;
+    }
+};
+
+} // namespace
+
+bool FmapFile::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return fail("cannot open " + path);
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(FmapHeader)) {
+        ::close(fd);
+        return fail(path + " is too short for an .fmap header");
+    }
+    size = (size_t)info.st_size;
+
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);   // The mapping keeps the file
+    if (mapped == MAP_FAILED) {
+        size = 0;
+        return fail("cannot map " + path);
+    }
+    data = static_cast<const uint8_t*>(mapped);
+
+    if (!validate()) {
+        std::string message = path + ": " + error;
+        close();
+        return fail(message);
+    }
+    return true;
+}
+
+void FmapFile::close() {
+    if (data) munmap(const_cast<uint8_t*>(data), size);
+    data = nullptr;
+    size = 0;
+    strings = nullptr;
+    stringsSize = 0;
+}
+
+bool FmapFile::fail(const std::string& message) {
+    error = message;
+    return false;
+}
+
+const FmapSection* FmapFile::find(FmapSectionKind kind) const {
+    const FmapSection* sections = reinterpret_cast<const FmapSection*>(data + sizeof(FmapHeader));
+    for (uint32_t i = 0; i < header()->sectionCount; ++i) {
+        if (sections[i].kind == kind) return &sections[i];
+    }
+    return nullptr;
+}
+
+bool FmapFile::validate() {
+    const FmapHeader* h = header();
+    if (std::memcmp(h->magic, "FMAP", 4) != 0) return fail("not an .fmap file");
+    if (h->version != FMAP_VERSION) return fail("unsupported .fmap version " + std::to_string(h->version));
+    if (h->byteOrder != FMAP_BYTE_ORDER) return fail("written with the other byte order");
+
+    uint64_t tableEnd = sizeof(FmapHeader) + (uint64_t)h->sectionCount * sizeof(FmapSection);
+    if (tableEnd > size) return fail("section table runs past the end");
+
+    const FmapSection* sections = reinterpret_cast<const FmapSection*>(data + sizeof(FmapHeader));
+    for (uint32_t i = 0; i < h->sectionCount; ++i) {
+        size_t record = recordSize(sections[i].kind);
+        if (record == 0) continue;
+        if (sections[i].offset % 4 != 0 || sections[i].offset < tableEnd ||
+            sections[i].offset > size || (uint64_t)sections[i].count * record > size - sections[i].offset) {
+            return fail("section " + std::to_string(sections[i].kind) + " out of bounds");
+        }
+    }
+
+    size_t count;
+    strings = section<char>(FMAP_STRINGS, count);
+    stringsSize = count;
+    auto stringOk = [&](const FmapString& s) {
+        return s.length == 0 || (strings && s.offset <= stringsSize && s.length <= stringsSize - s.offset);
+    };
+    if (!stringOk(h->name)) return fail("map name out of bounds");
+
+    const FmapNPC* npcs = section<FmapNPC>(FMAP_NPCS, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!stringOk(npcs[i].id)) return fail("NPC id out of bounds");
+    }
+
+    size_t pointCount;
+    section<FmapPoint>(FMAP_POINTS, pointCount);
+    const FmapPolyline* polylines = section<FmapPolyline>(FMAP_POLYLINES, count);
+    for (size_t i = 0; i < count; ++i) {
+        if (polylines[i].firstPoint > pointCount || polylines[i].pointCount > pointCount - polylines[i].firstPoint) {
+            return fail("polyline points out of bounds");
+        }
+        if (polylines[i].pointCount < 2) return fail("polyline with fewer than 2 points");
+    }
+    return true;
+}
+
+bool isFmap(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4];
+    return file.read(magic, 4) && std::memcmp(magic, "FMAP", 4) == 0;
+}
+
+bool readFmap(const std::string& path, MapText& out) {
+    FmapFile file;
+    if (!file.open(path)) {
+        std::cerr << "Failed to load map file: " << file.getError() << std::endl;
+        return false;
+    }
+    out.name = std::string(file.name());
+
+    size_t rectCount, triCount, circleCount;
+    const FmapRect* rects = file.section<FmapRect>(FMAP_RECTS, rectCount);
+    const FmapTriangle* tris = file.section<FmapTriangle>(FMAP_TRIANGLES, triCount);
+    const FmapCircle* circles = file.section<FmapCircle>(FMAP_CIRCLES, circleCount);
+    out.shapes.reserve(out.shapes.size() + rectCount + triCount + circleCount);
+    for (size_t i = 0; i < rectCount; ++i) {
+        out.shapes.push_back(std::make_shared<Rectangle>(Vec2(rects[i].x, rects[i].y), rects[i].width, rects[i].height));
+    }
+    for (size_t i = 0; i < triCount; ++i) {
+        const FmapTriangle& t = tris[i];
+        out.shapes.push_back(std::make_shared<Triangle>(Vec2(t.x1, t.y1), Vec2(t.x2, t.y2), Vec2(t.x3, t.y3)));
+    }
+    for (size_t i = 0; i < circleCount; ++i) {
+        out.shapes.push_back(std::make_shared<Circle>(Vec2(circles[i].x, circles[i].y), circles[i].radius));
+    }
+
+    size_t count, pointCount;
+    const FmapPoint* points = file.section<FmapPoint>(FMAP_POINTS, pointCount);
+    const FmapPolyline* polylines = file.section<FmapPolyline>(FMAP_POLYLINES, count);
+    std::vector<Vec2> linePoints;
+    out.lines.reserve(out.lines.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        const FmapPoint* first = points + polylines[i].firstPoint;
+        linePoints.clear();
+        for (uint32_t k = 0; k < polylines[i].pointCount; ++k) linePoints.push_back(Vec2(first[k].x, first[k].y));
+        out.lines.push_back(std::make_shared<Line>(linePoints));
+    }
+
+    // An empty id keeps NPC's default rather than taking a fallback from its
+    // counter, so chunks can be read off the main thread
+    const FmapNPC* npcs = file.section<FmapNPC>(FMAP_NPCS, count);
+    out.npcs.reserve(out.npcs.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        const FmapNPC& n = npcs[i];
+        auto shape = std::make_shared<Circle>(Vec2(n.x, n.y), n.radius);
+        if (n.id.length == 0) {
+            out.npcs.emplace_back(shape, Vec2(n.velX, n.velY));
+        } else {
+            out.npcs.emplace_back(shape, Vec2(n.velX, n.velY), std::string(file.string(n.id)));
+        }
+    }
+    return true;
+}
+
+bool writeFmap(const Map& map, const std::string& path) {
+    StringTable strings;
+    std::vector<FmapRect> rects;
+    std::vector<FmapTriangle> tris;
+    std::vector<FmapCircle> circles;
+    std::vector<FmapPoint> points;
+    std::vector<FmapPolyline> polylines;
+    std::vector<FmapNPC> npcs;
+
+    FmapHeader header;
+    std::memcpy(header.magic, "FMAP", 4);
+    header.version = FMAP_VERSION;
+    header.byteOrder = FMAP_BYTE_ORDER;
+    header.name = strings.add(map.name);
+
+    for (const auto& shape : map.shapes) {
+        switch (shape->getKind()) {
+            case ShapeKind::RECTANGLE: {
+                const auto& rect = static_cast<const Rectangle&>(*shape);
+                rects.push_back({ rect.position.x, rect.position.y, rect.width, rect.height });
+                break;
+            }
+            case ShapeKind::TRIANGLE: {
+                const auto& tri = static_cast<const Triangle&>(*shape);
+                tris.push_back({ tri.p1.x, tri.p1.y, tri.p2.x, tri.p2.y, tri.p3.x, tri.p3.y });
+                break;
+            }
+            case ShapeKind::CIRCLE: {
+                const auto& circ = static_cast<const Circle&>(*shape);
+                circles.push_back({ circ.position.x, circ.position.y, circ.radius });
+                break;
+            }
+            case ShapeKind::LINE:
+                break;
+        }
+    }
+    for (const auto& line : map.lines) {
+        const auto& pts = line->getPoints();
+        if (pts.size() < 2) continue;   // Not a wall; the text parser drops these too
+        polylines.push_back({ (uint32_t)points.size(), (uint32_t)pts.size() });
+        for (const Vec2& p : pts) points.push_back({ p.x, p.y });
+    }
+    for (const auto& npc : map.npcs) {
+        if (npc.shape->getKind() != ShapeKind::CIRCLE) continue;
+        const auto& circ = static_cast<const Circle&>(*npc.shape);
+        npcs.push_back({ circ.position.x, circ.position.y, circ.radius,
+                         npc.velocity.x, npc.velocity.y, strings.add(npc.id) });
+    }
+
+    // Lay the sections out after the table, each 8-byte aligned
+    struct Payload {
+        FmapSectionKind kind;
+        const void* bytes;
+        size_t count, recordSize;
+    };
+    const Payload payloads[] = {
+        { FMAP_STRINGS, strings.bytes.data(), strings.bytes.size(), 1 },
+        { FMAP_POINTS, points.data(), points.size(), sizeof(FmapPoint) },
+        { FMAP_POLYLINES, polylines.data(), polylines.size(), sizeof(FmapPolyline) },
+        { FMAP_RECTS, rects.data(), rects.size(), sizeof(FmapRect) },
+        { FMAP_TRIANGLES, tris.data(), tris.size(), sizeof(FmapTriangle) },
+        { FMAP_CIRCLES, circles.data(), circles.size(), sizeof(FmapCircle) },
+        { FMAP_NPCS, npcs.data(), npcs.size(), sizeof(FmapNPC) },
+    };
+    const size_t sectionCount = sizeof(payloads) / sizeof(payloads[0]);
+    header.sectionCount = (uint32_t)sectionCount;
+
+    std::vector<FmapSection> table(sectionCount);
+    uint64_t offset = sizeof(FmapHeader) + sectionCount * sizeof(FmapSection);
+    for (size_t i = 0; i < sectionCount; ++i) {
+        offset = (offset + 7) & ~(uint64_t)7;
+        table[i] = { payloads[i].kind, (uint32_t)payloads[i].count, offset };
+        offset += payloads[i].count * payloads[i].recordSize;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write map file: " << path << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(FmapSection));
+    uint64_t written = sizeof(FmapHeader) + sectionCount * sizeof(FmapSection);
+    const char padding[8] = {};
+    for (size_t i = 0; i < sectionCount; ++i) {
+        file.write(padding, (std::streamsize)(table[i].offset - written));
+        size_t bytes = payloads[i].count * payloads[i].recordSize;
+        if (bytes) file.write(static_cast<const char*>(payloads[i].bytes), (std::streamsize)bytes);
+        written = table[i].offset + bytes;
+    }
+    return (bool)file;
+}
@@ -0,0 +1,119 @@
+#ifndef FMAP_HH
+#define FMAP_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+class Map;
+struct MapText;
+
+// .fmap, the binary map format. A header, a table of sections, then the
+// sections, each an array of one of the records below, 8-byte aligned and
+// in the byte order of the machine that wrote it (byteOrder tells). Once
+// FmapFile::open() has checked the bounds, the records are read straight
+// out of the mapped file.
+//
+// Shapes are grouped by kind, so a text map that mixes kinds comes back
+// from .fmap in a different shape order.
+const uint32_t FMAP_VERSION = 1;
+const uint32_t FMAP_BYTE_ORDER = 0x01020304;
+
+enum FmapSectionKind : uint32_t {
+    FMAP_STRINGS = 1,     // char; referenced by FmapString
+    FMAP_POINTS,          // FmapPoint; polyline vertices, back to back
+    FMAP_POLYLINES,       // FmapPolyline
+    FMAP_RECTS,           // FmapRect
+    FMAP_TRIANGLES,       // FmapTriangle
+    FMAP_CIRCLES,         // FmapCircle
+    FMAP_NPCS             // FmapNPC
+};
+
+struct FmapString {
+    uint32_t offset, length;   // Into the string table
+};
+
+struct FmapHeader {
+    char magic[4];             // "FMAP"
+    uint32_t version;
+    uint32_t byteOrder;        // FMAP_BYTE_ORDER as written
+    uint32_t sectionCount;
+    FmapString name;
+};
+
+struct FmapSection {
+    uint32_t kind;
+    uint32_t count;            // Records
+    uint64_t offset;           // From the start of the file
+};
+
+struct FmapPoint { float x, y; };
+struct FmapPolyline { uint32_t firstPoint, pointCount; };
+struct FmapRect { float x, y, width, height; };
+struct FmapTriangle { float x1, y1, x2, y2, x3, y3; };
+struct FmapCircle { float x, y, radius; };
+
+struct FmapNPC {
+    float x, y, radius;
+    float velX, velY;
+    FmapString id;
+};
+
+static_assert(sizeof(FmapHeader) == 24, "FmapHeader layout");
+static_assert(sizeof(FmapSection) == 16, "FmapSection layout");
+static_assert(sizeof(FmapNPC) == 28, "FmapNPC layout");
+
+// A .fmap file mapped read-only into memory
+class FmapFile {
+public:
+    FmapFile() = default;
+    ~FmapFile() { close(); }
+
+    FmapFile(const FmapFile&) = delete;
+    FmapFile& operator=(const FmapFile&) = delete;
+
+    // Maps path and checks the header and that every section, string and
+    // polyline lies inside the file, and that every polyline has at least
+    // two points; false with getError() set if not
+    bool open(const std::string& path);
+    void close();
+    const std::string& getError() const { return error; }
+
+    // Records of a section; count 0 and null if the file has none
+    template <typename T>
+    const T* section(FmapSectionKind kind, size_t& count) const {
+        const FmapSection* found = find(kind);
+        count = found ? found->count : 0;
+        return found ? reinterpret_cast<const T*>(data + found->offset) : nullptr;
+    }
+
+    std::string_view string(const FmapString& s) const {
+        return std::string_view(strings + s.offset, s.length);
+    }
+    std::string_view name() const { return string(header()->name); }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    const char* strings = nullptr;
+    size_t stringsSize = 0;
+    std::string error;
+
+    const FmapHeader* header() const { return reinterpret_cast<const FmapHeader*>(data); }
+    const FmapSection* find(FmapSectionKind kind) const;
+    bool validate();
+    bool fail(const std::string& message);
+};
+
+// Is path a .fmap file (by its magic, not its name)?
+bool isFmap(const std::string& path);
+
+// Reads an .fmap file into out, shapes grouped by kind; false (with a
+// message on stderr) if it cannot be read. Safe to call off the main
+// thread.
+bool readFmap(const std::string& path, MapText& out);
+
+bool writeFmap(const Map& map, const std::string& path);
+
+#endif // FMAP_HH
@@ -0,0 +1,272 @@
+#include "geometry-cleanup.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+
+namespace {
+
+// Cells per side of the piece grid used to find neighbours, relative to
+// the average piece length
+const float PIECE_CELL_SCALE = 2.0f;
+
+struct Piece {
+    uint32_t a, b;   // Welded vertex ids
+};
+
+float cross(const Vec2& a, const Vec2& b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+float dot(const Vec2& a, const Vec2& b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+uint64_t cellKey(int x, int y) {
+    return ((uint64_t)(uint32_t)x << 32) | (uint32_t)y;
+}
+
+// Vertices with every point within radius of an earlier one snapped onto it
+class Welder {
+public:
+    explicit Welder(float radius) : radius(radius), cellSize(radius > 0.0f ? radius : 1.0f) {}
+
+    uint32_t add(const Vec2& p, size_t& welded) {
+        int cx = (int)std::floor(p.x / cellSize), cy = (int)std::floor(p.y / cellSize);
+        uint32_t best = UINT32_MAX;
+        float bestSq = radius * radius;
+        for (int y = cy - 1; y <= cy + 1; ++y) {
+            for (int x = cx - 1; x <= cx + 1; ++x) {
+                auto found = cells.find(cellKey(x, y));
+                if (found == cells.end()) continue;
+                for (uint32_t v : found->second) {
+                    Vec2 d = vertices[v] - p;
+                    float distSq = dot(d, d);
+                    if (distSq <= bestSq) {
+                        bestSq = distSq;
+                        best = v;
+                    }
+                }
+            }
+        }
+        if (best != UINT32_MAX) {
+            if (bestSq > 0.0f) ++welded;
+            return best;
+        }
+        vertices.push_back(p);
+        cells[cellKey(cx, cy)].push_back((uint32_t)(vertices.size() - 1));
+        return (uint32_t)(vertices.size() - 1);
+    }
+
+    std::vector<Vec2> vertices;
+
+private:
+    float radius, cellSize;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+};
+
+// Folds pieces lying along longer ones into single pieces
+std::vector<Piece> mergeCollinear(const std::vector<Piece>& pieces, const std::vector<Vec2>& vertices,
+                                  float weld, float tolerance, size_t& merged) {
+    size_t count = pieces.size();
+    std::vector<float> length(count);
+    float total = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        length[i] = (vertices[pieces[i].b] - vertices[pieces[i].a]).length();
+        total += length[i];
+    }
+    if (count == 0) return {};
+
+    // Bucket the pieces by the cells their bounds cover
+    float cellSize = std::max(PIECE_CELL_SCALE * total / count, 4.0f * tolerance + 1e-3f);
+    std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+    auto forCells = [&](Vec2 lo, Vec2 hi, auto&& fn) {
+        int x0 = (int)std::floor(lo.x / cellSize), x1 = (int)std::floor(hi.x / cellSize);
+        int y0 = (int)std::floor(lo.y / cellSize), y1 = (int)std::floor(hi.y / cellSize);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) fn(cellKey(x, y));
+        }
+    };
+    auto bounds = [&](const Vec2& p, const Vec2& q, Vec2& lo, Vec2& hi) {
+        lo = Vec2(std::min(p.x, q.x) - tolerance, std::min(p.y, q.y) - tolerance);
+        hi = Vec2(std::max(p.x, q.x) + tolerance, std::max(p.y, q.y) + tolerance);
+    };
+    for (size_t i = 0; i < count; ++i) {
+        Vec2 lo, hi;
+        bounds(vertices[pieces[i].a], vertices[pieces[i].b], lo, hi);
+        forCells(lo, hi, [&](uint64_t key) { cells[key].push_back((uint32_t)i); });
+    }
+
+    // Longest first, so each group is measured against its best-defined
+    // piece
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t i, uint32_t j) { return length[i] > length[j]; });
+
+    std::vector<uint8_t> taken(count, 0);
+    std::vector<uint32_t> seen(count, UINT32_MAX);   // Query stamp
+    uint32_t stamp = 0;
+    std::vector<Piece> out;
+    std::vector<uint32_t> group;
+
+    // Would the ends of extra, and of all of group if whole is set, lie
+    // within tolerance of the segment from vertex a to vertex b?
+    auto fits = [&](uint32_t a, uint32_t b, uint32_t extra, bool whole) {
+        Vec2 from = vertices[a], span = vertices[b] - from;
+        float len = span.length();
+        if (len <= 0.0f) return false;
+        Vec2 along = span * (1.0f / len);
+        auto near = [&](uint32_t piece) {
+            return std::abs(cross(along, vertices[pieces[piece].a] - from)) <= tolerance &&
+                   std::abs(cross(along, vertices[pieces[piece].b] - from)) <= tolerance;
+        };
+        if (!near(extra)) return false;
+        if (!whole) return true;
+        for (uint32_t piece : group) {
+            if (!near(piece)) return false;
+        }
+        return true;
+    };
+
+    for (uint32_t ref : order) {
+        if (taken[ref]) continue;
+        taken[ref] = 1;
+        group.assign(1, ref);
+        Vec2 origin = vertices[pieces[ref].a];
+        Vec2 dir = (vertices[pieces[ref].b] - origin) * (1.0f / length[ref]);
+        float lo = 0.0f, hi = length[ref];
+        uint32_t loVertex = pieces[ref].a, hiVertex = pieces[ref].b;
+
+        // Take in whatever touches the span; the span grows as it does, so
+        // look again until nothing more joins. The line is refitted through
+        // the ends each round, so small errors in the first piece's
+        // direction do not add up along a long wall. A piece only joins if
+        // it lies within tolerance of the segment between the ends it
+        // leaves, and one that moves an end only if everything taken so far
+        // does too, so a gentle curve cannot drift the fit away from its
+        // first pieces.
+        bool grew = true;
+        while (grew) {
+            grew = false;
+            if (loVertex != pieces[ref].a || hiVertex != pieces[ref].b) {
+                origin = vertices[loVertex];
+                Vec2 span = vertices[hiVertex] - origin;
+                hi = span.length();
+                dir = span * (1.0f / hi);
+                lo = 0.0f;
+            }
+            ++stamp;
+            Vec2 boxLo, boxHi;
+            bounds(origin + dir * (lo - weld), origin + dir * (hi + weld), boxLo, boxHi);
+            forCells(boxLo, boxHi, [&](uint64_t key) {
+                auto found = cells.find(key);
+                if (found == cells.end()) return;
+                for (uint32_t s : found->second) {
+                    if (taken[s] || seen[s] == stamp) continue;
+                    seen[s] = stamp;
+                    Vec2 p = vertices[pieces[s].a] - origin, q = vertices[pieces[s].b] - origin;
+                    if (std::abs(cross(dir, p)) > tolerance || std::abs(cross(dir, q)) > tolerance) continue;
+                    float tp = dot(dir, p), tq = dot(dir, q);
+                    if (std::min(tp, tq) > hi + weld || std::max(tp, tq) < lo - weld) continue;
+
+                    float newLo = lo, newHi = hi;
+                    uint32_t newLoVertex = loVertex, newHiVertex = hiVertex;
+                    if (tp < newLo) { newLo = tp; newLoVertex = pieces[s].a; }
+                    if (tq < newLo) { newLo = tq; newLoVertex = pieces[s].b; }
+                    if (tp > newHi) { newHi = tp; newHiVertex = pieces[s].a; }
+                    if (tq > newHi) { newHi = tq; newHiVertex = pieces[s].b; }
+                    bool extends = newLoVertex != loVertex || newHiVertex != hiVertex;
+                    if (!fits(newLoVertex, newHiVertex, s, extends)) continue;
+
+                    taken[s] = 1;
+                    group.push_back(s);
+                    ++merged;
+                    lo = newLo; hi = newHi;
+                    loVertex = newLoVertex; hiVertex = newHiVertex;
+                    grew |= extends;
+                }
+            });
+        }
+        out.push_back({ loVertex, hiVertex });
+    }
+    return out;
+}
+
+// Chains pieces through vertices exactly two of them share
+std::vector<std::vector<uint32_t>> joinPolylines(const std::vector<Piece>& pieces, size_t vertexCount) {
+    std::vector<std::vector<uint32_t>> touching(vertexCount);
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        touching[pieces[i].a].push_back((uint32_t)i);
+        touching[pieces[i].b].push_back((uint32_t)i);
+    }
+
+    std::vector<uint8_t> used(pieces.size(), 0);
+    std::vector<std::vector<uint32_t>> chains;
+    auto walk = [&](uint32_t start, uint32_t piece) {
+        std::vector<uint32_t> chain{ start };
+        uint32_t at = start;
+        while (true) {
+            used[piece] = 1;
+            at = pieces[piece].a == at ? pieces[piece].b : pieces[piece].a;
+            chain.push_back(at);
+            if (touching[at].size() != 2) break;
+            uint32_t next = touching[at][0] == piece ? touching[at][1] : touching[at][0];
+            if (used[next]) break;   // Back where a closed outline started
+            piece = next;
+        }
+        chains.push_back(std::move(chain));
+    };
+
+    // Open chains start and end where the count is not two; what is left
+    // after them are closed loops
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+        if (touching[v].size() == 2) continue;
+        for (uint32_t piece : touching[v]) {
+            if (!used[piece]) walk(v, piece);
+        }
+    }
+    for (uint32_t i = 0; i < pieces.size(); ++i) {
+        if (!used[i]) walk(pieces[i].a, i);
+    }
+    return chains;
+}
+
+} // namespace
+
+CleanupStats cleanupLines(std::vector<std::shared_ptr<Line>>& lines, const CleanupOptions& options) {
+    CleanupStats stats;
+    stats.linesBefore = lines.size();
+
+    Welder welder(options.weldDistance);
+    std::vector<Piece> pieces;
+    for (const auto& line : lines) {
+        const auto& points = line->getPoints();
+        if (points.empty()) continue;
+        uint32_t previous = welder.add(points[0], stats.verticesWelded);
+        for (size_t i = 1; i < points.size(); ++i) {
+            uint32_t current = welder.add(points[i], stats.verticesWelded);
+            ++stats.segmentsBefore;
+            if (current == previous) {
+                ++stats.degenerate;
+                continue;
+            }
+            pieces.push_back({ previous, current });
+            previous = current;
+        }
+    }
+
+    pieces = mergeCollinear(pieces, welder.vertices, options.weldDistance, options.lineTolerance, stats.merged);
+    stats.segmentsAfter = pieces.size();
+
+    std::vector<std::shared_ptr<Line>> cleaned;
+    std::vector<Vec2> points;
+    for (const auto& chain : joinPolylines(pieces, welder.vertices.size())) {
+        points.clear();
+        for (uint32_t v : chain) points.push_back(welder.vertices[v]);
+        cleaned.push_back(std::make_shared<Line>(points));
+    }
+    lines = std::move(cleaned);
+    stats.linesAfter = lines.size();
+    return stats;
+}
@@ -0,0 +1,37 @@
+#ifndef GEOMETRY_CLEANUP_HH
+#define GEOMETRY_CLEANUP_HH
+
+#include "../npc/Shapes/Line.hh"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+struct CleanupOptions {
+    float weldDistance = 0.01f;    // Vertices closer than this become one
+    float lineTolerance = 0.01f;   // How far off a wall a piece may be and still lie along it
+};
+
+struct CleanupStats {
+    size_t linesBefore = 0, linesAfter = 0;
+    size_t segmentsBefore = 0, segmentsAfter = 0;
+    size_t verticesWelded = 0;     // Moved onto a nearby vertex
+    size_t degenerate = 0;         // Pieces that welded down to a point
+    size_t merged = 0;             // Pieces folded into a collinear neighbour
+};
+
+// Tidies hand-drawn walls (map.lines, or the builder's list) in place:
+//
+//   1. welds vertices within weldDistance onto the first one seen there,
+//   2. drops pieces that welded down to nothing,
+//   3. folds every piece lying along a longer one (both ends within
+//      lineTolerance of it) and overlapping or touching it into one
+//      piece: duplicates, overlaps and collinear runs alike, and
+//   4. joins pieces that meet end to end, at a vertex no third piece
+//      touches, into polylines (closed outlines come back closed).
+//
+// Nothing moves further than the tolerances, and gaps wider than
+// weldDistance (doorways) stay open. Walls come back in a new order.
+CleanupStats cleanupLines(std::vector<std::shared_ptr<Line>>& lines,
+                          const CleanupOptions& options = CleanupOptions());
+
+#endif // GEOMETRY_CLEANUP_HH
@@ -0,0 +1,33 @@
+#ifndef GRID_FIT_HH
+#define GRID_FIT_HH
+
+#include <algorithm>
+#include <cmath>
+
+// Widest span, either way, that the map grids (spatial index, distance
+// field, nav mesh, flow field) will cover. Real maps are a few thousand
+// units across; past this the map is broken (a stray or corrupt point),
+// and the grids stay empty rather than take all memory.
+const float MAX_GRID_SPAN = 1e7f;
+
+// Cell size, no smaller than cellSize, at which a grid over spanX by spanY
+// has at most maxCells cells, counting ceil(span / size) + 1 cells along
+// each axis (as many as any of the grids uses). Both counts are taken in
+// doubles, so one far point on a thin map grows the cells until the long
+// axis alone fits instead of overflowing an int product.
+//
+// Returns 0 if either span is negative, not finite or past MAX_GRID_SPAN.
+inline float fitCellSize(float spanX, float spanY, float cellSize, double maxCells) {
+    if (!(spanX >= 0.0f && spanY >= 0.0f && spanX <= MAX_GRID_SPAN && spanY <= MAX_GRID_SPAN)) return 0.0f;
+
+    double size = cellSize;
+    auto cells = [&] { return (std::ceil(spanX / size) + 1) * (std::ceil(spanY / size) + 1); };
+    // Each round takes the excess down to its square root or better, and
+    // the +1s make the last steps small, hence the floor on the factor
+    for (int round = 0; round < 64 && cells() > maxCells; ++round) {
+        size *= std::max(std::sqrt(cells() / maxCells), 1.01);
+    }
+    return (float)size;
+}
+
+#endif // GRID_FIT_HH
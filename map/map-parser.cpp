@@ -0,0 +1,259 @@
+#include "map-parser.hh"
+#include "../npc/Shapes/Rectangle.hh"
+#include "../npc/Shapes/Triangle.hh"
+#include "../npc/Shapes/Circle.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+namespace {
+
+// Files smaller than this parse on the calling thread; bigger ones are cut
+// into pieces at least this big
+const size_t MIN_CHUNK_BYTES = 256 * 1024;
+
+// Chunks per pool thread, so an uneven split still keeps all of them busy
+const size_t CHUNKS_PER_THREAD = 4;
+
+// An NPC_CIRC record, made into an NPC when the chunks are merged. One
+// without an id keeps NPC's default id ("Unnamed"), as map files always
+// have; only an explicitly empty id would draw on NPC's npc_N counter.
+struct NPCRecord {
+    Vec2 position, velocity;
+    float radius;
+    std::string id;
+};
+
+// What one run of records holds, in file order
+struct Chunk {
+    std::vector<std::shared_ptr<Shape>> shapes;
+    std::vector<std::shared_ptr<Line>> lines;
+    std::vector<NPCRecord> npcs;
+};
+
+std::string_view trim(std::string_view s) {
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string_view::npos) return std::string_view();
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Cuts the next line off text, without its newline
+std::string_view nextLine(std::string_view& text) {
+    size_t end = text.find('\n');
+    std::string_view line = text.substr(0, end);
+    text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+    return line;
+}
+
+// Cuts the next comma-separated field off rest; false once rest is used up
+bool nextField(std::string_view& rest, std::string_view& field) {
+    if (rest.data() == nullptr) return false;
+    size_t comma = rest.find(',');
+    if (comma == std::string_view::npos) {
+        field = rest;
+        rest = std::string_view();
+    } else {
+        field = rest.substr(0, comma);
+        rest.remove_prefix(comma + 1);
+    }
+    return true;
+}
+
+// The whole field must be a number; spaces around it and a leading '+'
+// are allowed, as they were with istream
+bool parseFloat(std::string_view field, float& value) {
+    field = trim(field);
+    if (!field.empty() && field[0] == '+') field.remove_prefix(1);
+    if (field.empty()) return false;
+    auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(), value);
+    return ec == std::errc() && end == field.data() + field.size();
+}
+
+template <size_t N>
+bool parseFloats(std::string_view& rest, float (&values)[N]) {
+    std::string_view field;
+    for (size_t i = 0; i < N; ++i) {
+        if (!nextField(rest, field) || !parseFloat(field, values[i])) return false;
+    }
+    return true;
+}
+
+enum RecordType { SKIP, RECT, TRI, CIRC, NPC_CIRC, LINE };
+
+RecordType recordType(std::string_view type) {
+    type = trim(type);
+    if (type == "RECT") return RECT;
+    if (type == "TRI") return TRI;
+    if (type == "CIRC") return CIRC;
+    if (type == "NPC_CIRC") return NPC_CIRC;
+    if (type == "LINE") return LINE;
+    return SKIP;
+}
+
+// Splits a record into its type and the fields after it
+RecordType splitRecord(std::string_view line, std::string_view& rest) {
+    if (line.empty() || line[0] == '#') return SKIP;
+    std::string_view type;
+    rest = line;
+    nextField(rest, type);
+    return recordType(type);
+}
+
+void parseRecord(RecordType type, std::string_view rest, Chunk& out) {
+    switch (type) {
+        case RECT: {
+            float v[4];
+            if (parseFloats(rest, v)) {
+                out.shapes.push_back(std::make_shared<Rectangle>(Vec2(v[0], v[1]), v[2], v[3]));
+            }
+            break;
+        }
+        case TRI: {
+            float v[6];
+            if (parseFloats(rest, v)) {
+                out.shapes.push_back(std::make_shared<Triangle>(
+                    Vec2(v[0], v[1]), Vec2(v[2], v[3]), Vec2(v[4], v[5])));
+            }
+            break;
+        }
+        case CIRC: {
+            float v[3];
+            if (parseFloats(rest, v)) {
+                out.shapes.push_back(std::make_shared<Circle>(Vec2(v[0], v[1]), v[2]));
+            }
+            break;
+        }
+        case NPC_CIRC: {
+            float v[5];
+            if (!parseFloats(rest, v)) break;
+            // Everything after the last number is the optional id
+            out.npcs.push_back({ Vec2(v[0], v[1]), Vec2(v[3], v[4]), v[2], std::string(trim(rest)) });
+            break;
+        }
+        case LINE: {
+            std::vector<Vec2> points;
+            points.reserve((std::count(rest.begin(), rest.end(), ',') + 1) / 2);
+            std::string_view fx, fy;
+            float x, y;
+            while (nextField(rest, fx) && nextField(rest, fy)) {
+                if (parseFloat(fx, x) && parseFloat(fy, y)) points.push_back(Vec2(x, y));
+            }
+            if (points.size() >= 2) {
+                out.lines.push_back(std::make_shared<Line>(points));
+            }
+            break;
+        }
+        case SKIP:
+            break;
+    }
+}
+
+// Parses whole lines of records into chunk
+void parseRecords(std::string_view text, Chunk& chunk) {
+    // Count the records first so the lists grow once
+    size_t shapes = 0, lines = 0, npcs = 0;
+    std::string_view scan = text, rest;
+    while (!scan.empty()) {
+        switch (splitRecord(nextLine(scan), rest)) {
+            case RECT: case TRI: case CIRC: ++shapes; break;
+            case NPC_CIRC: ++npcs; break;
+            case LINE: ++lines; break;
+            case SKIP: break;
+        }
+    }
+    chunk.shapes.reserve(shapes);
+    chunk.lines.reserve(lines);
+    chunk.npcs.reserve(npcs);
+
+    while (!text.empty()) {
+        RecordType type = splitRecord(nextLine(text), rest);
+        parseRecord(type, rest, chunk);
+    }
+}
+
+// Reads the "MAP:" line off text into out.name
+bool parseHeader(std::string_view& text, MapText& out) {
+    std::string_view header = trim(nextLine(text));
+    if (header.substr(0, 4) != "MAP:") {
+        std::cerr << "Invalid map file - expected 'MAP:' on first line" << std::endl;
+        return false;
+    }
+    out.name = std::string(header.substr(4));
+    return true;
+}
+
+// Appends the chunks to out in order
+void merge(std::vector<Chunk>& chunks, MapText& out) {
+    size_t shapes = 0, lines = 0, npcs = 0;
+    for (const Chunk& chunk : chunks) {
+        shapes += chunk.shapes.size();
+        lines += chunk.lines.size();
+        npcs += chunk.npcs.size();
+    }
+    out.shapes.reserve(out.shapes.size() + shapes);
+    out.lines.reserve(out.lines.size() + lines);
+    out.npcs.reserve(out.npcs.size() + npcs);
+
+    for (Chunk& chunk : chunks) {
+        std::move(chunk.shapes.begin(), chunk.shapes.end(), std::back_inserter(out.shapes));
+        std::move(chunk.lines.begin(), chunk.lines.end(), std::back_inserter(out.lines));
+        for (NPCRecord& npc : chunk.npcs) {
+            auto shape = std::make_shared<Circle>(npc.position, npc.radius);
+            if (npc.id.empty()) {
+                out.npcs.emplace_back(shape, npc.velocity);
+            } else {
+                out.npcs.emplace_back(shape, npc.velocity, std::move(npc.id));
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool parseMapText(std::string_view text, MapText& out) {
+    if (!parseHeader(text, out)) return false;
+    std::vector<Chunk> chunks(1);
+    parseRecords(text, chunks[0]);
+    merge(chunks, out);
+    return true;
+}
+
+bool parseMapText(std::string_view text, MapText& out, ThreadPool& pool) {
+    if (!parseHeader(text, out)) return false;
+
+    // Cut the records at line breaks into about equal pieces
+    size_t count = std::min<size_t>(pool.concurrency() * CHUNKS_PER_THREAD, text.size() / MIN_CHUNK_BYTES);
+    count = std::max<size_t>(count, 1);
+    std::vector<std::string_view> pieces;
+    size_t begin = 0;
+    for (size_t k = 1; k <= count && begin < text.size(); ++k) {
+        size_t end = k == count ? text.size() : std::max(begin, text.size() * k / count);
+        end = text.find('\n', end);
+        end = end == std::string_view::npos ? text.size() : end + 1;
+        pieces.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+
+    std::vector<Chunk> chunks(pieces.size());
+    pool.parallelFor(pieces.size(), 1, [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) parseRecords(pieces[i], chunks[i]);
+    });
+    merge(chunks, out);
+    return true;
+}
+
+bool parseMapFile(const std::string& path, MapText& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open map file: " << path << std::endl;
+        return false;
+    }
+    std::string buffer((size_t)file.tellg(), '\0');
+    file.seekg(0);
+    file.read(&buffer[0], (std::streamsize)buffer.size());
+    return parseMapText(buffer, out, ThreadPool::shared());
+}
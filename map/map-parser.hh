@@ -0,0 +1,44 @@
+#ifndef MAP_PARSER_HH
+#define MAP_PARSER_HH
+
+#include "../npc/Shape.hh"
+#include "../npc/Shapes/Line.hh"
+#include "../npc/npc.hh"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class ThreadPool;
+
+// What a text .map file holds, before it goes into a Map or the map
+// builder's own lists
+struct MapText {
+    std::string name;
+    std::vector<std::shared_ptr<Shape>> shapes;   // In file order
+    std::vector<std::shared_ptr<Line>> lines;
+    std::vector<NPC> npcs;
+};
+
+// The text .map reader shared by the game and the builder. The whole file
+// is read into one buffer and cut into std::string_view fields, numbers
+// go through std::from_chars, and a first pass over the record types
+// sizes the output, so nothing is copied or allocated per field. Big
+// files are cut at line breaks into chunks that parse on a thread pool,
+// each into lists of its own, joined in file order at the end.
+//
+// Records that do not parse are skipped, as before: a shape needs all of
+// its numbers, a LINE at least two points. Blank lines and lines starting
+// with '#' are ignored.
+
+// Reads path, in parallel on ThreadPool::shared(); false with a message
+// on stderr if it cannot be opened or has no "MAP:" header
+bool parseMapFile(const std::string& path, MapText& out);
+
+// Same, from the text of a whole file, on the calling thread only
+bool parseMapText(std::string_view text, MapText& out);
+
+// Same, in parallel chunks on pool
+bool parseMapText(std::string_view text, MapText& out, ThreadPool& pool);
+
+#endif // MAP_PARSER_HH
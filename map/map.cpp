@@ -1,179 +1,443 @@
 #include "map.hh"
+#include "fmap.hh"
+#include "map-parser.hh"
 #include "../npc/Shapes/Rectangle.hh"
 #include "../npc/Shapes/Triangle.hh"
 #include "../npc/Shapes/Circle.hh"
 #include "../npc/Shapes/Line.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
-#include <sstream>
 #include <iostream>
+#include <random>
 
-void Map::addShape(std::shared_ptr<Shape> shape) {
+ShapeHandle Map::addShape(std::shared_ptr<Shape> shape) {
     shapes.push_back(shape);
+    shapeHandles.push_back(shapeTable.add((uint32_t)(shapes.size() - 1)));
+    return shapeHandles.back();
 }
 
-void Map::addNPC(const NPC& npc) {
+NPCHandle Map::addNPC(const NPC& npc) {
     npcs.push_back(npc);
+    NPC& added = npcs.back();
+    uint32_t index = (uint32_t)(npcs.size() - 1);
+    added.handle = npcTable.add(index);
+
+    Vec2 min, max;
+    added.shape->getBounds(min, max);
+    float radius = std::max(max.x - min.x, max.y - min.y) * 0.5f;
+    added.body = npcStore.add(added.shape->position, added.velocity, radius, index);
+    return added.handle;
 }
 
-void Map::update(float dt) {
-    for (auto& npc : npcs) {
-        npc.update(dt);
+bool Map::removeShape(ShapeHandle handle) {
+    uint32_t index = shapeTable.find(handle);
+    if (index == HandleTable<Shape>::NONE) return false;
+
+    uint32_t last = (uint32_t)(shapes.size() - 1);
+    if (index != last) {
+        shapes[index] = std::move(shapes[last]);
+        shapeHandles[index] = shapeHandles[last];
+        shapeTable.move(shapeHandles[index], index);
     }
+    shapes.pop_back();
+    shapeHandles.pop_back();
+    shapeTable.remove(handle);
+    return true;
 }
 
-void Map::save(const std::string& filename) const {
-    std::ofstream file(filename);
-    file << "MAP:" << name << "\n";
-    
-    for (const auto& shape : shapes) {
-        if (auto rect = dynamic_cast<Rectangle*>(shape.get())) {
-            file << "RECT," << rect->position.x << "," << rect->position.y << ","
-                 << rect->width << "," << rect->height << "\n";
-        } else if (auto tri = dynamic_cast<Triangle*>(shape.get())) {
-            file << "TRI," << tri->p1.x << "," << tri->p1.y << ","
-                 << tri->p2.x << "," << tri->p2.y << ","
-                 << tri->p3.x << "," << tri->p3.y << "\n";
-        } else if (auto circ = dynamic_cast<Circle*>(shape.get())) {
-            file << "CIRC," << circ->position.x << "," << circ->position.y << ","
-                 << circ->radius << "\n";
-        }
+bool Map::removeNPC(NPCHandle handle) {
+    uint32_t index = npcTable.find(handle);
+    if (index == HandleTable<NPC>::NONE) return false;
+
+    // The body first: the store moves its last body into the gap, and if
+    // that one is named, its NPC has to follow
+    uint32_t body = npcs[index].body;
+    uint32_t lastBody = (uint32_t)(npcStore.size() - 1);
+    npcStore.remove(body);
+    npcLod.remove(body, lastBody);
+    npcPerception.remove(body, lastBody);
+    if (body != lastBody && npcStore.cold[body] != NPCStore::NONE) {
+        npcs[npcStore.cold[body]].body = body;
     }
-    
-    // Save all NPCs
-    for (const auto& npc : npcs) {
-        if (auto circ = dynamic_cast<Circle*>(npc.shape.get())) {
-            file << "NPC_CIRC," << circ->position.x << "," << circ->position.y << ","
-                 << circ->radius << "," << npc.velocity.x << "," << npc.velocity.y << "\n";
-        }
+
+    uint32_t last = (uint32_t)(npcs.size() - 1);
+    if (index != last) {
+        npcs[index] = std::move(npcs[last]);
+        npcTable.move(npcs[index].handle, index);
+        npcStore.cold[npcs[index].body] = index;
     }
-    
-    // Save lines
-    for (const auto& line : lines) {
-        file << "LINE";
-        for (const auto& pt : line->getPoints()) {
-            file << "," << pt.x << "," << pt.y;
-        }
-        file << "\n";
+    npcs.pop_back();
+    npcTable.remove(handle);
+    return true;
+}
+
+NPC* Map::getNPC(NPCHandle handle) {
+    uint32_t index = npcTable.find(handle);
+    return index == HandleTable<NPC>::NONE ? nullptr : &npcs[index];
+}
+
+const NPC* Map::getNPC(NPCHandle handle) const {
+    uint32_t index = npcTable.find(handle);
+    return index == HandleTable<NPC>::NONE ? nullptr : &npcs[index];
+}
+
+Shape* Map::getShape(ShapeHandle handle) const {
+    uint32_t index = shapeTable.find(handle);
+    return index == HandleTable<Shape>::NONE ? nullptr : shapes[index].get();
+}
+
+void Map::spawnCrowd(const Vec2& min, const Vec2& max, size_t count,
+                     float speed, float radius, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> x(min.x, max.x), y(min.y, max.y);
+    std::uniform_real_distribution<float> heading(0.0f, 2.0f * (float)M_PI);
+
+    npcStore.reserve(npcStore.size() + count);
+    for (size_t i = 0; i < count; ++i) {
+        float angle = heading(rng);
+        npcStore.add(Vec2(x(rng), y(rng)), Vec2(std::cos(angle), std::sin(angle)) * speed, radius);
     }
 }
 
-Map Map::load(const std::string& filename) {
-    Map map;
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Failed to open map file: " << filename << std::endl;
-        return map;
+namespace {
+
+// Runs the bodies npcLod picked for this step
+void simulate(Map& map) {
+    ThreadPool& pool = ThreadPool::shared();
+    NPCStore& store = map.npcStore;
+    const NPCLod& lod = map.npcLod;
+    const float* steps = lod.getSteps();
+
+    store.savePositions();
+    map.npcAvoidance.solve(store, lod.getAwake(), lod.getInteracting(), steps, pool);
+
+    // Nobody near enough to see a far body dodge; it just walks
+    for (uint32_t i : lod.getCoarse()) {
+        store.velX[i] = store.prefVelX[i];
+        store.velY[i] = store.prefVelY[i];
+    }
+
+    store.integrate(lod.getTicking(), steps, pool);
+    map.npcCollision.resolve(map, lod.getAwake(), lod.getInteracting(), lod.getTicking(), steps, pool);
+
+    // Named NPCs keep a Shape for hit tests and drawing; bring it along
+    for (auto& npc : map.npcs) {
+        npc.shape->position = store.position(npc.body);
+        npc.velocity = store.velocity(npc.body);
     }
+}
+
+} // namespace
+
+void Map::update(float dt) {
+    npcLod.scheduleAll(npcStore, dt);
+    simulate(*this);
+}
+
+void Map::update(float dt, const Vec2& focus) {
+    npcLod.schedule(npcStore, focus, dt);
+    simulate(*this);
+}
 
-    std::string line;
+void Map::buildSpatialIndex(float cellSize) {
+    static std::atomic<uint64_t> nextRevision{1};
+    revision = nextRevision++;
 
-    // Read MAP: line
-    if (std::getline(file, line)) {
-        if (line.substr(0, 4) == "MAP:") {
-            map.name = line.substr(4);
-        } else {
-            std::cerr << "Invalid map file - expected 'MAP:' on first line" << std::endl;
-            return map;
+    segments.clear();
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const auto& pts = lines[i]->getPoints();
+        for (size_t j = 0; j + 1 < pts.size(); ++j) {
+            segments.push(pts[j], pts[j + 1], (uint32_t)i);
         }
     }
+    staticShapes.build(shapes);
+    grid.build(segments, shapes, cellSize);
 
-    int npc_count = 0;
-    int shape_count = 0;
-    int line_count = 0;
+    // Copy the segments out in cell order so that every grid row of a
+    // clearance query is one contiguous run for the SIMD kernel
+    const auto& items = grid.getSegmentItems();
+    cellSegments.clear();
+    cellSegments.reserve(items.size());
+    for (uint32_t i : items) {
+        cellSegments.push(segments.a(i), segments.b(i), segments.line[i]);
+    }
+}
+
+void Map::bakeDistanceField(float cellSize, float maxDistance) {
+    distanceField.bake(lines, shapes, cellSize, maxDistance, ThreadPool::shared());
+}
 
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
+void Map::buildNavMesh(float agentRadius, float cellSize) {
+    auto mesh = std::make_shared<NavMesh>();
+    mesh->build(*this, agentRadius, cellSize, ThreadPool::shared());
+    navMesh = mesh;
+}
+
+bool Map::circleHitsStatic(const Vec2& center, float radius) const {
+    // One lookup settles the common case of standing in the open
+    if (!distanceField.empty() && distanceField.lowerBound(center) >= radius) {
+        return false;
+    }
 
-        std::istringstream iss(line);
-        std::string type;
-        std::getline(iss, type, ',');
+    Vec2 lo(center.x - radius, center.y - radius);
+    Vec2 hi(center.x + radius, center.y + radius);
 
-        char comma;
+    // Shapes keep the vertical-span test the player has always used
+    bool hit = grid.forEachShape(lo, hi, [&](uint32_t i) {
+        return staticShapes.visit(i, [&](const auto& shape) {
+            float minY, maxY;
+            return shape.intersectsVerticalLine(center.x, minY, maxY) &&
+                   center.y >= minY - radius && center.y <= maxY + radius;
+        });
+    });
+    if (hit) return true;
 
-        if (type == "RECT") {
-            float x, y, w, h;
-            iss >> x >> comma >> y >> comma >> w >> comma >> h;
-            if (iss) {
-                map.addShape(std::make_shared<Rectangle>(Vec2(x, y), w, h));
-                shape_count++;
-            }
+    // Open polylines collide by distance
+    return distanceToWalls(center, radius) < radius;
+}
+
+bool Map::circleClearOfStatic(const Vec2& center, float radius) const {
+    if (!distanceField.empty() && distanceField.lowerBound(center) >= radius) {
+        return true;
+    }
+    if (distanceToWalls(center, radius) < radius) return false;
+
+    Vec2 lo(center.x - radius, center.y - radius);
+    Vec2 hi(center.x + radius, center.y + radius);
+    return !grid.forEachShape(lo, hi, [&](uint32_t i) {
+        Contact contact;
+        staticShapes.visit(i, [&](const auto& shape) {
+            contactCircleShape(center, radius, shape, contact);
+        });
+        return contact.hit;
+    });
+}
+
+float Map::distanceToWalls(const Vec2& point, float maxDistance) const {
+    Vec2 lo(point.x - maxDistance, point.y - maxDistance);
+    Vec2 hi(point.x + maxDistance, point.y + maxDistance);
+
+    float bestSq = maxDistance * maxDistance;
+    grid.forEachSegmentRun(lo, hi, [&](uint32_t begin, uint32_t end) {
+        bestSq = cellSegments.minDistanceSq(point, begin, end, bestSq);
+    });
+    return std::sqrt(bestSq);
+}
+
+void Map::distancesToWalls(const Vec2* points, size_t count, float maxDistance, float* out) const {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = distanceToWalls(points[i], maxDistance);
+    }
+}
+
+bool Map::castRay(const Vec2& origin, const Vec2& dir, float maxDistance, RayHit& hit) const {
+    hit = RayHit();
+    float best = maxDistance;
+    float t;
+    Vec2 normal;
+
+    // NPCs move, so they are not in the grid; there are few enough of them
+    // to test directly, and the closest one bounds the static walk below
+    for (size_t i = 0; i < npcs.size(); ++i) {
+        if (npcs[i].shape->intersectRay(origin, dir, best, t, normal)) {
+            best = t;
+            hit.kind = RayHit::NPC;
+            hit.index = (int)i;
+            hit.normal = normal;
         }
-        else if (type == "TRI") {
-            float x1, y1, x2, y2, x3, y3;
-            iss >> x1 >> comma >> y1 >> comma >> x2 >> comma >> y2 >> comma >> x3 >> comma >> y3;
-            if (iss) {
-                map.addShape(std::make_shared<Triangle>(
-                    Vec2(x1, y1), Vec2(x2, y2), Vec2(x3, y3)
-                ));
-                shape_count++;
+    }
+
+    // The baked field can vouch for a clear stretch at the start of the
+    // ray; the exact walk only has to cover what comes after it
+    float skip = 0.0f;
+    if (!distanceField.empty()) {
+        distanceField.traceRay(origin, dir, best, skip);
+    }
+
+    grid.traverseRay(origin + dir * skip, dir, best - skip, [&](int cell, float tExit) {
+        grid.forEachSegmentInCell(cell, [&](uint32_t i) {
+            if (Line::intersectRaySegment(origin, dir, best, segments.a(i), segments.b(i), t, normal)) {
+                best = t;
+                hit.kind = RayHit::WALL;
+                hit.index = (int)i;
+                hit.normal = normal;
             }
-        }
-        else if (type == "CIRC") {
-            float x, y, r;
-            iss >> x >> comma >> y >> comma >> r;
-            if (iss) {
-                map.addShape(std::make_shared<Circle>(Vec2(x, y), r));
-                shape_count++;
+        });
+        grid.forEachShapeInCell(cell, [&](uint32_t i) {
+            bool shapeHit = staticShapes.visit(i, [&](const auto& shape) {
+                return shape.intersectRay(origin, dir, best, t, normal);
+            });
+            if (shapeHit) {
+                best = t;
+                hit.kind = RayHit::SHAPE;
+                hit.index = (int)i;
+                hit.normal = normal;
             }
+        });
+        // Anything in a later cell is further away than a hit inside this one
+        return hit.kind != RayHit::NONE && best <= skip + tExit;
+    });
+
+    if (hit.kind == RayHit::NONE) return false;
+    hit.distance = best;
+    hit.point = origin + dir * best;
+    return true;
+}
+
+bool Map::sweepCircle(const Vec2& start, const Vec2& delta, float radius, SweepHit& hit) const {
+    hit = SweepHit();
+
+    // Broadphase: everything bucketed around the swept box
+    Vec2 end = start + delta;
+    Vec2 lo(std::min(start.x, end.x) - radius, std::min(start.y, end.y) - radius);
+    Vec2 hi(std::max(start.x, end.x) + radius, std::max(start.y, end.y) + radius);
+
+    // Static geometry can be skipped outright when the field shows the whole
+    // swept circle is in the clear
+    float length = delta.length();
+    bool staticClear = !distanceField.empty() &&
+                       distanceField.lowerBound(start) >= radius + length;
+
+    if (!staticClear) {
+        grid.forEachSegment(lo, hi, [&](uint32_t i) {
+            sweepCircleSegment(start, delta, radius, segments.a(i), segments.b(i), hit);
+            return false;
+        });
+        grid.forEachShape(lo, hi, [&](uint32_t i) {
+            staticShapes.visit(i, [&](const auto& shape) {
+                sweepCircleShape(start, delta, radius, shape, hit);
+            });
+            return false;
+        });
+    }
+
+    for (const auto& npc : npcs) {
+        Vec2 npcMin, npcMax;
+        npc.shape->getBounds(npcMin, npcMax);
+        if (npcMax.x < lo.x || npcMin.x > hi.x || npcMax.y < lo.y || npcMin.y > hi.y) continue;
+        if (npc.shape->getKind() == ShapeKind::CIRCLE) {
+            sweepCircleShape(start, delta, radius, static_cast<const Circle&>(*npc.shape), hit);
         }
-        else if (type == "NPC_CIRC") {
-            float x, y, r, vx, vy;
-            std::string npc_id;
-
-            iss >> x >> comma >> y >> comma >> r >> comma >> vx >> comma >> vy;
-
-            // Read optional identifier/name after the last comma
-            if (iss >> comma) {
-                std::getline(iss, npc_id);
-                // Clean up whitespace
-                npc_id.erase(0, npc_id.find_first_not_of(" \t\r\n"));
-                npc_id.erase(npc_id.find_last_not_of(" \t\r\n") + 1);
-            }
+    }
 
-            if (iss) {
-                auto shape = std::make_shared<Circle>(Vec2(x, y), r);
-                // MARK: NPC FACTORY
-                NPC new_npc(shape, Vec2(vx, vy));
+    return hit.hit;
+}
 
-                // Store the name/ID if present
-                if (!npc_id.empty()) {
-                    new_npc.id = npc_id;
-                    // You can also do: new_npc.name = npc_id;  // if your NPC has a 'name' field
-                }
+Vec2 Map::moveCircle(const Vec2& start, const Vec2& delta, float radius, int maxIterations) const {
+    // Gap kept between the mover and a surface so the next sweep does not
+    // start out touching it
+    const float skin = 1e-3f;
 
-                map.addNPC(new_npc);
-                npc_count++;
-            }
+    Vec2 pos = start;
+    Vec2 remaining = delta;
+
+    for (int i = 0; i < maxIterations; ++i) {
+        if (remaining.x * remaining.x + remaining.y * remaining.y < 1e-12f) break;
+
+        SweepHit hit;
+        if (!sweepCircle(pos, remaining, radius, hit)) {
+            return pos + remaining;
         }
-        else if (type == "LINE") {
-            std::vector<Vec2> linePoints;
-            std::string coord;
-            while (std::getline(iss, coord, ',')) {
-                float x, y;
-                std::istringstream coordIss(coord);
-                coordIss >> x;
-                if (coordIss) {
-                    std::getline(iss, coord, ',');
-                    std::istringstream yIss(coord);
-                    yIss >> y;
-                    if (yIss) {
-                        linePoints.push_back(Vec2(x, y));
-                    }
-                }
+
+        // Advance to the contact, then slide: drop the part of what is left
+        // that points into the surface
+        pos = pos + remaining * hit.time + hit.normal * skin;
+        Vec2 leftover = remaining * (1.0f - hit.time);
+        float into = leftover.x * hit.normal.x + leftover.y * hit.normal.y;
+        remaining = leftover - hit.normal * std::min(0.0f, into);
+    }
+
+    return pos;
+}
+
+bool Map::save(const std::string& filename) const {
+    if (filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".fmap") == 0) {
+        return writeFmap(*this, filename);
+    }
+
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Failed to write map file: " << filename << std::endl;
+        return false;
+    }
+    file << "MAP:" << name << "\n";
+    
+    for (const auto& shape : shapes) {
+        switch (shape->getKind()) {
+            case ShapeKind::RECTANGLE: {
+                const auto& rect = static_cast<const Rectangle&>(*shape);
+                file << "RECT," << rect.position.x << "," << rect.position.y << ","
+                     << rect.width << "," << rect.height << "\n";
+                break;
             }
-            if (linePoints.size() >= 2) {
-                map.lines.push_back(std::make_shared<Line>(linePoints));
-                line_count++;
+            case ShapeKind::TRIANGLE: {
+                const auto& tri = static_cast<const Triangle&>(*shape);
+                file << "TRI," << tri.p1.x << "," << tri.p1.y << ","
+                     << tri.p2.x << "," << tri.p2.y << ","
+                     << tri.p3.x << "," << tri.p3.y << "\n";
+                break;
             }
+            case ShapeKind::CIRCLE: {
+                const auto& circ = static_cast<const Circle&>(*shape);
+                file << "CIRC," << circ.position.x << "," << circ.position.y << ","
+                     << circ.radius << "\n";
+                break;
+            }
+            case ShapeKind::LINE:
+                break;
+        }
+    }
+    
+    // Save all NPCs
+    for (const auto& npc : npcs) {
+        if (npc.shape->getKind() == ShapeKind::CIRCLE) {
+            const auto& circ = static_cast<const Circle&>(*npc.shape);
+            file << "NPC_CIRC," << circ.position.x << "," << circ.position.y << ","
+                 << circ.radius << "," << npc.velocity.x << "," << npc.velocity.y << ","
+                 << npc.id << "\n";
+        }
+    }
+    
+    // Save lines
+    for (const auto& line : lines) {
+        file << "LINE";
+        for (const auto& pt : line->getPoints()) {
+            file << "," << pt.x << "," << pt.y;
         }
+        file << "\n";
     }
+    file.close();
+    if (!file) {
+        std::cerr << "Failed to write map file: " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+Map Map::load(const std::string& filename) {
+    Map map;
+    MapText text;
+    bool loaded = isFmap(filename) ? readFmap(filename, text) : parseMapFile(filename, text);
+    if (!loaded) return map;
+
+    map.name = std::move(text.name);
+    map.shapes.reserve(text.shapes.size());
+    for (auto& shape : text.shapes) map.addShape(std::move(shape));
+    map.lines = std::move(text.lines);
+    map.npcs.reserve(text.npcs.size());
+    for (const auto& npc : text.npcs) map.addNPC(npc);
+
+    map.buildSpatialIndex();
 
     // Improved debug output with NPC names/IDs
     std::cout << "\n=== MAP LOADED DEBUG ===\n";
     std::cout << "Map name: " << map.name << "\n";
-    std::cout << "Static shapes loaded: " << shape_count << "\n";
-    std::cout << "Lines loaded: " << line_count << "\n";
-    std::cout << "NPCs loaded: " << npc_count << "\n";
+    std::cout << "Static shapes loaded: " << map.shapes.size() << "\n";
+    std::cout << "Lines loaded: " << map.lines.size() << "\n";
+    std::cout << "NPCs loaded: " << map.npcs.size() << "\n";
 
     if (!map.npcs.empty()) {
         std::cout << "NPC list:\n";
@@ -1,25 +1,153 @@
 #ifndef MAP_HH
 #define MAP_HH
 
+#include "../engine/handle.hh"
 #include "../npc/Shape.hh"
 #include "../npc/Shapes/Line.hh"
 #include "../npc/npc.hh"
+#include "../npc/npc-store.hh"
+#include "../npc/npc-avoidance.hh"
+#include "../npc/npc-lod.hh"
+#include "collision.hh"
+#include "distance-field.hh"
+#include "nav-mesh.hh"
+#include "npc-collision.hh"
+#include "npc-perception.hh"
+#include "segment-buffer.hh"
+#include "shape-store.hh"
+#include "spatial-grid.hh"
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
 
+// Nearest thing a ray ran into
+using ShapeHandle = Handle<Shape>;
+
+struct RayHit {
+    enum Kind { NONE, WALL, SHAPE, NPC };
+    Kind kind = NONE;
+    int index = -1;        // Into Map::segments, Map::shapes or Map::npcs
+    float distance = 0.0f;
+    Vec2 point;
+    Vec2 normal;           // Surface normal, facing back along the ray
+};
+
 class Map {
 public:
     std::vector<std::shared_ptr<Shape>> shapes;
     std::vector<std::shared_ptr<Line>> lines;
     std::vector<NPC> npcs;
     std::string name;
+
+    // Stable names for the entries of npcs and shapes, which move when one
+    // is removed. Add and remove through the functions below to keep them
+    // in step; shapeHandles[i] names shapes[i].
+    HandleTable<NPC> npcTable;
+    HandleTable<Shape> shapeTable;
+    std::vector<ShapeHandle> shapeHandles;
+
+    // Position, velocity and radius of every NPC, named ones (npcs above)
+    // and ambient crowd members alike; this is what update() integrates
+    NPCStore npcStore;
+
+    // What update() does with npcStore: avoidance turns each body's
+    // preferred velocity into one that steers clear of its neighbours,
+    // then after integration collision keeps bodies apart and out of walls
+    NPCAvoidance npcAvoidance;
+    NPCCollision npcCollision;
+
+    // How often each body is simulated, by distance from the player; see
+    // update(dt, focus)
+    NPCLod npcLod;
+
+    // Who can see the player (or another body); not run by update(), call
+    // npcPerception.update() with the player's position
+    NPCPerception npcPerception;
+
+    // Static geometry index. Rebuild with buildSpatialIndex() after editing
+    // shapes or lines; load() does it once for you.
+    SegmentBuffer segments;       // Every polyline piece, in map order
+    SegmentBuffer cellSegments;   // Same segments in grid cell order
+    ShapeStore staticShapes;      // Map::shapes, partitioned by type
+    SpatialGrid grid;
+
+    // Changes every time the index is rebuilt, and never repeats across
+    // Map instances, so caches of the static geometry can key on it
+    uint64_t revision = 0;
+
+    // Optional baked clearance raster; empty until bakeDistanceField().
+    // When present, the queries below use it to skip open space.
+    DistanceField distanceField;
+
+    // Walkable space for pathfinding; null until buildNavMesh(). Shared and
+    // never modified, so path searches in flight can keep using an old one.
+    std::shared_ptr<const NavMesh> navMesh;
     
-    void addShape(std::shared_ptr<Shape> shape);
-    void addNPC(const NPC& npc);
+    ShapeHandle addShape(std::shared_ptr<Shape> shape);
+    NPCHandle addNPC(const NPC& npc);
+
+    // Removes by moving the last entry into the gap. After removing shapes,
+    // call buildSpatialIndex() (and rebake anything built from it) before
+    // the next query. Returns false for a stale handle.
+    bool removeShape(ShapeHandle handle);
+    bool removeNPC(NPCHandle handle);
+
+    // Null once the handle's entry is gone
+    NPC* getNPC(NPCHandle handle);
+    const NPC* getNPC(NPCHandle handle) const;
+    Shape* getShape(ShapeHandle handle) const;
+
+    // Adds count ambient NPCs at random spots in [min, max], walking in
+    // random directions at speed. They only live in npcStore.
+    void spawnCrowd(const Vec2& min, const Vec2& max, size_t count,
+                    float speed, float radius, uint32_t seed = 1);
+    // Simulates every body at full rate
     void update(float dt);
-    void save(const std::string& filename) const;
+
+    // Simulates bodies at npcLod rates around focus, so the cost follows
+    // the crowd near the player rather than the whole population
+    void update(float dt, const Vec2& focus);
+    // Writes .fmap or text by the file name; false (with a message on
+    // stderr) if the file could not be written
+    bool save(const std::string& filename) const;
     static Map load(const std::string& filename);
+
+    void buildSpatialIndex(float cellSize = SpatialGrid::DEFAULT_CELL_SIZE);
+    void bakeDistanceField(float cellSize = DistanceField::DEFAULT_CELL_SIZE,
+                           float maxDistance = DistanceField::DEFAULT_MAX_DISTANCE);
+    void buildNavMesh(float agentRadius = NavMesh::DEFAULT_AGENT_RADIUS,
+                      float cellSize = NavMesh::DEFAULT_CELL_SIZE);
+
+    // Does a circle at center overlap any static shape or wall?
+    bool circleHitsStatic(const Vec2& center, float radius) const;
+
+    // Is a circle at center clear of every wall and shape? Exact, unlike
+    // circleHitsStatic, which only looks straight up and down for shapes.
+    bool circleClearOfStatic(const Vec2& center, float radius) const;
+
+    // Distance from point to the nearest wall segment, or maxDistance if
+    // nothing is closer than that
+    float distanceToWalls(const Vec2& point, float maxDistance) const;
+
+    // Batched form of distanceToWalls: out[i] is the wall clearance of
+    // points[i], capped at maxDistance
+    void distancesToWalls(const Vec2* points, size_t count, float maxDistance, float* out) const;
+
+    // Closest hit along a ray (dir must be unit length) against NPCs, shapes
+    // and walls, using analytic intersections. Walls and shapes occlude
+    // whatever is behind them. Returns false if nothing is within maxDistance.
+    bool castRay(const Vec2& origin, const Vec2& dir, float maxDistance, RayHit& hit) const;
+
+    // Continuous collision: sweeps a circle from start by delta against
+    // walls, shapes and NPCs and reports the first contact (time of impact
+    // as a fraction of delta, plus contact normal). Never tunnels, however
+    // long the move.
+    bool sweepCircle(const Vec2& start, const Vec2& delta, float radius, SweepHit& hit) const;
+
+    // Moves a circle by delta, sliding along whatever it touches for up to
+    // maxIterations contacts, and returns where it ends up
+    Vec2 moveCircle(const Vec2& start, const Vec2& delta, float radius, int maxIterations = 4) const;
 };
 
 #endif // MAP_HH
\ No newline at end of file
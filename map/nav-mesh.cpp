@@ -0,0 +1,376 @@
+#include "nav-mesh.hh"
+#include "grid-fit.hh"
+#include "map.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+namespace {
+
+// Same idea as the distance field's cap: a stray far-away point makes the
+// cells bigger rather than the raster huge
+const double MAX_CELLS = 1 << 22;
+
+// Open ground kept around the geometry, so paths can go round the outside
+const float MARGIN = 4.0f;
+
+// How far (in cells) findPath looks for walkable ground near an endpoint
+const int SNAP_CELLS = 8;
+
+// Raster rows per parallel chunk
+const size_t ROW_GRAIN = 8;
+
+float cross(const Vec2& a, const Vec2& b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+float distance(const Vec2& a, const Vec2& b) {
+    return (a - b).length();
+}
+
+bool samePoint(const Vec2& a, const Vec2& b) {
+    return std::abs(a.x - b.x) < 1e-5f && std::abs(a.y - b.y) < 1e-5f;
+}
+
+Vec2 clampToSegment(const Vec2& p, const Vec2& a, const Vec2& b) {
+    return Vec2(std::clamp(p.x, std::min(a.x, b.x), std::max(a.x, b.x)),
+                std::clamp(p.y, std::min(a.y, b.y), std::max(a.y, b.y)));
+}
+
+// A* bookkeeping, reused by every query on the same thread. A node's entry
+// is stale unless its stamp matches the query's generation.
+struct SearchScratch {
+    std::vector<uint32_t> stamp;
+    std::vector<float> cost;
+    std::vector<Vec2> entry;       // Where the path enters the region
+    std::vector<uint32_t> via;     // Link taken to get there
+    std::vector<uint32_t> parent;  // Region that link leaves from
+    std::vector<uint32_t> chain;
+    uint32_t generation = 0;
+
+    void begin(size_t regionCount) {
+        if (stamp.size() != regionCount || ++generation == 0) {
+            stamp.assign(regionCount, 0);
+            cost.resize(regionCount);
+            entry.resize(regionCount);
+            via.resize(regionCount);
+            parent.resize(regionCount);
+            generation = 1;
+        }
+    }
+};
+
+} // namespace
+
+void NavMesh::clear() {
+    width = height = 0;
+    cellRegion.clear();
+    regions.clear();
+    links.clear();
+}
+
+void NavMesh::build(const Map& map, float radius, float size, ThreadPool& pool) {
+    clear();
+    agentRadius = radius;
+    cellSize = size;
+
+    // Bounds of everything static
+    Vec2 lo(INFINITY, INFINITY), hi(-INFINITY, -INFINITY);
+    auto grow = [&](const Vec2& min, const Vec2& max) {
+        lo = Vec2(std::min(lo.x, min.x), std::min(lo.y, min.y));
+        hi = Vec2(std::max(hi.x, max.x), std::max(hi.y, max.y));
+    };
+    for (size_t i = 0; i < map.segments.size(); ++i) {
+        grow(map.segments.a(i), map.segments.a(i));
+        grow(map.segments.b(i), map.segments.b(i));
+    }
+    for (const auto& shape : map.shapes) {
+        Vec2 min, max;
+        shape->getBounds(min, max);
+        grow(min, max);
+    }
+    if (lo.x > hi.x) return;
+
+    lo = lo - Vec2(MARGIN, MARGIN);
+    hi = hi + Vec2(MARGIN, MARGIN);
+    float fitted = fitCellSize(hi.x - lo.x, hi.y - lo.y, cellSize, MAX_CELLS);
+    if (fitted == 0.0f) {
+        std::cerr << "Map bounds are not finite or too far apart - no nav mesh" << std::endl;
+        return;
+    }
+    cellSize = fitted;
+
+    origin = lo;
+    width = std::max(1, (int)std::ceil((hi.x - lo.x) / cellSize));
+    height = std::max(1, (int)std::ceil((hi.y - lo.y) / cellSize));
+
+    // A cell is walkable when the agent fits anywhere inside it
+    std::vector<uint8_t> walkable((size_t)width * height);
+    float clearance = agentRadius + cellSize * 0.70711f;
+    pool.parallelFor(height, ROW_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            for (int x = 0; x < width; ++x) {
+                Vec2 center = origin + Vec2((x + 0.5f) * cellSize, (y + 0.5f) * cellSize);
+                walkable[y * width + x] = map.circleClearOfStatic(center, clearance);
+            }
+        }
+    });
+
+    // Greedy rectangles: run right as far as possible, then down while the
+    // whole run stays free
+    struct Span { int x0, y0, x1, y1; };
+    std::vector<Span> spans;
+    cellRegion.assign((size_t)width * height, -1);
+    auto isFree = [&](int x, int y) {
+        size_t i = (size_t)y * width + x;
+        return walkable[i] && cellRegion[i] < 0;
+    };
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            if (!isFree(x, y)) continue;
+            int x1 = x;
+            while (x1 + 1 < width && isFree(x1 + 1, y)) ++x1;
+            int y1 = y;
+            while (y1 + 1 < height) {
+                bool rowFree = true;
+                for (int cx = x; cx <= x1 && rowFree; ++cx) rowFree = isFree(cx, y1 + 1);
+                if (!rowFree) break;
+                ++y1;
+            }
+
+            int32_t id = (int32_t)spans.size();
+            spans.push_back({x, y, x1, y1});
+            for (int cy = y; cy <= y1; ++cy) {
+                std::fill(&cellRegion[(size_t)cy * width + x], &cellRegion[(size_t)cy * width + x1] + 1, id);
+            }
+        }
+    }
+
+    // Portals along the right and bottom side of every region; the left and
+    // top ones are some other region's right and bottom
+    struct Portal { uint32_t from, to; Vec2 a, b; };
+    std::vector<Portal> portals;
+    auto corner = [&](int x, int y) {
+        return origin + Vec2(x * cellSize, y * cellSize);
+    };
+    auto addPortal = [&](uint32_t from, int32_t to, const Vec2& a, const Vec2& b) {
+        if (to < 0) return;
+        portals.push_back({from, (uint32_t)to, a, b});
+        portals.push_back({(uint32_t)to, from, a, b});
+    };
+    for (uint32_t id = 0; id < spans.size(); ++id) {
+        const Span& s = spans[id];
+        if (s.x1 + 1 < width) {
+            int x = s.x1 + 1;
+            for (int y = s.y0; y <= s.y1;) {
+                int32_t other = cellRegion[(size_t)y * width + x];
+                int y1 = y;
+                while (y1 + 1 <= s.y1 && cellRegion[(size_t)(y1 + 1) * width + x] == other) ++y1;
+                addPortal(id, other, corner(x, y), corner(x, y1 + 1));
+                y = y1 + 1;
+            }
+        }
+        if (s.y1 + 1 < height) {
+            int y = s.y1 + 1;
+            for (int x = s.x0; x <= s.x1;) {
+                int32_t other = cellRegion[(size_t)y * width + x];
+                int x1 = x;
+                while (x1 + 1 <= s.x1 && cellRegion[(size_t)y * width + x1 + 1] == other) ++x1;
+                addPortal(id, other, corner(x, y), corner(x1 + 1, y));
+                x = x1 + 1;
+            }
+        }
+    }
+
+    // Pack the links CSR-style, by region
+    std::stable_sort(portals.begin(), portals.end(),
+                     [](const Portal& p, const Portal& q) { return p.from < q.from; });
+    regions.resize(spans.size());
+    links.reserve(portals.size());
+    for (uint32_t id = 0; id < spans.size(); ++id) {
+        regions[id].min = corner(spans[id].x0, spans[id].y0);
+        regions[id].max = corner(spans[id].x1 + 1, spans[id].y1 + 1);
+    }
+    for (const Portal& p : portals) {
+        Region& region = regions[p.from];
+        if (region.linkCount == 0) region.firstLink = (uint32_t)links.size();
+        region.linkCount++;
+        links.push_back({p.to, p.a, p.b});
+    }
+}
+
+int NavMesh::regionAt(const Vec2& p) const {
+    if (cellRegion.empty()) return -1;
+    int x = (int)std::floor((p.x - origin.x) / cellSize);
+    int y = (int)std::floor((p.y - origin.y) / cellSize);
+    if (x < 0 || y < 0 || x >= width || y >= height) return -1;
+    return cellRegion[(size_t)y * width + x];
+}
+
+int NavMesh::snap(const Vec2& p, Vec2& snapped) const {
+    int region = regionAt(p);
+    if (region >= 0) {
+        snapped = p;
+        return region;
+    }
+    if (cellRegion.empty()) return -1;
+
+    int cx = std::clamp((int)std::floor((p.x - origin.x) / cellSize), 0, width - 1);
+    int cy = std::clamp((int)std::floor((p.y - origin.y) / cellSize), 0, height - 1);
+    float bestSq = INFINITY;
+    for (int y = std::max(0, cy - SNAP_CELLS); y <= std::min(height - 1, cy + SNAP_CELLS); ++y) {
+        for (int x = std::max(0, cx - SNAP_CELLS); x <= std::min(width - 1, cx + SNAP_CELLS); ++x) {
+            int32_t id = cellRegion[(size_t)y * width + x];
+            if (id < 0) continue;
+
+            // Nearest point of the cell, nudged inside it
+            float inset = cellSize * 0.01f;
+            Vec2 min = origin + Vec2(x * cellSize + inset, y * cellSize + inset);
+            Vec2 max = min + Vec2(cellSize - 2 * inset, cellSize - 2 * inset);
+            Vec2 q(std::clamp(p.x, min.x, max.x), std::clamp(p.y, min.y, max.y));
+            Vec2 d = q - p;
+            float distSq = d.x * d.x + d.y * d.y;
+            if (distSq < bestSq) {
+                bestSq = distSq;
+                snapped = q;
+                region = id;
+            }
+        }
+    }
+    return region;
+}
+
+bool NavMesh::findPath(const Vec2& start, const Vec2& goal, std::vector<Vec2>& path) const {
+    path.clear();
+    Vec2 from, to;
+    int startRegion = snap(start, from);
+    int goalRegion = snap(goal, to);
+    if (startRegion < 0 || goalRegion < 0) return false;
+
+    // Regions are convex: same region, straight line
+    if (startRegion == goalRegion) {
+        path.push_back(from);
+        path.push_back(to);
+        return true;
+    }
+
+    // A* over regions. A region is entered at the point of its portal
+    // nearest to where the previous one was entered, which makes the
+    // distances close to what the smoothed path will be.
+    static thread_local SearchScratch scratch;
+    scratch.begin(regions.size());
+    uint32_t gen = scratch.generation;
+
+    using Open = std::pair<float, uint32_t>;
+    std::priority_queue<Open, std::vector<Open>, std::greater<Open>> open;
+    scratch.stamp[startRegion] = gen;
+    scratch.cost[startRegion] = 0.0f;
+    scratch.entry[startRegion] = from;
+    open.push({distance(from, to), (uint32_t)startRegion});
+
+    bool found = false;
+    while (!open.empty()) {
+        auto [estimate, node] = open.top();
+        open.pop();
+        if (node == (uint32_t)goalRegion) {
+            found = true;
+            break;
+        }
+        // Skip stale queue entries
+        const Vec2& here = scratch.entry[node];
+        if (estimate > scratch.cost[node] + distance(here, to) + 1e-4f) continue;
+
+        const Region& region = regions[node];
+        for (uint32_t l = region.firstLink; l < region.firstLink + region.linkCount; ++l) {
+            const Link& link = links[l];
+            Vec2 point = clampToSegment(here, link.a, link.b);
+            float cost = scratch.cost[node] + distance(here, point);
+            if (link.region == (uint32_t)goalRegion) cost += distance(point, to);
+
+            uint32_t next = link.region;
+            if (scratch.stamp[next] == gen && scratch.cost[next] <= cost) continue;
+            scratch.stamp[next] = gen;
+            scratch.cost[next] = cost;
+            scratch.entry[next] = next == (uint32_t)goalRegion ? to : point;
+            scratch.via[next] = l;
+            scratch.parent[next] = node;
+            open.push({cost + distance(scratch.entry[next], to), next});
+        }
+    }
+    if (!found) return false;
+
+    // Links from start to goal
+    std::vector<uint32_t>& chain = scratch.chain;
+    chain.clear();
+    for (uint32_t node = goalRegion; node != (uint32_t)startRegion;) {
+        uint32_t l = scratch.via[node];
+        chain.push_back(l);
+        node = scratch.parent[node];
+    }
+    std::reverse(chain.begin(), chain.end());
+
+    // Funnel: portals oriented left/right as seen crossing them, with the
+    // endpoints as zero-width portals at both ends
+    std::vector<Vec2> lefts, rights;
+    lefts.reserve(chain.size() + 2);
+    rights.reserve(chain.size() + 2);
+    lefts.push_back(from);
+    rights.push_back(from);
+    for (uint32_t l : chain) {
+        const Link& link = links[l];
+        const Region& far = regions[link.region];
+        Vec2 mid = (link.a + link.b) * 0.5f;
+        Vec2 heading = (far.min + far.max) * 0.5f - mid;
+        bool aLeft = cross(heading, link.a - mid) > 0.0f;
+        lefts.push_back(aLeft ? link.a : link.b);
+        rights.push_back(aLeft ? link.b : link.a);
+    }
+    lefts.push_back(to);
+    rights.push_back(to);
+
+    path.push_back(from);
+    Vec2 apex = from, left = lefts[0], right = rights[0];
+    size_t apexIndex = 0, leftIndex = 0, rightIndex = 0;
+    for (size_t i = 1; i < lefts.size(); ++i) {
+        const Vec2& l = lefts[i];
+        const Vec2& r = rights[i];
+
+        // Tighten the right side
+        if (cross(right - apex, r - apex) >= 0.0f) {
+            if (samePoint(apex, right) || cross(left - apex, r - apex) < 0.0f) {
+                right = r;
+                rightIndex = i;
+            } else {
+                // Right crossed over left: the left corner is on the path
+                apex = left;
+                apexIndex = leftIndex;
+                path.push_back(apex);
+                left = right = apex;
+                leftIndex = rightIndex = apexIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+
+        // Tighten the left side
+        if (cross(left - apex, l - apex) <= 0.0f) {
+            if (samePoint(apex, left) || cross(right - apex, l - apex) > 0.0f) {
+                left = l;
+                leftIndex = i;
+            } else {
+                apex = right;
+                apexIndex = rightIndex;
+                path.push_back(apex);
+                left = right = apex;
+                leftIndex = rightIndex = apexIndex;
+                i = apexIndex;
+                continue;
+            }
+        }
+    }
+    if (!samePoint(path.back(), to)) path.push_back(to);
+    return true;
+}
@@ -0,0 +1,70 @@
+#ifndef NAV_MESH_HH
+#define NAV_MESH_HH
+
+#include "../Vec2.hh"
+#include <cstdint>
+#include <vector>
+
+class Map;
+class ThreadPool;
+
+// Walkable space of a map for one agent radius, as a mesh of convex
+// regions. The map is rasterized and every cell a circle of the agent
+// radius can stand anywhere in is marked walkable (so the walls are
+// inflated by the radius), then walkable cells are merged greedily into
+// axis-aligned rectangles. Neighbouring rectangles are joined by portals,
+// the stretch of edge they share.
+//
+// findPath() runs A* over the regions and pulls the path tight through
+// the portals (the "simple stupid funnel"), so the result only turns at
+// region corners. The mesh is immutable once built; queries may run on
+// any number of threads at once.
+class NavMesh {
+public:
+    static constexpr float DEFAULT_CELL_SIZE = 0.25f;
+    static constexpr float DEFAULT_AGENT_RADIUS = 0.5f;
+
+    struct Region {
+        Vec2 min, max;
+        uint32_t firstLink = 0, linkCount = 0;
+    };
+
+    // One way through a portal; every portal has a link in each direction
+    struct Link {
+        uint32_t region;   // Region on the other side
+        Vec2 a, b;         // Ends of the shared edge
+    };
+
+    // Rasterizes the map's walls and shapes (rows in parallel on pool)
+    void build(const Map& map, float agentRadius, float cellSize, ThreadPool& pool);
+    void clear();
+
+    bool empty() const { return regions.empty(); }
+    float getCellSize() const { return cellSize; }
+    float getAgentRadius() const { return agentRadius; }
+    const std::vector<Region>& getRegions() const { return regions; }
+    const std::vector<Link>& getLinks() const { return links; }
+
+    // Region containing p, or -1 if p is not walkable
+    int regionAt(const Vec2& p) const;
+
+    // Smoothed path from start to goal, both included. A start or goal a
+    // little way off the walkable space (in a wall's inflated margin) is
+    // moved to the nearest walkable spot first. Returns false, leaving
+    // path empty, if there is no way through.
+    bool findPath(const Vec2& start, const Vec2& goal, std::vector<Vec2>& path) const;
+
+private:
+    Vec2 origin;
+    int width = 0, height = 0;
+    float cellSize = DEFAULT_CELL_SIZE;
+    float agentRadius = DEFAULT_AGENT_RADIUS;
+    std::vector<int32_t> cellRegion;   // Row-major, -1 where blocked
+    std::vector<Region> regions;
+    std::vector<Link> links;
+
+    // Region and walkable point near p, searching a few cells around it
+    int snap(const Vec2& p, Vec2& snapped) const;
+};
+
+#endif // NAV_MESH_HH
@@ -0,0 +1,195 @@
+#include "npc-collision.hh"
+#include "map.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bodies per parallel chunk; a body costs a few dozen distance tests here
+// against two multiply-adds in integration
+const size_t COLLISION_GRAIN = 2048;
+
+// Bounds the wall tests for a body catching up on a long step; a step
+// longer than this many half radii is cut short
+const int MAX_SUBSTEPS = 64;
+
+float dot(const Vec2& a, const Vec2& b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+} // namespace
+
+void NPCCollision::resolve(Map& map, const std::vector<uint32_t>& awake,
+                           const std::vector<uint32_t>& interacting,
+                           const std::vector<uint32_t>& ticking, const float* steps, ThreadPool& pool) {
+    NPCStore& store = map.npcStore;
+    size_t count = interacting.size();
+
+    // Where each ticking body started this step, before the pushes below
+    startX.resize(ticking.size()); startY.resize(ticking.size());
+    for (size_t k = 0; k < ticking.size(); ++k) {
+        uint32_t i = ticking[k];
+        startX[k] = store.posX[i] - store.velX[i] * steps[i];
+        startY[k] = store.posY[i] - store.velY[i] * steps[i];
+    }
+
+    float maxRadius = 0.0f;
+    for (uint32_t i : awake) maxRadius = std::max(maxRadius, store.radius[i]);
+
+    if (count > 0 && awake.size() > 1 && maxRadius > 0.0f) {
+        // Touching bodies are at most two radii apart, so one cell that wide
+        // means every neighbour is in the 3x3 cells around a body
+        hash.build(store, awake, 2.0f * maxRadius);
+
+        nextPosX.resize(count); nextPosY.resize(count);
+        nextVelX.resize(count); nextVelY.resize(count);
+        pool.parallelFor(count, COLLISION_GRAIN, [&](size_t begin, size_t end) {
+            separateBodies(map, interacting, maxRadius, begin, end);
+        });
+        for (size_t k = 0; k < count; ++k) {
+            uint32_t i = interacting[k];
+            store.posX[i] = nextPosX[k]; store.posY[i] = nextPosY[k];
+            store.velX[i] = nextVelX[k]; store.velY[i] = nextVelY[k];
+        }
+    }
+
+    // Walls go last so nothing gets pushed through one by a neighbour
+    pool.parallelFor(ticking.size(), COLLISION_GRAIN, [&](size_t begin, size_t end) {
+        resolveStatic(map, ticking, begin, end);
+    });
+}
+
+void NPCCollision::separateBodies(const Map& map, const std::vector<uint32_t>& bodies, float maxRadius,
+                                  size_t begin, size_t end) {
+    const NPCStore& store = map.npcStore;
+    float response = 0.5f * (1.0f + bodyRestitution);
+
+    for (size_t k = begin; k < end; ++k) {
+        uint32_t i = bodies[k];
+        Vec2 p = store.position(i);
+        Vec2 v = store.velocity(i);
+        float r = store.radius[i];
+        Vec2 push, dv;
+
+        hash.forEachNear(p, r + maxRadius, [&](uint32_t j) {
+            if (j == i) return;
+            Vec2 offset = p - store.position(j);
+            float reach = r + store.radius[j];
+            float distSq = dot(offset, offset);
+            if (distSq >= reach * reach) return;
+
+            float dist = std::sqrt(distSq);
+            Vec2 normal;
+            if (dist > 1e-6f) {
+                normal = offset * (1.0f / dist);
+            } else {
+                // Same spot: split along x, in opposite directions for the pair
+                normal = Vec2(i < j ? -1.0f : 1.0f, 0.0f);
+            }
+
+            // Each side of the pair moves half the overlap
+            push = push + normal * (0.5f * (reach - dist));
+
+            float approach = dot(v - store.velocity(j), normal);
+            if (approach < 0.0f) {
+                dv = dv - normal * (approach * response);
+            }
+        });
+
+        nextPosX[k] = p.x + push.x;
+        nextPosY[k] = p.y + push.y;
+        nextVelX[k] = v.x + dv.x;
+        nextVelY[k] = v.y + dv.y;
+    }
+}
+
+void NPCCollision::resolveStatic(Map& map, const std::vector<uint32_t>& bodies,
+                                 size_t begin, size_t end) const {
+    NPCStore& store = map.npcStore;
+    bool haveField = !map.distanceField.empty();
+
+    for (size_t k = begin; k < end; ++k) {
+        uint32_t i = bodies[k];
+        Vec2 p = store.position(i);
+        Vec2 v = store.velocity(i);
+        float r = store.radius[i];
+        Vec2 start(startX[k], startY[k]);
+        Vec2 move = p - start;
+        float travel = move.length();
+
+        // One lookup settles the common case of walking in the open
+        if (haveField && map.distanceField.lowerBound(p) >= r + (travel > r ? travel : 0.0f)) continue;
+
+        Vec2 preferred = store.preferredVelocity(i);
+        bool moved;
+        if (travel > r) {
+            // Too far in one go to trust the end point: walk it again from
+            // where the step began, half a radius at a time. It stops at the
+            // first wall it meets and leaves the rest of the step to the
+            // bounced velocity. Past MAX_SUBSTEPS the rest of the step is
+            // dropped rather than walked in strides long enough to skip a
+            // wall, so the body falls behind instead of tunnelling.
+            float stride = 0.5f * r;
+            float needed = std::ceil(travel / stride);
+            int substeps = needed < MAX_SUBSTEPS ? (int)needed : MAX_SUBSTEPS;
+            if (needed > MAX_SUBSTEPS) move = move * (MAX_SUBSTEPS * stride / travel);
+            Vec2 delta = move * (1.0f / substeps);
+            Vec2 q = start;
+            moved = true;
+            for (int s = 0; s < substeps; ++s) {
+                q = q + delta;
+                if (pushOut(map, q, v, preferred, r)) break;
+            }
+            p = q;
+        } else {
+            moved = pushOut(map, p, v, preferred, r);
+        }
+
+        if (moved) {
+            store.posX[i] = p.x; store.posY[i] = p.y;
+            store.velX[i] = v.x; store.velY[i] = v.y;
+            store.setPreferredVelocity(i, preferred);
+        }
+    }
+}
+
+bool NPCCollision::pushOut(const Map& map, Vec2& p, Vec2& v, Vec2& preferred, float r) const {
+    float response = 1.0f + wallRestitution;
+    bool moved = false;
+
+    // Push out of each contact in turn, so a body wedged into a corner
+    // ends up clear of both sides. The preferred velocity turns too, or
+    // a wanderer would keep walking into the wall.
+    auto respond = [&](const Contact& contact) {
+        if (!contact.hit) return;
+        p = p + contact.normal * contact.depth;
+        float into = dot(v, contact.normal);
+        if (into < 0.0f) {
+            v = v - contact.normal * (into * response);
+        }
+        float wanted = dot(preferred, contact.normal);
+        if (wanted < 0.0f) {
+            preferred = preferred - contact.normal * (wanted * response);
+        }
+        moved = true;
+    };
+
+    Vec2 lo(p.x - r, p.y - r);
+    Vec2 hi(p.x + r, p.y + r);
+    map.grid.forEachSegment(lo, hi, [&](uint32_t s) {
+        Contact contact;
+        contactCircleSegment(p, r, map.segments.a(s), map.segments.b(s), contact);
+        respond(contact);
+        return false;
+    });
+    map.grid.forEachShape(lo, hi, [&](uint32_t s) {
+        Contact contact;
+        map.staticShapes.visit(s, [&](const auto& shape) {
+            contactCircleShape(p, r, shape, contact);
+        });
+        respond(contact);
+        return false;
+    });
+    return moved;
+}
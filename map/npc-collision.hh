@@ -0,0 +1,57 @@
+#ifndef NPC_COLLISION_HH
+#define NPC_COLLISION_HH
+
+#include "../npc/npc-hash.hh"
+#include <vector>
+
+class Map;
+class ThreadPool;
+
+// Keeps the bodies in Map::npcStore out of each other and out of the
+// static geometry, once per step after integration.
+//
+// Bodies against bodies: a spatial hash rebuilt every step finds the
+// neighbours of each body, and every overlapping pair is pushed apart and
+// has the approaching part of its relative velocity reflected (an elastic
+// hit between equal masses). Each body only writes its own result, into
+// scratch arrays, so the pass runs in parallel chunks and is independent
+// of the order bodies are visited in.
+//
+// Bodies against walls and shapes: the static grid gives candidates and
+// the circle is pushed out along the contact normal, losing the inward
+// part of its velocity (bounce) or just its normal part (slide). A baked
+// distance field lets bodies in open space skip the grid entirely. A body
+// that moved further than its radius in one step (one simulated at a low
+// NPCLod rate) is walked there again in shorter steps, so it cannot pass
+// through a wall. A step too long for that to stay cheap (more than 32
+// radii) is cut short at that length, so the body lags rather than
+// tunnels.
+class NPCCollision {
+public:
+    // Share of the normal speed kept after hitting a wall: 1 bounces off,
+    // 0 slides along it
+    float wallRestitution = 1.0f;
+
+    // Same, between two bodies
+    float bodyRestitution = 1.0f;
+
+    // After integration. interacting bodies are kept out of every body in
+    // awake; every ticking body, having just moved by its velocity times
+    // steps[i], is kept out of the walls.
+    void resolve(Map& map, const std::vector<uint32_t>& awake,
+                 const std::vector<uint32_t>& interacting,
+                 const std::vector<uint32_t>& ticking, const float* steps, ThreadPool& pool);
+
+private:
+    NPCHash hash;
+    std::vector<float> nextPosX, nextPosY;   // Per interacting body
+    std::vector<float> nextVelX, nextVelY;
+    std::vector<float> startX, startY;       // Per ticking body
+
+    void separateBodies(const Map& map, const std::vector<uint32_t>& bodies, float maxRadius,
+                        size_t begin, size_t end);
+    void resolveStatic(Map& map, const std::vector<uint32_t>& bodies, size_t begin, size_t end) const;
+    bool pushOut(const Map& map, Vec2& p, Vec2& v, Vec2& preferred, float r) const;
+};
+
+#endif // NPC_COLLISION_HH
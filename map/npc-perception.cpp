@@ -0,0 +1,181 @@
+#include "npc-perception.hh"
+#include "map.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bodies that need no ray still cost a few loads each; bound how many one
+// step may look at so a crowd far from the player cannot stall it
+const size_t SCAN_PER_RAY = 8;
+
+} // namespace
+
+void NPCPerception::setTarget(uint32_t observer, uint32_t target) {
+    if (observer >= awareness.size()) awareness.resize(observer + 1);
+    Awareness& a = awareness[observer];
+    if (a.target == target) return;
+    a = Awareness();
+    a.target = target;
+    a.checkedTime = clock;
+}
+
+void NPCPerception::clear() {
+    awareness.clear();
+    cursor = 0;
+}
+
+void NPCPerception::remove(uint32_t i, uint32_t last) {
+    // Bodies added since the last update have no entry yet; give them
+    // fresh ones so the body the store moves brings its own
+    if (awareness.size() <= last) {
+        Awareness fresh;
+        fresh.checkedTime = clock;
+        awareness.resize(last + 1, fresh);
+    }
+    awareness[i] = awareness[last];
+    awareness.resize(last);
+
+    for (Awareness& a : awareness) {
+        if (a.target == i) {
+            Awareness fresh;
+            fresh.checkedTime = clock;
+            a = fresh;
+        } else if (a.target == last) {
+            a.target = i;
+        }
+    }
+    if (cursor >= awareness.size()) cursor = 0;
+}
+
+void NPCPerception::update(const Map& map, const Vec2& player, float dt) {
+    const NPCStore& store = map.npcStore;
+    size_t count = store.size();
+    clock += dt;
+    if (awareness.size() < count) {
+        Awareness fresh;
+        fresh.checkedTime = clock;
+        awareness.resize(count, fresh);
+    }
+    rays.clear();
+    if (count == 0) return;
+
+    float cosHalfView = std::cos(0.5f * fieldOfView);
+    float rangeSq = viewDistance * viewDistance;
+    size_t scanLimit = std::max<size_t>(raysPerStep * SCAN_PER_RAY, 1);
+
+    for (size_t scanned = 0; scanned < count && scanned < scanLimit && rays.size() < raysPerStep; ++scanned) {
+        uint32_t i = (uint32_t)cursor;
+        cursor = cursor + 1 < count ? cursor + 1 : 0;
+
+        const Awareness& a = awareness[i];
+        if (a.target != NPCStore::NONE && a.target >= count) {
+            record(i, false, Vec2());
+            continue;
+        }
+        Vec2 target = a.target == NPCStore::NONE ? player : store.position(a.target);
+        Vec2 eye = store.position(i);
+        Vec2 offset = target - eye;
+        float distSq = offset.x * offset.x + offset.y * offset.y;
+        if (distSq > rangeSq) {
+            record(i, false, target);
+            continue;
+        }
+
+        float dist = std::sqrt(distSq);
+        Vec2 dir = dist > 1e-6f ? offset * (1.0f / dist) : Vec2(1.0f, 0.0f);
+
+        // A body standing still looks all around
+        Vec2 v = store.velocity(i);
+        float speed = v.length();
+        if (speed > 1e-3f && (v.x * dir.x + v.y * dir.y) < cosHalfView * speed) {
+            record(i, false, target);
+            continue;
+        }
+        rays.push_back({ eye, dir, dist, i });
+    }
+
+    castBatch(map);
+    for (size_t r = 0; r < rays.size(); ++r) {
+        record(rays[r].body, !blocked[r], rays[r].origin + rays[r].dir * rays[r].length);
+    }
+}
+
+void NPCPerception::castBatch(const Map& map) {
+    blocked.assign(rays.size(), 0);
+    if (rays.empty() || map.grid.empty()) return;
+
+    // Which cells each ray has to look at, counted per cell
+    size_t cells = map.grid.cellCount();
+    cellStart.assign(cells + 1, 0);
+    rayCells.clear();
+    rayCellStart.assign(rays.size() + 1, 0);
+    for (size_t r = 0; r < rays.size(); ++r) {
+        const Ray& ray = rays[r];
+        map.grid.traverseRay(ray.origin, ray.dir, ray.length, [&](int cell, float) {
+            if (!map.grid.cellEmpty(cell)) {
+                rayCells.push_back((uint32_t)cell);
+                cellStart[cell + 1]++;
+            }
+            return false;
+        });
+        rayCellStart[r + 1] = (uint32_t)rayCells.size();
+    }
+
+    // Counting sort into CSR: the rays through cell c are
+    // cellRays[cellStart[c] .. cellStart[c + 1])
+    for (size_t c = 1; c <= cells; ++c) cellStart[c] += cellStart[c - 1];
+    cellRays.resize(rayCells.size());
+    for (size_t r = rays.size(); r-- > 0;) {
+        for (uint32_t k = rayCellStart[r + 1]; k-- > rayCellStart[r];) {
+            cellRays[--cellStart[rayCells[k] + 1]] = (uint32_t)r;
+        }
+    }
+    for (size_t c = 0; c < cells; ++c) cellStart[c] = cellStart[c + 1];
+    cellStart[cells] = (uint32_t)rayCells.size();
+
+    // One pass over the cells, each with all the rays through it
+    const SegmentBuffer& walls = map.cellSegments;
+    float t;
+    Vec2 normal;
+    for (size_t c = 0; c < cells; ++c) {
+        if (cellStart[c] == cellStart[c + 1]) continue;
+
+        uint32_t begin, end;
+        map.grid.segmentRange((int)c, begin, end);
+        for (uint32_t k = cellStart[c]; k < cellStart[c + 1]; ++k) {
+            uint32_t r = cellRays[k];
+            if (blocked[r]) continue;
+            const Ray& ray = rays[r];
+            if (walls.anyCrossing(ray.origin, ray.origin + ray.dir * ray.length, begin, end)) {
+                blocked[r] = 1;
+                continue;
+            }
+            map.grid.forEachShapeInCell((int)c, [&](uint32_t i) {
+                if (blocked[r]) return;
+                blocked[r] = map.staticShapes.visit(i, [&](const auto& shape) {
+                    return shape.intersectRay(ray.origin, ray.dir, ray.length, t, normal);
+                });
+            });
+        }
+    }
+}
+
+void NPCPerception::record(uint32_t body, bool sees, const Vec2& target) {
+    Awareness& a = awareness[body];
+    float elapsed = (float)(clock - a.checkedTime);
+    a.checkedTime = clock;
+
+    // Whatever was true at the last check held until now
+    if (a.sees) {
+        a.level = std::min(1.0f, a.level + noticeRate * elapsed);
+    } else {
+        a.level = std::max(0.0f, a.level - forgetRate * elapsed);
+    }
+
+    a.sees = sees;
+    if (sees) {
+        a.lastSeen = target;
+        a.lastSeenTime = clock;
+    }
+}
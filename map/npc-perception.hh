@@ -0,0 +1,82 @@
+#ifndef NPC_PERCEPTION_HH
+#define NPC_PERCEPTION_HH
+
+#include "../Vec2.hh"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Map;
+
+// What one body of Map::npcStore knows about its target: the player, or
+// another body set with NPCPerception::setTarget()
+struct Awareness {
+    uint32_t target = UINT32_MAX;   // Body watched, NPCStore::NONE for the player
+    bool sees = false;              // Target in sight at the last check
+    float level = 0.0f;             // 0 unaware .. 1 fully aware
+    Vec2 lastSeen;                  // Where the target was when last seen
+    double lastSeenTime = -1.0;     // Simulation time of that, -1 for never
+    double checkedTime = 0.0;       // Simulation time of the last check
+};
+
+// Line-of-sight perception for the bodies in Map::npcStore.
+//
+// Each step takes the next bodies in turn, up to raysPerStep lines of
+// sight, so the checks are spread over frames and every body is revisited
+// about every size / raysPerStep steps. A target out of viewDistance or
+// behind the body (outside fieldOfView around its heading) needs no ray.
+// The rest are answered as one batch: each ray lists the non-empty grid
+// cells it crosses, a counting sort turns that into the rays through each
+// cell, and then every cell's walls (a contiguous run of
+// Map::cellSegments) and shapes are read once for all those rays.
+//
+// Between checks, awareness rises at noticeRate per second while the
+// target was in sight and falls at forgetRate while it was not.
+class NPCPerception {
+public:
+    float viewDistance = 20.0f;
+    float fieldOfView = 2.0944f;    // Radians, centered on the heading; 120 degrees
+    size_t raysPerStep = 1024;
+    float noticeRate = 2.0f;
+    float forgetRate = 0.25f;
+
+    // Checks the next bodies in turn; player is the player's position
+    void update(const Map& map, const Vec2& player, float dt);
+
+    // Makes observer watch another body; NPCStore::NONE goes back to the player
+    void setTarget(uint32_t observer, uint32_t target);
+
+    const Awareness& getAwareness(uint32_t body) const { return awareness[body]; }
+    size_t size() const { return awareness.size(); }
+    void clear();
+
+    // Follows NPCStore::remove(i), where last is the store's last body
+    // before it (the one moved into i); bodies that watched i go back to
+    // the player
+    void remove(uint32_t i, uint32_t last);
+
+    // Rays cast by the last update(), for profiling
+    size_t getLastRays() const { return rays.size(); }
+
+private:
+    struct Ray {
+        Vec2 origin, dir;
+        float length;
+        uint32_t body;
+    };
+
+    std::vector<Awareness> awareness;
+    size_t cursor = 0;
+    double clock = 0.0;
+
+    // Scratch for the batch
+    std::vector<Ray> rays;
+    std::vector<uint8_t> blocked;
+    std::vector<uint32_t> rayCells, rayCellStart;   // Cells per ray, CSR
+    std::vector<uint32_t> cellRays, cellStart;      // Rays per cell, CSR
+
+    void castBatch(const Map& map);
+    void record(uint32_t body, bool sees, const Vec2& target);
+};
+
+#endif // NPC_PERCEPTION_HH
@@ -0,0 +1,66 @@
+#include "path-service.hh"
+#include "../engine/thread-pool.hh"
+#include <cmath>
+
+PathService::PathService(ThreadPool& threads, float cacheCellSize)
+    : pool(threads), invCacheCellSize(1.0f / cacheCellSize) {}
+
+PathService::~PathService() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this] { return inFlight == 0; });
+}
+
+uint64_t PathService::key(const Vec2& start, const Vec2& goal) const {
+    // 16 bits per cell coordinate; wrapping only costs a cache miss
+    auto cell = [&](float v) {
+        return (uint64_t)(uint16_t)(int32_t)std::floor(v * invCacheCellSize);
+    };
+    return cell(start.x) | cell(start.y) << 16 | cell(goal.x) << 32 | cell(goal.y) << 48;
+}
+
+std::shared_ptr<const PathResult> PathService::request(const std::shared_ptr<const NavMesh>& mesh,
+                                                       const Vec2& start, const Vec2& goal) {
+    auto result = std::make_shared<PathResult>();
+    if (!mesh) {
+        result->done.store(true, std::memory_order_release);
+        return result;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests++;
+        if (mesh != cachedMesh || cache.size() >= MAX_CACHED) {
+            cache.clear();
+            cachedMesh = mesh;
+        }
+        auto [it, inserted] = cache.emplace(key(start, goal), result);
+        if (!inserted) return it->second;
+        searches++;
+        inFlight++;
+    }
+
+    // The task holds the mesh, so a rebuild meanwhile cannot free it
+    pool.submit([this, mesh, result, start, goal] {
+        result->found = mesh->findPath(start, goal, result->points);
+        result->done.store(true, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--inFlight == 0) idle.notify_all();
+    });
+    return result;
+}
+
+void PathService::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    cache.clear();
+}
+
+size_t PathService::getRequests() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return requests;
+}
+
+size_t PathService::getSearches() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return searches;
+}
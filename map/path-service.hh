@@ -0,0 +1,71 @@
+#ifndef PATH_SERVICE_HH
+#define PATH_SERVICE_HH
+
+#include "nav-mesh.hh"
+#include "../Vec2.hh"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// A path handed out by PathService. Poll ready(); once it is true the
+// other fields never change again.
+struct PathResult {
+    std::atomic<bool> done{false};
+    bool found = false;
+    std::vector<Vec2> points;   // Start to goal, empty if not found
+
+    bool ready() const { return done.load(std::memory_order_acquire); }
+};
+
+// Asynchronous, cached NavMesh::findPath. Requests are served on worker
+// threads of the pool, so a frame never waits for A*, and answers are
+// cached by (start cell, goal cell): everyone walking from around here to
+// around there shares one search, and a request already in flight is
+// joined rather than repeated. A cached path starts and ends where its
+// first requester asked, which is within a cache cell of any later one.
+//
+// The cache is dropped whenever requests start naming a different mesh.
+class PathService {
+public:
+    static constexpr float DEFAULT_CACHE_CELL_SIZE = 1.0f;
+    static constexpr size_t MAX_CACHED = 4096;
+
+    explicit PathService(ThreadPool& pool, float cacheCellSize = DEFAULT_CACHE_CELL_SIZE);
+
+    // Waits for the searches still in flight
+    ~PathService();
+
+    PathService(const PathService&) = delete;
+    PathService& operator=(const PathService&) = delete;
+
+    std::shared_ptr<const PathResult> request(const std::shared_ptr<const NavMesh>& mesh,
+                                              const Vec2& start, const Vec2& goal);
+
+    // Forgets every cached path (in-flight ones still complete)
+    void clear();
+
+    // Requests made, and how many of them needed a search of their own
+    size_t getRequests() const;
+    size_t getSearches() const;
+
+private:
+    ThreadPool& pool;
+    float invCacheCellSize;
+
+    mutable std::mutex mutex;
+    std::condition_variable idle;
+    std::shared_ptr<const NavMesh> cachedMesh;
+    std::unordered_map<uint64_t, std::shared_ptr<PathResult>> cache;
+    size_t inFlight = 0;
+    size_t requests = 0, searches = 0;
+
+    uint64_t key(const Vec2& start, const Vec2& goal) const;
+};
+
+#endif // PATH_SERVICE_HH
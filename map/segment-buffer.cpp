@@ -0,0 +1,177 @@
+#include "segment-buffer.hh"
+#include <algorithm>
+
+#if !defined(FLATLAND_NO_SIMD) && defined(__AVX2__)
+#define SEGMENT_KERNEL_AVX2
+#include <immintrin.h>
+#elif !defined(FLATLAND_NO_SIMD) && defined(__SSE2__)
+#define SEGMENT_KERNEL_SSE2
+#include <emmintrin.h>
+#elif !defined(FLATLAND_NO_SIMD) && defined(__ARM_NEON)
+#define SEGMENT_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+void SegmentBuffer::clear() {
+    x1.clear(); y1.clear(); x2.clear(); y2.clear();
+    invLengthSq.clear();
+    line.clear();
+}
+
+void SegmentBuffer::reserve(size_t count) {
+    x1.reserve(count); y1.reserve(count); x2.reserve(count); y2.reserve(count);
+    invLengthSq.reserve(count);
+    line.reserve(count);
+}
+
+void SegmentBuffer::push(const Vec2& a, const Vec2& b, uint32_t lineIndex) {
+    x1.push_back(a.x); y1.push_back(a.y);
+    x2.push_back(b.x); y2.push_back(b.y);
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float lenSq = dx * dx + dy * dy;
+    invLengthSq.push_back(lenSq < 1e-6f ? 0.0f : 1.0f / lenSq);
+    line.push_back(lineIndex);
+}
+
+float SegmentBuffer::distanceSq(const Vec2& point, size_t i) const {
+    float dx = x2[i] - x1[i], dy = y2[i] - y1[i];
+    float px = point.x - x1[i], py = point.y - y1[i];
+    float t = std::max(0.0f, std::min(1.0f, (px * dx + py * dy) * invLengthSq[i]));
+    float ex = px - t * dx, ey = py - t * dy;
+    return ex * ex + ey * ey;
+}
+
+#if defined(SEGMENT_KERNEL_AVX2)
+
+const char* SegmentBuffer::kernelName() { return "avx2"; }
+
+float SegmentBuffer::minDistanceSq(const Vec2& point, size_t begin, size_t end, float limitSq) const {
+    const __m256 px = _mm256_set1_ps(point.x), py = _mm256_set1_ps(point.y);
+    const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+    __m256 best = _mm256_set1_ps(limitSq);
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 ax = _mm256_loadu_ps(&x1[i]), ay = _mm256_loadu_ps(&y1[i]);
+        __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&x2[i]), ax);
+        __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&y2[i]), ay);
+        __m256 qx = _mm256_sub_ps(px, ax), qy = _mm256_sub_ps(py, ay);
+        __m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(qx, dx), _mm256_mul_ps(qy, dy)),
+                                 _mm256_loadu_ps(&invLengthSq[i]));
+        t = _mm256_min_ps(one, _mm256_max_ps(zero, t));
+        __m256 ex = _mm256_sub_ps(qx, _mm256_mul_ps(t, dx));
+        __m256 ey = _mm256_sub_ps(qy, _mm256_mul_ps(t, dy));
+        best = _mm256_min_ps(best, _mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)));
+    }
+
+    __m128 half = _mm_min_ps(_mm256_castps256_ps128(best), _mm256_extractf128_ps(best, 1));
+    half = _mm_min_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_min_ss(half, _mm_shuffle_ps(half, half, 1));
+    float result = _mm_cvtss_f32(half);
+
+    for (; i < end; ++i) {
+        result = std::min(result, distanceSq(point, i));
+    }
+    return result;
+}
+
+#elif defined(SEGMENT_KERNEL_SSE2) || defined(SEGMENT_KERNEL_NEON)
+
+#if defined(SEGMENT_KERNEL_SSE2)
+typedef __m128 Lanes;
+static inline Lanes splat(float v) { return _mm_set1_ps(v); }
+static inline Lanes load(const float* p) { return _mm_loadu_ps(p); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes vmin(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes vmax(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+static inline float reduceMin(Lanes v) {
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+const char* SegmentBuffer::kernelName() { return "sse2"; }
+#else
+typedef float32x4_t Lanes;
+static inline Lanes splat(float v) { return vdupq_n_f32(v); }
+static inline Lanes load(const float* p) { return vld1q_f32(p); }
+static inline Lanes add(Lanes a, Lanes b) { return vaddq_f32(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return vsubq_f32(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return vmulq_f32(a, b); }
+static inline Lanes vmin(Lanes a, Lanes b) { return vminq_f32(a, b); }
+static inline Lanes vmax(Lanes a, Lanes b) { return vmaxq_f32(a, b); }
+static inline float reduceMin(Lanes v) {
+    float32x2_t m = vmin_f32(vget_low_f32(v), vget_high_f32(v));
+    return std::min(vget_lane_f32(m, 0), vget_lane_f32(m, 1));
+}
+const char* SegmentBuffer::kernelName() { return "neon"; }
+#endif
+
+float SegmentBuffer::minDistanceSq(const Vec2& point, size_t begin, size_t end, float limitSq) const {
+    const Lanes px = splat(point.x), py = splat(point.y);
+    const Lanes zero = splat(0.0f), one = splat(1.0f);
+
+    // Two independent 4-lane accumulators: 8 segments per iteration
+    Lanes best[2] = {splat(limitSq), splat(limitSq)};
+
+    auto step = [&](size_t at, Lanes& acc) {
+        Lanes ax = load(&x1[at]), ay = load(&y1[at]);
+        Lanes dx = sub(load(&x2[at]), ax), dy = sub(load(&y2[at]), ay);
+        Lanes qx = sub(px, ax), qy = sub(py, ay);
+        Lanes t = mul(add(mul(qx, dx), mul(qy, dy)), load(&invLengthSq[at]));
+        t = vmin(one, vmax(zero, t));
+        Lanes ex = sub(qx, mul(t, dx)), ey = sub(qy, mul(t, dy));
+        acc = vmin(acc, add(mul(ex, ex), mul(ey, ey)));
+    };
+
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        step(i, best[0]);
+        step(i + 4, best[1]);
+    }
+    if (i + 4 <= end) {
+        step(i, best[0]);
+        i += 4;
+    }
+
+    float result = reduceMin(vmin(best[0], best[1]));
+    for (; i < end; ++i) {
+        result = std::min(result, distanceSq(point, i));
+    }
+    return result;
+}
+
+#else
+
+const char* SegmentBuffer::kernelName() { return "scalar"; }
+
+float SegmentBuffer::minDistanceSq(const Vec2& point, size_t begin, size_t end, float limitSq) const {
+    float result = limitSq;
+    for (size_t i = begin; i < end; ++i) {
+        result = std::min(result, distanceSq(point, i));
+    }
+    return result;
+}
+
+#endif
+
+bool SegmentBuffer::anyCrossing(const Vec2& p, const Vec2& q, size_t begin, size_t end) const {
+    // No early exit: without branches the compiler runs this several
+    // segments per instruction, which beats stopping at the first hit for
+    // the short runs of a grid cell
+    float dx = q.x - p.x, dy = q.y - p.y;
+    int hits = 0;
+    for (size_t i = begin; i < end; ++i) {
+        float ex = x2[i] - x1[i], ey = y2[i] - y1[i];
+        // Sides of p-q the segment ends are on, and sides of the segment p and q are on
+        float sa = dx * (y1[i] - p.y) - dy * (x1[i] - p.x);
+        float sb = dx * (y2[i] - p.y) - dy * (x2[i] - p.x);
+        float sp = ex * (p.y - y1[i]) - ey * (p.x - x1[i]);
+        float sq = ex * (q.y - y1[i]) - ey * (q.x - x1[i]);
+        // Touching counts, so a line through a polyline joint is blocked;
+        // collinear segments (both sides zero) do not
+        hits |= (sa * sb <= 0.0f) & (sp * sq <= 0.0f) & ((sa != 0.0f) | (sb != 0.0f));
+    }
+    return hits != 0;
+}
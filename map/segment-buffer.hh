@@ -0,0 +1,44 @@
+#ifndef SEGMENT_BUFFER_HH
+#define SEGMENT_BUFFER_HH
+
+#include "../Vec2.hh"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Wall segments flattened into a structure of arrays, so distance queries
+// can stream through x1/y1/x2/y2 several segments per instruction.
+//
+// The distance kernel is picked at compile time: AVX2 (8 lanes) when built
+// with -mavx2, otherwise SSE2 or NEON (4 lanes, twice per step), otherwise
+// scalar. Define FLATLAND_NO_SIMD to force the scalar loop.
+class SegmentBuffer {
+public:
+    std::vector<float> x1, y1, x2, y2;
+    std::vector<float> invLengthSq;  // 0 for degenerate (point) segments
+    std::vector<uint32_t> line;      // Owning polyline in Map::lines
+
+    void clear();
+    void reserve(size_t count);
+    void push(const Vec2& a, const Vec2& b, uint32_t lineIndex);
+
+    size_t size() const { return x1.size(); }
+    bool empty() const { return x1.empty(); }
+    Vec2 a(size_t i) const { return Vec2(x1[i], y1[i]); }
+    Vec2 b(size_t i) const { return Vec2(x2[i], y2[i]); }
+
+    // Smallest squared distance from point to segments [begin, end), or
+    // limitSq if none is closer
+    float minDistanceSq(const Vec2& point, size_t begin, size_t end, float limitSq) const;
+
+    // Same, for a single segment
+    float distanceSq(const Vec2& point, size_t i) const;
+
+    // Does the segment p-q touch any of segments [begin, end)?
+    bool anyCrossing(const Vec2& p, const Vec2& q, size_t begin, size_t end) const;
+
+    // Name of the kernel compiled in ("avx2", "sse2", "neon", "scalar")
+    static const char* kernelName();
+};
+
+#endif // SEGMENT_BUFFER_HH
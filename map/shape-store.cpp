@@ -0,0 +1,38 @@
+#include "shape-store.hh"
+#include <iostream>
+
+void ShapeStore::clear() {
+    rects.clear();
+    tris.clear();
+    circles.clear();
+    refs.clear();
+}
+
+void ShapeStore::build(const std::vector<std::shared_ptr<Shape>>& shapes) {
+    clear();
+    refs.reserve(shapes.size());
+
+    for (const auto& shape : shapes) {
+        switch (shape->getKind()) {
+            case ShapeKind::RECTANGLE:
+                refs.push_back({ShapeKind::RECTANGLE, (uint32_t)rects.size()});
+                rects.push_back(static_cast<const Rectangle&>(*shape));
+                break;
+            case ShapeKind::TRIANGLE:
+                refs.push_back({ShapeKind::TRIANGLE, (uint32_t)tris.size()});
+                tris.push_back(static_cast<const Triangle&>(*shape));
+                break;
+            case ShapeKind::CIRCLE:
+                refs.push_back({ShapeKind::CIRCLE, (uint32_t)circles.size()});
+                circles.push_back(static_cast<const Circle&>(*shape));
+                break;
+            case ShapeKind::LINE:
+                // Polylines belong in Map::lines; keep indices aligned with
+                // Map::shapes by parking an empty rectangle in their slot
+                std::cerr << "ShapeStore: LINE in the shape list, ignored" << std::endl;
+                refs.push_back({ShapeKind::RECTANGLE, (uint32_t)rects.size()});
+                rects.emplace_back(shape->position, 0.0f, 0.0f);
+                break;
+        }
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef SHAPE_STORE_HH
+#define SHAPE_STORE_HH
+
+#include "../npc/Shape.hh"
+#include "../npc/Shapes/Rectangle.hh"
+#include "../npc/Shapes/Triangle.hh"
+#include "../npc/Shapes/Circle.hh"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Where a shape lives inside a ShapeStore
+struct ShapeRef {
+    ShapeKind kind;
+    uint32_t index;   // Into the array for that kind
+};
+
+// Static shapes split by concrete type into contiguous arrays, held by
+// value. The shape classes are final, so calls made through these arrays
+// are direct calls: no vtable lookup, no shared_ptr refcount, no RTTI.
+//
+// Map::shapes stays the editable, polymorphic source of truth; the store
+// is rebuilt from it by Map::buildSpatialIndex().
+class ShapeStore {
+public:
+    std::vector<Rectangle> rects;
+    std::vector<Triangle> tris;
+    std::vector<Circle> circles;
+    std::vector<ShapeRef> refs;   // refs[i] describes Map::shapes[i]
+
+    void build(const std::vector<std::shared_ptr<Shape>>& shapes);
+    void clear();
+
+    size_t size() const { return refs.size(); }
+
+    // Calls fn with the concrete shape behind Map::shapes[i], e.g.
+    //   store.visit(i, [&](const auto& shape) { return shape.intersectRay(...); });
+    // fn is instantiated once per type, so the calls inside it are static.
+    template <typename Fn>
+    decltype(auto) visit(uint32_t i, Fn&& fn) const {
+        const ShapeRef& ref = refs[i];
+        switch (ref.kind) {
+            case ShapeKind::TRIANGLE: return fn(tris[ref.index]);
+            case ShapeKind::CIRCLE: return fn(circles[ref.index]);
+            default: return fn(rects[ref.index]);
+        }
+    }
+};
+
+#endif // SHAPE_STORE_HH
@@ -0,0 +1,127 @@
+#include "spatial-grid.hh"
+#include "grid-fit.hh"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+
+// Keeps a pathological map (one far-away stray point) from allocating a
+// huge, mostly empty grid; the cells grow instead (see fitCellSize)
+const double MAX_CELLS = 1 << 22;
+
+// Builds CSR buckets from an emitter that reports (cell, item) pairs.
+// emit is run twice: once to count items per cell, once to fill them in.
+template <typename Emit>
+void buildBuckets(int cellCount, size_t itemCount, Emit emit,
+                  std::vector<uint32_t>& start, std::vector<uint32_t>& items) {
+    start.assign(cellCount + 1, 0);
+    for (size_t i = 0; i < itemCount; ++i) {
+        emit(i, [&](int cell) { start[cell + 1]++; });
+    }
+    for (int c = 0; c < cellCount; ++c) {
+        start[c + 1] += start[c];
+    }
+
+    items.resize(start[cellCount]);
+    std::vector<uint32_t> cursor(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < itemCount; ++i) {
+        emit(i, [&](int cell) { items[cursor[cell]++] = (uint32_t)i; });
+    }
+}
+
+} // namespace
+
+int SpatialGrid::cellX(float x) const {
+    int c = (int)std::floor((x - origin.x) * invCellSize);
+    return std::max(0, std::min(cols - 1, c));
+}
+
+int SpatialGrid::cellY(float y) const {
+    int c = (int)std::floor((y - origin.y) * invCellSize);
+    return std::max(0, std::min(rows - 1, c));
+}
+
+void SpatialGrid::clear() {
+    cols = rows = 0;
+    segmentStart.clear();
+    segmentItems.clear();
+    shapeStart.clear();
+    shapeItems.clear();
+}
+
+void SpatialGrid::build(const SegmentBuffer& segments,
+                        const std::vector<std::shared_ptr<Shape>>& shapes,
+                        float size) {
+    clear();
+    if (segments.empty() && shapes.empty()) return;
+
+    // World bounds of everything static
+    Vec2 lo(1e30f, 1e30f), hi(-1e30f, -1e30f);
+    auto grow = [&](const Vec2& p) {
+        lo.x = std::min(lo.x, p.x); lo.y = std::min(lo.y, p.y);
+        hi.x = std::max(hi.x, p.x); hi.y = std::max(hi.y, p.y);
+    };
+    for (size_t i = 0; i < segments.size(); ++i) {
+        grow(segments.a(i));
+        grow(segments.b(i));
+    }
+    std::vector<Vec2> shapeMin(shapes.size()), shapeMax(shapes.size());
+    for (size_t i = 0; i < shapes.size(); ++i) {
+        shapes[i]->getBounds(shapeMin[i], shapeMax[i]);
+        grow(shapeMin[i]);
+        grow(shapeMax[i]);
+    }
+
+    float spanX = hi.x - lo.x, spanY = hi.y - lo.y;
+    cellSize = fitCellSize(spanX, spanY, size > 0 ? size : DEFAULT_CELL_SIZE, MAX_CELLS);
+    if (cellSize == 0.0f) {
+        std::cerr << "Map bounds are not finite or too far apart - no spatial index" << std::endl;
+        return;
+    }
+    invCellSize = 1.0f / cellSize;
+    origin = lo;
+    cols = (int)std::floor(spanX * invCellSize) + 1;
+    rows = (int)std::floor(spanY * invCellSize) + 1;
+    int totalCells = cols * rows;
+
+    // A segment goes into the cells it actually crosses: for every row its
+    // y-range covers, clip it to that row's band and take the x-span there
+    auto emitSegment = [&](size_t i, auto&& add) {
+        Vec2 a = segments.a(i);
+        Vec2 b = segments.b(i);
+        int r0 = cellY(std::min(a.y, b.y));
+        int r1 = cellY(std::max(a.y, b.y));
+        float dy = b.y - a.y;
+
+        for (int r = r0; r <= r1; ++r) {
+            float xa = a.x, xb = b.x;
+            if (r0 != r1 && std::abs(dy) > 1e-9f) {
+                float bandLo = origin.y + r * cellSize;
+                float bandHi = bandLo + cellSize;
+                float t0 = std::max(0.0f, std::min(1.0f, (bandLo - a.y) / dy));
+                float t1 = std::max(0.0f, std::min(1.0f, (bandHi - a.y) / dy));
+                xa = a.x + (b.x - a.x) * t0;
+                xb = a.x + (b.x - a.x) * t1;
+            }
+            int c0 = cellX(std::min(xa, xb));
+            int c1 = cellX(std::max(xa, xb));
+            for (int c = c0; c <= c1; ++c) {
+                add(r * cols + c);
+            }
+        }
+    };
+
+    auto emitShape = [&](size_t i, auto&& add) {
+        int c0 = cellX(shapeMin[i].x), c1 = cellX(shapeMax[i].x);
+        int r0 = cellY(shapeMin[i].y), r1 = cellY(shapeMax[i].y);
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c) {
+                add(r * cols + c);
+            }
+        }
+    };
+
+    buildBuckets(totalCells, segments.size(), emitSegment, segmentStart, segmentItems);
+    buildBuckets(totalCells, shapes.size(), emitShape, shapeStart, shapeItems);
+}
@@ -0,0 +1,178 @@
+#ifndef SPATIAL_GRID_HH
+#define SPATIAL_GRID_HH
+
+#include "../Vec2.hh"
+#include "../npc/Shape.hh"
+#include "segment-buffer.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Uniform grid over the static map geometry (wall segments and shapes).
+// Built once after the map is loaded; every cell keeps the indices of the
+// segments and shapes that touch it, packed CSR-style (one offsets array
+// plus one flat item array) so a query is just a few contiguous reads.
+//
+// Items that span several cells are listed in each of them, so a region
+// query can report the same index more than once. All current callers
+// take a min or an "any hit", where that does not matter.
+class SpatialGrid {
+public:
+    static constexpr float DEFAULT_CELL_SIZE = 4.0f;
+
+    void build(const SegmentBuffer& segments,
+               const std::vector<std::shared_ptr<Shape>>& shapes,
+               float cellSize = DEFAULT_CELL_SIZE);
+    void clear();
+
+    bool empty() const { return cols == 0 || rows == 0; }
+    size_t cellCount() const { return (size_t)cols * rows; }
+    float getCellSize() const { return cellSize; }
+
+    // Calls fn(index) for every segment / shape bucketed in a cell that
+    // overlaps the box [min, max]. Returning true from fn stops the query
+    // early and makes the function return true.
+    template <typename Fn>
+    bool forEachSegment(const Vec2& min, const Vec2& max, Fn&& fn) const {
+        return visit(segmentStart, segmentItems, min, max, fn);
+    }
+
+    template <typename Fn>
+    bool forEachShape(const Vec2& min, const Vec2& max, Fn&& fn) const {
+        return visit(shapeStart, shapeItems, min, max, fn);
+    }
+
+    // Calls fn(begin, end) with ranges into getSegmentItems() covering every
+    // cell that overlaps the box. Cells are stored row-major, so each grid
+    // row of the box is one contiguous run.
+    template <typename Fn>
+    void forEachSegmentRun(const Vec2& min, const Vec2& max, Fn&& fn) const {
+        if (!overlaps(min, max)) return;
+        int x0 = cellX(min.x), x1 = cellX(max.x);
+        for (int cy = cellY(min.y), y1 = cellY(max.y); cy <= y1; ++cy) {
+            uint32_t begin = segmentStart[cy * cols + x0];
+            uint32_t end = segmentStart[cy * cols + x1 + 1];
+            if (begin < end) fn(begin, end);
+        }
+    }
+
+    // Segment indices in cell order; item k belongs to the run above
+    const std::vector<uint32_t>& getSegmentItems() const { return segmentItems; }
+
+    // A cell's range in getSegmentItems(), and so in Map::cellSegments
+    void segmentRange(int cell, uint32_t& begin, uint32_t& end) const {
+        begin = segmentStart[cell];
+        end = segmentStart[cell + 1];
+    }
+
+    bool cellEmpty(int cell) const {
+        return segmentStart[cell] == segmentStart[cell + 1] && shapeStart[cell] == shapeStart[cell + 1];
+    }
+
+    // Per-cell access, for use from traverseRay callbacks
+    template <typename Fn>
+    void forEachSegmentInCell(int cell, Fn&& fn) const {
+        for (uint32_t i = segmentStart[cell]; i < segmentStart[cell + 1]; ++i) fn(segmentItems[i]);
+    }
+
+    template <typename Fn>
+    void forEachShapeInCell(int cell, Fn&& fn) const {
+        for (uint32_t i = shapeStart[cell]; i < shapeStart[cell + 1]; ++i) fn(shapeItems[i]);
+    }
+
+    // Walks the cells pierced by a ray in front-to-back order (Amanatides &
+    // Woo grid DDA). dir must be unit length. fn(cell, tExit) gets the
+    // distance at which the ray leaves the cell; returning true stops the
+    // walk, which callers do once their best hit is closer than tExit.
+    template <typename Fn>
+    void traverseRay(const Vec2& from, const Vec2& dir, float maxDist, Fn&& fn) const {
+        if (empty()) return;
+
+        // Clip the ray to the grid box
+        float tEnter = 0.0f, tLeave = maxDist;
+        const float o[2] = {from.x, from.y};
+        const float d[2] = {dir.x, dir.y};
+        const float lo[2] = {origin.x, origin.y};
+        const float hi[2] = {origin.x + cols * cellSize, origin.y + rows * cellSize};
+        for (int axis = 0; axis < 2; ++axis) {
+            if (d[axis] == 0.0f) {
+                if (o[axis] < lo[axis] || o[axis] > hi[axis]) return;
+                continue;
+            }
+            float t0 = (lo[axis] - o[axis]) / d[axis];
+            float t1 = (hi[axis] - o[axis]) / d[axis];
+            if (t0 > t1) std::swap(t0, t1);
+            tEnter = std::max(tEnter, t0);
+            tLeave = std::min(tLeave, t1);
+        }
+        if (tEnter > tLeave) return;
+
+        Vec2 start = from + dir * tEnter;
+        int cx = cellX(start.x), cy = cellY(start.y);
+        int stepX = dir.x > 0 ? 1 : -1;
+        int stepY = dir.y > 0 ? 1 : -1;
+        const float inf = 1e30f;
+        float tMaxX = dir.x != 0.0f
+            ? (origin.x + (cx + (stepX > 0)) * cellSize - from.x) / dir.x : inf;
+        float tMaxY = dir.y != 0.0f
+            ? (origin.y + (cy + (stepY > 0)) * cellSize - from.y) / dir.y : inf;
+        float tDeltaX = dir.x != 0.0f ? cellSize / std::abs(dir.x) : inf;
+        float tDeltaY = dir.y != 0.0f ? cellSize / std::abs(dir.y) : inf;
+
+        while (true) {
+            float tExit = std::min(std::min(tMaxX, tMaxY), tLeave);
+            if (fn(cy * cols + cx, tExit) || tExit >= tLeave) return;
+            if (tMaxX < tMaxY) {
+                cx += stepX;
+                tMaxX += tDeltaX;
+            } else {
+                cy += stepY;
+                tMaxY += tDeltaY;
+            }
+            if (cx < 0 || cx >= cols || cy < 0 || cy >= rows) return;
+        }
+    }
+
+private:
+    Vec2 origin;
+    float cellSize = DEFAULT_CELL_SIZE;
+    float invCellSize = 1.0f / DEFAULT_CELL_SIZE;
+    int cols = 0;
+    int rows = 0;
+
+    // CSR buckets: items of cell c are items[start[c] .. start[c + 1])
+    std::vector<uint32_t> segmentStart, segmentItems;
+    std::vector<uint32_t> shapeStart, shapeItems;
+
+    int cellX(float x) const;
+    int cellY(float y) const;
+
+    bool overlaps(const Vec2& min, const Vec2& max) const {
+        if (empty()) return false;
+        if (max.x < origin.x || max.y < origin.y) return false;
+        return min.x <= origin.x + cols * cellSize && min.y <= origin.y + rows * cellSize;
+    }
+
+    template <typename Fn>
+    bool visit(const std::vector<uint32_t>& start, const std::vector<uint32_t>& items,
+               const Vec2& min, const Vec2& max, Fn& fn) const {
+        if (!overlaps(min, max)) return false;
+
+        int x0 = cellX(min.x), x1 = cellX(max.x);
+        int y0 = cellY(min.y), y1 = cellY(max.y);
+
+        for (int cy = y0; cy <= y1; ++cy) {
+            for (int cx = x0; cx <= x1; ++cx) {
+                int cell = cy * cols + cx;
+                for (uint32_t i = start[cell]; i < start[cell + 1]; ++i) {
+                    if (fn(items[i])) return true;
+                }
+            }
+        }
+        return false;
+    }
+};
+
+#endif // SPATIAL_GRID_HH
@@ -0,0 +1,312 @@
+#include "visibility-polygon.hh"
+#include "map.hh"
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+namespace {
+
+// Edges of the circle approximation used for circular shapes
+const int CIRCLE_SIDES = 16;
+
+// Everything is done relative to the eye with coordinates snapped to this
+// grid (exact in float), so shared endpoints compare exactly equal
+const float SNAP = 1.0f / 4096.0f;
+
+// Tolerance on cross products (twice a triangle's area) before three points
+// count as collinear; keeps the edge ordering consistent under rounding
+const float EPSILON = 1e-3f;
+
+float cross(const Vec2& a, const Vec2& b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+float snap(float v) {
+    float s = std::round(v / SNAP) * SNAP;
+    return s == 0.0f ? 0.0f : s;   // No -0, so atan2 puts the seam at +pi
+}
+
+int orientation(const Vec2& a, const Vec2& b, const Vec2& c) {
+    float d = cross(b - a, c - a);
+    if (std::abs(d) < EPSILON) return 0;
+    return d > 0 ? 1 : -1;
+}
+
+bool samePoint(const Vec2& a, const Vec2& b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+// Orders edges by distance from the eye (at the origin) along any ray
+// that crosses both. Only meaningful for edges that do not cross each
+// other, which is why crossings are split beforehand.
+template <typename Edge>
+struct CloserToEye {
+    bool operator()(const Edge* x, const Edge* y) const {
+        if (x == y) return false;
+        const Vec2 eye(0, 0);
+        Vec2 a = x->a, b = x->b, c = y->a, d = y->b;
+
+        // Put a shared endpoint, if any, in a and c
+        if (samePoint(b, c) || samePoint(b, d)) std::swap(a, b);
+        if (samePoint(a, d)) std::swap(c, d);
+        if (samePoint(a, c)) {
+            if (samePoint(b, d) || orientation(eye, a, d) != orientation(eye, a, b)) return false;
+            return orientation(a, b, d) != orientation(a, b, eye);
+        }
+
+        int cda = orientation(c, d, a), cdb = orientation(c, d, b);
+        if (cda == 0 && cdb == 0) {
+            return a.x * a.x + a.y * a.y < c.x * c.x + c.y * c.y;
+        }
+        if (cda == cdb || cda == 0 || cdb == 0) {
+            // x lies entirely on one side of y's line: closer if that is
+            // the eye's side
+            int cdo = orientation(c, d, eye);
+            return cdo == cda || cdo == cdb;
+        }
+        // Otherwise y lies on one side of x's line
+        return orientation(a, b, eye) != orientation(a, b, c);
+    }
+};
+
+// Where the ray from the eye (origin) through point meets the line a-b
+Vec2 alongRay(const Vec2& point, const Vec2& a, const Vec2& b) {
+    Vec2 edge = b - a;
+    float denom = cross(point, edge);
+    if (std::abs(denom) < EPSILON) return point;
+    return point * (cross(a, edge) / denom);
+}
+
+} // namespace
+
+bool VisibilityPolygon::update(const Map& map, const Vec2& eyePos, float range) {
+    Vec2 moved = eyePos - eye;
+    if (valid && range == radius && map.revision == mapRevision &&
+        moved.x * moved.x + moved.y * moved.y <= RECOMPUTE_DISTANCE * RECOMPUTE_DISTANCE) {
+        return false;
+    }
+    compute(map, eyePos, range);
+    return true;
+}
+
+void VisibilityPolygon::compute(const Map& map, const Vec2& eyePos, float range) {
+    eye = eyePos;
+    radius = range;
+    mapRevision = map.revision;
+    valid = true;
+
+    gatherEdges(map);
+    splitCrossings();
+    sweep();
+}
+
+void VisibilityPolygon::gatherEdges(const Map& map) {
+    edges.clear();
+    auto add = [&](const Vec2& a, const Vec2& b) {
+        edges.push_back({a - eye, b - eye});
+    };
+
+    Vec2 lo(eye.x - radius, eye.y - radius);
+    Vec2 hi(eye.x + radius, eye.y + radius);
+
+    // The grid reports items once per cell they touch
+    std::vector<uint32_t> found;
+    map.grid.forEachSegment(lo, hi, [&](uint32_t i) { found.push_back(i); return false; });
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    for (uint32_t i : found) {
+        add(map.segments.a(i), map.segments.b(i));
+    }
+
+    found.clear();
+    map.grid.forEachShape(lo, hi, [&](uint32_t i) { found.push_back(i); return false; });
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+    for (uint32_t i : found) {
+        const ShapeRef& ref = map.staticShapes.refs[i];
+        switch (ref.kind) {
+            case ShapeKind::RECTANGLE: {
+                const Rectangle& rect = map.staticShapes.rects[ref.index];
+                Vec2 p0 = rect.position;
+                Vec2 p1(p0.x + rect.width, p0.y);
+                Vec2 p2(p0.x + rect.width, p0.y + rect.height);
+                Vec2 p3(p0.x, p0.y + rect.height);
+                add(p0, p1); add(p1, p2); add(p2, p3); add(p3, p0);
+                break;
+            }
+            case ShapeKind::TRIANGLE: {
+                const Triangle& tri = map.staticShapes.tris[ref.index];
+                add(tri.p1, tri.p2); add(tri.p2, tri.p3); add(tri.p3, tri.p1);
+                break;
+            }
+            case ShapeKind::CIRCLE: {
+                const Circle& circle = map.staticShapes.circles[ref.index];
+                for (int k = 0; k < CIRCLE_SIDES; ++k) {
+                    float a0 = 2 * M_PI * k / CIRCLE_SIDES, a1 = 2 * M_PI * (k + 1) / CIRCLE_SIDES;
+                    add(circle.position + Vec2(std::cos(a0), std::sin(a0)) * circle.radius,
+                        circle.position + Vec2(std::cos(a1), std::sin(a1)) * circle.radius);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    // Boundary square, so every direction ends somewhere
+    Vec2 c0(lo.x, lo.y), c1(hi.x, lo.y), c2(hi.x, hi.y), c3(lo.x, hi.y);
+    add(c0, c1); add(c1, c2); add(c2, c3); add(c3, c0);
+}
+
+void VisibilityPolygon::splitCrossings() {
+    // Sort-and-sweep along x: only edges whose x-ranges overlap can cross
+    size_t count = edges.size();
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; ++i) order[i] = (uint32_t)i;
+    auto minX = [&](uint32_t i) { return std::min(edges[i].a.x, edges[i].b.x); };
+    auto maxX = [&](uint32_t i) { return std::max(edges[i].a.x, edges[i].b.x); };
+    std::sort(order.begin(), order.end(), [&](uint32_t i, uint32_t j) { return minX(i) < minX(j); });
+
+    std::vector<std::pair<uint32_t, float>> cuts;   // (edge, t along it)
+    std::vector<uint32_t> active;
+    for (uint32_t i : order) {
+        float left = minX(i);
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](uint32_t j) { return maxX(j) < left; }),
+                     active.end());
+
+        const Edge& e = edges[i];
+        for (uint32_t j : active) {
+            const Edge& f = edges[j];
+            if (std::max(e.a.y, e.b.y) < std::min(f.a.y, f.b.y) ||
+                std::max(f.a.y, f.b.y) < std::min(e.a.y, e.b.y)) continue;
+
+            // Proper crossings only; touching at an endpoint is fine
+            int o1 = orientation(e.a, e.b, f.a), o2 = orientation(e.a, e.b, f.b);
+            int o3 = orientation(f.a, f.b, e.a), o4 = orientation(f.a, f.b, e.b);
+            if (o1 * o2 >= 0 || o3 * o4 >= 0) continue;
+
+            Vec2 de = e.b - e.a, df = f.b - f.a;
+            float denom = cross(de, df);
+            float te = cross(f.a - e.a, df) / denom;
+            float tf = cross(f.a - e.a, de) / denom;
+            cuts.push_back({i, te});
+            cuts.push_back({j, tf});
+        }
+        active.push_back(i);
+    }
+
+    // Rebuild the edge list with crossing edges cut into pieces, every
+    // endpoint snapped, and pieces seen edge-on from the eye dropped
+    std::sort(cuts.begin(), cuts.end());
+    std::vector<Edge> pieces;
+    pieces.reserve(count + cuts.size());
+    auto emit = [&](Vec2 a, Vec2 b) {
+        a = Vec2(snap(a.x), snap(a.y));
+        b = Vec2(snap(b.x), snap(b.y));
+        float turn = cross(a, b);
+        if (std::abs(turn) < EPSILON) return;
+        // Orient counter-clockwise around the eye, the sweep direction
+        if (turn > 0) pieces.push_back({a, b});
+        else pieces.push_back({b, a});
+    };
+    size_t c = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Vec2 from = edges[i].a;
+        Vec2 dir = edges[i].b - edges[i].a;
+        for (; c < cuts.size() && cuts[c].first == i; ++c) {
+            Vec2 at = edges[i].a + dir * cuts[c].second;
+            emit(from, at);
+            from = at;
+        }
+        emit(from, edges[i].b);
+    }
+    edges.swap(pieces);
+}
+
+void VisibilityPolygon::sweep() {
+    vertices.clear();
+    angles.clear();
+
+    struct Event {
+        float angle;
+        float distSq;
+        bool start;
+        uint32_t edge;
+    };
+    std::vector<Event> events;
+    events.reserve(edges.size() * 2);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const Edge& e = edges[i];
+        events.push_back({std::atan2(e.a.y, e.a.x), e.a.x * e.a.x + e.a.y * e.a.y, true, (uint32_t)i});
+        events.push_back({std::atan2(e.b.y, e.b.x), e.b.x * e.b.x + e.b.y * e.b.y, false, (uint32_t)i});
+    }
+    // By angle, nearer first along the same ray; at a shared endpoint the
+    // edge that ends goes before the one that starts
+    std::sort(events.begin(), events.end(), [](const Event& x, const Event& y) {
+        if (x.angle != y.angle) return x.angle < y.angle;
+        if (x.distSq != y.distSq) return x.distSq < y.distSq;
+        return !x.start && y.start;
+    });
+
+    using State = std::multiset<const Edge*, CloserToEye<Edge>>;
+    State state;
+    std::vector<State::iterator> where(edges.size(), state.end());
+
+    // Edges straddling the seam at angle +-pi are already under the ray
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const Edge& e = edges[i];
+        if (std::atan2(e.a.y, e.a.x) > std::atan2(e.b.y, e.b.x)) {
+            where[i] = state.insert(&e);
+        }
+    }
+
+    auto push = [&](const Vec2& local, float angle) {
+        vertices.push_back(local + eye);
+        angles.push_back(angle);
+    };
+
+    const Edge* nearest = state.empty() ? nullptr : *state.begin();
+    for (const Event& event : events) {
+        const Edge& e = edges[event.edge];
+        if (event.start) {
+            where[event.edge] = state.insert(&e);
+        } else if (where[event.edge] != state.end()) {
+            state.erase(where[event.edge]);
+            where[event.edge] = state.end();
+        }
+        if (state.empty()) continue;
+
+        const Edge* now = *state.begin();
+        if (now == nearest) continue;
+
+        // The nearest edge changed: the boundary jumps along this ray
+        // between the old one and the new one
+        if (event.start) {
+            Vec2 point = e.a;
+            if (nearest) push(alongRay(point, nearest->a, nearest->b), event.angle);
+            push(point, event.angle);
+        } else {
+            Vec2 point = e.b;
+            push(point, event.angle);
+            push(alongRay(point, now->a, now->b), event.angle);
+        }
+        nearest = now;
+    }
+}
+
+bool VisibilityPolygon::contains(const Vec2& p) const {
+    if (vertices.size() < 3) return false;
+    Vec2 local = p - eye;
+    if (std::abs(local.x) > radius || std::abs(local.y) > radius) return false;
+
+    // Wedge between the last vertex at or before p's angle and the next one
+    float angle = std::atan2(local.y, local.x);
+    size_t next = std::upper_bound(angles.begin(), angles.end(), angle) - angles.begin();
+    size_t i = next == 0 ? vertices.size() - 1 : next - 1;
+    size_t j = next == vertices.size() ? 0 : next;
+
+    const Vec2& a = vertices[i];
+    const Vec2& b = vertices[j];
+    return cross(b - a, p - a) >= -EPSILON;
+}
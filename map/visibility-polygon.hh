@@ -0,0 +1,62 @@
+#ifndef VISIBILITY_POLYGON_HH
+#define VISIBILITY_POLYGON_HH
+
+#include "../Vec2.hh"
+#include <cstdint>
+#include <vector>
+
+class Map;
+
+// Region of the map visible from an eye point: the walls and static shapes
+// within a square of half-size radius around it occlude, NPCs do not.
+// Built by an angular sweep over the segment endpoints with the segments
+// the sweep ray currently crosses kept ordered by distance, O(n log n).
+//
+// The polygon is star-shaped around the eye, so contains() is a binary
+// search over the vertex angles plus one edge test.
+class VisibilityPolygon {
+public:
+    static constexpr float DEFAULT_RADIUS = 60.0f;
+
+    // How far the eye may drift from where the polygon was computed before
+    // update() computes it again
+    static constexpr float RECOMPUTE_DISTANCE = 0.25f;
+
+    // Recomputes if the eye moved past RECOMPUTE_DISTANCE, the radius or
+    // the map's revision changed, or invalidate() was called; returns
+    // whether it did
+    bool update(const Map& map, const Vec2& eye, float radius = DEFAULT_RADIUS);
+    void compute(const Map& map, const Vec2& eye, float radius = DEFAULT_RADIUS);
+
+    // Forces the next update() to recompute
+    void invalidate() { valid = false; }
+
+    bool empty() const { return vertices.empty(); }
+    const Vec2& getEye() const { return eye; }
+
+    // Boundary in counter-clockwise order around the eye
+    const std::vector<Vec2>& getVertices() const { return vertices; }
+
+    // Is p visible from the eye the polygon was computed for?
+    bool contains(const Vec2& p) const;
+
+private:
+    struct Edge {
+        Vec2 a, b;
+    };
+
+    Vec2 eye;
+    float radius = 0.0f;
+    uint64_t mapRevision = 0;
+    bool valid = false;
+    std::vector<Vec2> vertices;
+    std::vector<float> angles;   // atan2 of each vertex around the eye
+
+    std::vector<Edge> edges;     // Scratch, reused between computes
+
+    void gatherEdges(const Map& map);
+    void splitCrossings();
+    void sweep();
+};
+
+#endif // VISIBILITY_POLYGON_HH
@@ -0,0 +1,288 @@
+#include "world-stream.hh"
+#include "fmap.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+const char* INDEX_FILE = "world.index";
+
+std::string chunkFile(int cx, int cy) {
+    return "chunk_" + std::to_string(cx) + "_" + std::to_string(cy) + ".fmap";
+}
+
+void growBounds(const Shape& shape, Vec2& min, Vec2& max) {
+    Vec2 lo, hi;
+    shape.getBounds(lo, hi);
+    min = Vec2(std::min(min.x, lo.x), std::min(min.y, lo.y));
+    max = Vec2(std::max(max.x, hi.x), std::max(max.y, hi.y));
+}
+
+} // namespace
+
+bool writeWorld(const Map& map, const std::string& dir, float chunkSize) {
+    struct Bucket {
+        int cx, cy;
+        Vec2 min = Vec2(INFINITY, INFINITY);
+        Vec2 max = Vec2(-INFINITY, -INFINITY);
+        Map part;
+    };
+    std::vector<Bucket> buckets;
+    std::unordered_map<uint64_t, size_t> lookup;
+
+    auto bucketFor = [&](const Shape& shape) -> Bucket& {
+        Vec2 lo, hi;
+        shape.getBounds(lo, hi);
+        int cx = (int)std::floor((lo.x + hi.x) * 0.5f / chunkSize);
+        int cy = (int)std::floor((lo.y + hi.y) * 0.5f / chunkSize);
+        uint64_t key = ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+        auto found = lookup.find(key);
+        if (found == lookup.end()) {
+            found = lookup.emplace(key, buckets.size()).first;
+            buckets.emplace_back();
+            buckets.back().cx = cx;
+            buckets.back().cy = cy;
+            buckets.back().part.name = map.name;
+        }
+        Bucket& bucket = buckets[found->second];
+        growBounds(shape, bucket.min, bucket.max);
+        return bucket;
+    };
+
+    for (const auto& shape : map.shapes) bucketFor(*shape).part.addShape(shape);
+    for (const auto& line : map.lines) bucketFor(*line).part.lines.push_back(line);
+    for (const auto& npc : map.npcs) bucketFor(*npc.shape).part.addNPC(npc);
+
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    std::ofstream index(dir + "/" + INDEX_FILE);
+    if (!index) {
+        std::cerr << "Failed to write world index in " << dir << std::endl;
+        return false;
+    }
+    index << "WORLD:" << map.name << "\n";
+    index << "CHUNK_SIZE," << chunkSize << "\n";
+    for (const Bucket& bucket : buckets) {
+        if (!writeFmap(bucket.part, dir + "/" + chunkFile(bucket.cx, bucket.cy))) return false;
+        index << "CHUNK," << bucket.cx << "," << bucket.cy << ","
+              << bucket.min.x << "," << bucket.min.y << "," << bucket.max.x << "," << bucket.max.y << "\n";
+    }
+    return (bool)index;
+}
+
+uint64_t WorldStream::chunkKey(int cx, int cy) {
+    return ((uint64_t)(uint32_t)cx << 32) | (uint32_t)cy;
+}
+
+bool WorldStream::open(const std::string& worldDir) {
+    std::ifstream file(worldDir + "/" + INDEX_FILE);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open world index in " << worldDir << std::endl;
+        return false;
+    }
+    dir = worldDir;
+    chunks.clear();
+    lookup.clear();
+    active.clear();
+    overhang = 0.0f;
+
+    std::string line;
+    if (!std::getline(file, line) || line.substr(0, 6) != "WORLD:") {
+        std::cerr << "Invalid world index - expected 'WORLD:' on first line" << std::endl;
+        return false;
+    }
+    name = line.substr(6);
+
+    while (std::getline(file, line)) {
+        std::istringstream iss(line);
+        std::string type;
+        std::getline(iss, type, ',');
+        char comma;
+
+        if (type == "CHUNK_SIZE") {
+            iss >> chunkSize;
+        } else if (type == "CHUNK") {
+            Chunk chunk;
+            iss >> chunk.cx >> comma >> chunk.cy >> comma
+                >> chunk.min.x >> comma >> chunk.min.y >> comma >> chunk.max.x >> comma >> chunk.max.y;
+            if (!iss) continue;
+            lookup[chunkKey(chunk.cx, chunk.cy)] = chunks.size();
+            chunks.push_back(std::move(chunk));
+        }
+    }
+    if (!(chunkSize > 0.0f)) {
+        std::cerr << "Invalid world index - no chunk size" << std::endl;
+        return false;
+    }
+
+    // How far to look past the chunk squares for bounds that reach in
+    for (const Chunk& chunk : chunks) {
+        float x0 = chunk.cx * chunkSize, y0 = chunk.cy * chunkSize;
+        overhang = std::max({ overhang, x0 - chunk.min.x, y0 - chunk.min.y,
+                              chunk.max.x - (x0 + chunkSize), chunk.max.y - (y0 + chunkSize) });
+    }
+    return true;
+}
+
+WorldStream::Chunk& WorldStream::chunkUnder(const Vec2& p, Chunk& fallback) {
+    int cx = (int)std::floor(p.x / chunkSize), cy = (int)std::floor(p.y / chunkSize);
+    auto found = lookup.find(chunkKey(cx, cy));
+    return found == lookup.end() ? fallback : chunks[found->second];
+}
+
+float WorldStream::distanceTo(const Chunk& chunk, const Vec2& p) const {
+    float dx = std::max({ chunk.min.x - p.x, 0.0f, p.x - chunk.max.x });
+    float dy = std::max({ chunk.min.y - p.y, 0.0f, p.y - chunk.max.y });
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+void WorldStream::startLoad(size_t index, ThreadPool& pool) {
+    Chunk& chunk = chunks[index];
+    auto load = std::make_shared<Load>();
+    load->path = dir + "/" + chunkFile(chunk.cx, chunk.cy);
+    chunk.load = load;
+    chunk.state = Chunk::LOADING;
+    active.push_back(index);
+
+    // The task keeps the load alive even if the chunk gives up on it
+    pool.submit([load] {
+        load->ok = readFmap(load->path, load->contents);
+        load->done.store(true, std::memory_order_release);
+    });
+}
+
+void WorldStream::addToMap(Chunk& chunk, Map& map) {
+    MapText& contents = chunk.load->contents;
+    for (auto& shape : contents.shapes) chunk.shapes.push_back(map.addShape(std::move(shape)));
+    for (auto& line : contents.lines) {
+        map.lines.push_back(line);
+        chunk.lines.push_back(std::move(line));
+    }
+
+    // NPCs come from the file the first time only; after that the ones
+    // standing in it are all in parked, as are any that walked in from a
+    // chunk that unloaded before this one was first loaded
+    if (!chunk.visited) {
+        for (const NPC& npc : contents.npcs) chunk.npcs.push_back(map.addNPC(npc));
+    }
+    for (const NPC& npc : chunk.parked) chunk.npcs.push_back(map.addNPC(npc));
+    chunk.parked.clear();
+    chunk.visited = true;
+
+    chunk.load.reset();
+    chunk.state = Chunk::RESIDENT;
+}
+
+void WorldStream::removeFromMap(Chunk& chunk, Map& map) {
+    for (ShapeHandle handle : chunk.shapes) map.removeShape(handle);
+    chunk.shapes.clear();
+
+    std::unordered_set<const Line*> gone;
+    for (const auto& line : chunk.lines) gone.insert(line.get());
+    map.lines.erase(std::remove_if(map.lines.begin(), map.lines.end(),
+                                   [&](const std::shared_ptr<Line>& line) { return gone.count(line.get()) > 0; }),
+                    map.lines.end());
+    chunk.lines.clear();
+
+    // NPCs belong to the chunk they are standing in now, not the one they
+    // spawned in: one still resident takes them over as they are, others
+    // park them. Those that wandered off every chunk stay with this one.
+    for (NPCHandle handle : chunk.npcs) {
+        const NPC* npc = map.getNPC(handle);
+        if (!npc) continue;
+        Vec2 at = map.npcStore.position(npc->body);
+        Chunk& home = chunkUnder(at, chunk);
+        if (&home != &chunk && home.state == Chunk::RESIDENT) {
+            home.npcs.push_back(handle);
+            continue;
+        }
+        // Park it where the body is, even if no update has synced the shape
+        home.parked.push_back(*npc);
+        home.parked.back().shape->position = at;
+        home.parked.back().velocity = map.npcStore.velocity(npc->body);
+        map.removeNPC(handle);
+    }
+    chunk.npcs.clear();
+    chunk.state = Chunk::UNLOADED;
+}
+
+bool WorldStream::update(Map& map, const Vec2& focus, ThreadPool& pool) {
+    bool changed = false;
+
+    // Drop what went out of range, and pick up finished loads
+    for (size_t k = 0; k < active.size();) {
+        Chunk& chunk = chunks[active[k]];
+        bool far = distanceTo(chunk, focus) > unloadDistance;
+        if (chunk.state == Chunk::LOADING) {
+            if (far) {
+                chunk.load.reset();
+                chunk.state = Chunk::UNLOADED;
+            } else if (chunk.load->done.load(std::memory_order_acquire)) {
+                if (chunk.load->ok) {
+                    addToMap(chunk, map);
+                    changed = true;
+                } else {
+                    chunk.load.reset();
+                    chunk.state = Chunk::UNLOADED;
+                }
+            }
+        } else if (far) {
+            removeFromMap(chunk, map);
+            changed = true;
+        }
+
+        if (chunk.state == Chunk::UNLOADED) {
+            active[k] = active.back();
+            active.pop_back();
+        } else {
+            ++k;
+        }
+    }
+
+    // Start loads for chunks coming into range. Only the squares whose
+    // chunks could reach that far are looked up, however big the world.
+    float reach = loadDistance + overhang;
+    int x0 = (int)std::floor((focus.x - reach) / chunkSize), x1 = (int)std::floor((focus.x + reach) / chunkSize);
+    int y0 = (int)std::floor((focus.y - reach) / chunkSize), y1 = (int)std::floor((focus.y + reach) / chunkSize);
+    for (int cy = y0; cy <= y1; ++cy) {
+        for (int cx = x0; cx <= x1; ++cx) {
+            auto found = lookup.find(chunkKey(cx, cy));
+            if (found == lookup.end()) continue;
+            const Chunk& chunk = chunks[found->second];
+            if (chunk.state == Chunk::UNLOADED && distanceTo(chunk, focus) <= loadDistance) {
+                startLoad(found->second, pool);
+            }
+        }
+    }
+
+    if (changed) {
+        map.buildSpatialIndex();
+        map.distanceField.clear();
+    }
+    return changed;
+}
+
+void WorldStream::loadAround(Map& map, const Vec2& focus, ThreadPool& pool) {
+    update(map, focus, pool);
+    while (loadingCount() > 0) {
+        std::this_thread::yield();
+        update(map, focus, pool);
+    }
+}
+
+size_t WorldStream::residentCount() const {
+    size_t count = 0;
+    for (size_t i : active) count += chunks[i].state == Chunk::RESIDENT;
+    return count;
+}
+
+size_t WorldStream::loadingCount() const {
+    return active.size() - residentCount();
+}
@@ -0,0 +1,106 @@
+#ifndef WORLD_STREAM_HH
+#define WORLD_STREAM_HH
+
+#include "map.hh"
+#include "map-parser.hh"
+#include "../Vec2.hh"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class ThreadPool;
+
+// Cuts map into square chunks of chunkSize and writes them to dir: one
+// .fmap file per chunk that has anything in it, plus world.index, which
+// lists each chunk with the bounds of what it holds. Every shape, wall
+// and NPC goes to the chunk under the center of its bounds, so a long wall
+// belongs to one chunk and that chunk's bounds grow to cover it.
+bool writeWorld(const Map& map, const std::string& dir, float chunkSize);
+
+// A world written by writeWorld(), paged in and out of a Map around a
+// point (the player). Only resident chunks are in the map, so collision,
+// rendering and NPC updates never see the rest, and only the index and
+// the NPCs of unloaded chunks stay in memory.
+//
+// Files are read and turned into shapes on the thread pool. update() then
+// adds the finished chunks to the map and drops the far ones, on the
+// calling thread, and rebuilds the spatial index once if anything
+// changed. A chunk starts loading once its bounds come within
+// loadDistance of the focus and goes at unloadDistance; the gap keeps a
+// player on the edge from loading the same chunk over and over.
+//
+// Unloaded chunks keep their NPCs as they left them, and hand the same
+// ones back when they return. An NPC goes with the chunk it is standing in
+// when its chunk unloads, so one that walked across a border comes back
+// with the chunk it walked into. The distance field is dropped whenever
+// chunks change, since it would no longer match the walls.
+class WorldStream {
+public:
+    float loadDistance = 48.0f;
+    float unloadDistance = 64.0f;
+
+    // Reads dir/world.index; false with a message on stderr if it cannot
+    bool open(const std::string& dir);
+
+    // Starts loads for chunks that came in range, drops those out of range
+    // and adds the ones whose load finished. Returns true if map changed.
+    bool update(Map& map, const Vec2& focus, ThreadPool& pool);
+
+    // Same, but waits until every chunk in range is resident (for the
+    // first frame, or after a teleport)
+    void loadAround(Map& map, const Vec2& focus, ThreadPool& pool);
+
+    const std::string& getName() const { return name; }
+    float getChunkSize() const { return chunkSize; }
+    size_t chunkCount() const { return chunks.size(); }
+    size_t residentCount() const;
+    size_t loadingCount() const;
+
+private:
+    // A chunk file read on the pool
+    struct Load {
+        std::string path;
+        MapText contents;
+        bool ok = false;
+        std::atomic<bool> done{false};
+    };
+
+    struct Chunk {
+        enum State { UNLOADED, LOADING, RESIDENT };
+
+        int cx = 0, cy = 0;
+        Vec2 min, max;                  // Bounds of what it holds
+        State state = UNLOADED;
+        std::shared_ptr<Load> load;     // While LOADING
+
+        // What it put in the map while RESIDENT
+        std::vector<ShapeHandle> shapes;
+        std::vector<std::shared_ptr<Line>> lines;
+        std::vector<NPCHandle> npcs;
+
+        // NPCs standing in it while it is not resident: its own once it has
+        // been loaded before, and any that walked in from an unloaded one
+        bool visited = false;
+        std::vector<NPC> parked;
+    };
+
+    std::string dir;
+    std::string name;
+    float chunkSize = 0.0f;
+    float overhang = 0.0f;    // Furthest any chunk's bounds reach past its square
+    std::vector<Chunk> chunks;
+    std::unordered_map<uint64_t, size_t> lookup;   // By chunkKey(cx, cy)
+    std::vector<size_t> active;                    // LOADING or RESIDENT
+
+    static uint64_t chunkKey(int cx, int cy);
+    Chunk& chunkUnder(const Vec2& p, Chunk& fallback);   // fallback if no chunk there
+    float distanceTo(const Chunk& chunk, const Vec2& p) const;
+    void startLoad(size_t index, ThreadPool& pool);
+    void addToMap(Chunk& chunk, Map& map);
+    void removeFromMap(Chunk& chunk, Map& map);
+};
+
+#endif // WORLD_STREAM_HH
@@ -2,15 +2,60 @@
 #define SHAPE_HH
 
 #include "../Vec2.hh"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <string>
 
+// Running [minY, maxY] of the places a vertical line crosses a shape's
+// outline; lets the crossing tests avoid collecting y values in a vector
+struct YSpan {
+    float minY = std::numeric_limits<float>::max();
+    float maxY = std::numeric_limits<float>::lowest();
+
+    void add(float y) {
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+    }
+    bool empty() const { return minY > maxY; }
+};
+
+// Concrete type of a Shape, so hot paths can switch on a tag instead of
+// going through dynamic_cast
+enum class ShapeKind {
+    RECTANGLE,
+    TRIANGLE,
+    CIRCLE,
+    LINE
+};
+
 // Abstract shape base class
 class Shape {
 public:
     Vec2 position;
+    explicit Shape(ShapeKind kind) : kind(kind) {}
     virtual ~Shape() = default;
+    ShapeKind getKind() const { return kind; }
     virtual bool intersectsVerticalLine(float x, float& minY, float& maxY) const = 0;
     virtual std::string getType() const = 0;
+
+    // Batched intersectsVerticalLine: answers count x positions in one call.
+    // hit[i] is 1 when the line at xs[i] crosses the shape, in which case
+    // minY[i] / maxY[i] hold the crossing span (untouched otherwise).
+    virtual void intersectsVerticalLines(const float* xs, size_t count,
+                                         float* minY, float* maxY, uint8_t* hit) const = 0;
+
+    // Axis-aligned bounding box, used to bucket the shape in spatial indexes
+    virtual void getBounds(Vec2& min, Vec2& max) const = 0;
+
+    // Closed-form ray test. dir must be unit length. On a hit closer than
+    // maxT, t is the distance along the ray and normal faces the ray origin.
+    virtual bool intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                              float& t, Vec2& normal) const = 0;
+
+private:
+    ShapeKind kind;
 };
 
 #endif // SHAPE_HH
\ No newline at end of file
@@ -1,21 +1,50 @@
 #include "Circle.hh"
 #include <cmath>
 
-Circle::Circle(Vec2 pos, float r) : radius(r) {
+Circle::Circle(Vec2 pos, float r) : Shape(ShapeKind::CIRCLE), radius(r) {
     position = pos;
 }
 
-bool Circle::intersectsVerticalLine(float x, float& minY, float& maxY) const {
-    float dx = x - position.x;
-    if (std::abs(dx) <= radius) {
-        float dy = std::sqrt(radius * radius - dx * dx);
-        minY = position.y - dy;
-        maxY = position.y + dy;
-        return true;
+void Circle::intersectsVerticalLines(const float* xs, size_t count,
+                                     float* minY, float* maxY, uint8_t* hit) const {
+    for (size_t i = 0; i < count; ++i) {
+        hit[i] = Circle::intersectsVerticalLine(xs[i], minY[i], maxY[i]);
     }
-    return false;
 }
 
 std::string Circle::getType() const { 
     return "circle"; 
-}
\ No newline at end of file
+}
+
+void Circle::getBounds(Vec2& min, Vec2& max) const {
+    min = Vec2(position.x - radius, position.y - radius);
+    max = Vec2(position.x + radius, position.y + radius);
+}
+
+bool Circle::intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                          float& t, Vec2& normal) const {
+    Vec2 toOrigin = origin - position;
+    float b = toOrigin.x * dir.x + toOrigin.y * dir.y;
+    float c = toOrigin.x * toOrigin.x + toOrigin.y * toOrigin.y - radius * radius;
+
+    if (c <= 0.0f) {
+        // Starting inside the circle counts as an immediate hit
+        t = 0.0f;
+        normal = dir * -1.0f;
+        return true;
+    }
+
+    float disc = b * b - c;
+    if (b > 0.0f || disc < 0.0f) {
+        return false;  // Pointing away, or missing entirely
+    }
+
+    float hitT = -b - std::sqrt(disc);
+    if (hitT > maxT) {
+        return false;
+    }
+
+    t = hitT;
+    normal = (origin + dir * hitT - position).normalized();
+    return true;
+}
@@ -2,14 +2,30 @@
 #define CIRCLE_HH
 
 #include "../Shape.hh"
+#include <cmath>
 
-class Circle : public Shape {
+class Circle final : public Shape {
 public:
     float radius;
     
     Circle(Vec2 pos, float r);
-    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override;
+    // Defined inline so typed loops (ShapeStore) can inline the hot test
+    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override {
+        float dx = x - position.x;
+        if (std::abs(dx) <= radius) {
+            float dy = std::sqrt(radius * radius - dx * dx);
+            minY = position.y - dy;
+            maxY = position.y + dy;
+            return true;
+        }
+        return false;
+    }
+    void intersectsVerticalLines(const float* xs, size_t count,
+                                 float* minY, float* maxY, uint8_t* hit) const override;
     std::string getType() const override;
+    void getBounds(Vec2& min, Vec2& max) const override;
+    bool intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                      float& t, Vec2& normal) const override;
 };
 
 #endif // CIRCLE_HH
\ No newline at end of file
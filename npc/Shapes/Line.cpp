@@ -2,7 +2,7 @@
 #include <algorithm>
 #include <cmath>
 
-Line::Line(const std::vector<Vec2>& pts) : points(pts) {
+Line::Line(const std::vector<Vec2>& pts) : Shape(ShapeKind::LINE), points(pts) {
     // Update position to be the average of all points
     if (!points.empty()) {
         float avgX = 0, avgY = 0;
@@ -19,7 +19,7 @@ bool Line::intersectsVerticalLine(float x, float& minY, float& maxY) const {
         return false;
     }
     
-    std::vector<float> yValues;
+    YSpan span;
     
     // Check each line segment
     for (size_t i = 0; i + 1 < points.size(); ++i) {
@@ -41,8 +41,8 @@ bool Line::intersectsVerticalLine(float x, float& minY, float& maxY) const {
         // Handle vertical line segment
         if (std::abs(p2.x - p1.x) < 1e-6f) {
             if (std::abs(p1.x - x) < tolerance) {
-                yValues.push_back(std::min(p1.y, p2.y));
-                yValues.push_back(std::max(p1.y, p2.y));
+                span.add(std::min(p1.y, p2.y));
+                span.add(std::max(p1.y, p2.y));
             }
             continue;
         }
@@ -51,21 +51,27 @@ bool Line::intersectsVerticalLine(float x, float& minY, float& maxY) const {
         float t = (x - p1.x) / (p2.x - p1.x);
         // Clamp t to [0, 1] but with slight tolerance for numerical precision
         if (t >= -tolerance && t <= 1.0f + tolerance) {
-            float y = p1.y + t * (p2.y - p1.y);
-            yValues.push_back(y);
+            span.add(p1.y + t * (p2.y - p1.y));
         }
     }
     
-    if (yValues.empty()) {
+    if (span.empty()) {
         return false;
     }
     
-    minY = *std::min_element(yValues.begin(), yValues.end());
-    maxY = *std::max_element(yValues.begin(), yValues.end());
+    minY = span.minY;
+    maxY = span.maxY;
     
     return true;
 }
 
+void Line::intersectsVerticalLines(const float* xs, size_t count,
+                                   float* minY, float* maxY, uint8_t* hit) const {
+    for (size_t i = 0; i < count; ++i) {
+        hit[i] = Line::intersectsVerticalLine(xs[i], minY[i], maxY[i]);
+    }
+}
+
 float Line::getClosestDistanceToPoint(const Vec2& point) const {
     if (points.size() < 2) {
         return 1e6f;  // No collision if line doesn't have segments
@@ -111,3 +117,51 @@ float Line::getClosestDistanceToPoint(const Vec2& point) const {
     
     return minDist;
 }
+
+void Line::getBounds(Vec2& min, Vec2& max) const {
+    if (points.empty()) {
+        min = max = position;
+        return;
+    }
+    min = max = points[0];
+    for (const auto& pt : points) {
+        min.x = std::min(min.x, pt.x); min.y = std::min(min.y, pt.y);
+        max.x = std::max(max.x, pt.x); max.y = std::max(max.y, pt.y);
+    }
+}
+
+bool Line::intersectRaySegment(const Vec2& origin, const Vec2& dir, float maxT,
+                               const Vec2& a, const Vec2& b,
+                               float& t, Vec2& normal) {
+    Vec2 edge = b - a;
+    float denom = dir.x * edge.y - dir.y * edge.x;
+    if (std::abs(denom) < 1e-9f) {
+        return false;  // Parallel: grazing hits are ignored
+    }
+
+    Vec2 toA = a - origin;
+    float hitT = (toA.x * edge.y - toA.y * edge.x) / denom;
+    float u = (toA.x * dir.y - toA.y * dir.x) / denom;
+    if (hitT < 0.0f || hitT > maxT || u < 0.0f || u > 1.0f) {
+        return false;
+    }
+
+    t = hitT;
+    normal = Vec2(-edge.y, edge.x).normalized();
+    if (normal.x * dir.x + normal.y * dir.y > 0) {
+        normal = normal * -1.0f;
+    }
+    return true;
+}
+
+bool Line::intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                        float& t, Vec2& normal) const {
+    bool hit = false;
+    for (size_t i = 0; i + 1 < points.size(); ++i) {
+        if (intersectRaySegment(origin, dir, maxT, points[i], points[i + 1], t, normal)) {
+            maxT = t;
+            hit = true;
+        }
+    }
+    return hit;
+}
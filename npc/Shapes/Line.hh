@@ -5,20 +5,30 @@
 #include "../../Vec2.hh"
 #include <vector>
 
-class Line : public Shape {
+class Line final : public Shape {
 public:
     std::vector<Vec2> points;
     
     Line(const std::vector<Vec2>& points = {});
     
     bool intersectsVerticalLine(float x, float& minY, float& maxY) const override;
+    void intersectsVerticalLines(const float* xs, size_t count,
+                                 float* minY, float* maxY, uint8_t* hit) const override;
     std::string getType() const override { return "Line"; }
+    void getBounds(Vec2& min, Vec2& max) const override;
+    bool intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                      float& t, Vec2& normal) const override;
     
     // Additional method to get all points
     const std::vector<Vec2>& getPoints() const { return points; }
     
     // New method: check closest point on line to given position
     float getClosestDistanceToPoint(const Vec2& point) const;
+
+    // Ray against the single segment a-b; shared with the map's wall queries
+    static bool intersectRaySegment(const Vec2& origin, const Vec2& dir, float maxT,
+                                    const Vec2& a, const Vec2& b,
+                                    float& t, Vec2& normal);
 };
 
 #endif // LINE_HH
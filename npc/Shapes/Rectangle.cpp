@@ -1,18 +1,65 @@
 #include "Rectangle.hh"
+#include <algorithm>
+#include <cmath>
 
-Rectangle::Rectangle(Vec2 pos, float w, float h) : width(w), height(h) {
+Rectangle::Rectangle(Vec2 pos, float w, float h) : Shape(ShapeKind::RECTANGLE), width(w), height(h) {
     position = pos;
 }
 
-bool Rectangle::intersectsVerticalLine(float x, float& minY, float& maxY) const {
-    if (x >= position.x && x <= position.x + width) {
-        minY = position.y;
-        maxY = position.y + height;
-        return true;
+void Rectangle::intersectsVerticalLines(const float* xs, size_t count,
+                                        float* minY, float* maxY, uint8_t* hit) const {
+    float left = position.x, right = position.x + width;
+    float top = position.y + height;
+    for (size_t i = 0; i < count; ++i) {
+        hit[i] = xs[i] >= left && xs[i] <= right;
+        if (hit[i]) {
+            minY[i] = position.y;
+            maxY[i] = top;
+        }
     }
-    return false;
 }
 
 std::string Rectangle::getType() const { 
     return "rectangle"; 
-}
\ No newline at end of file
+}
+
+void Rectangle::getBounds(Vec2& min, Vec2& max) const {
+    min = position;
+    max = Vec2(position.x + width, position.y + height);
+}
+
+bool Rectangle::intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                             float& t, Vec2& normal) const {
+    // Slab test; remember which axis we entered through for the normal
+    float tNear = 0.0f, tFar = maxT;
+    Vec2 nearNormal = dir * -1.0f;
+    const float lo[2] = {position.x, position.y};
+    const float hi[2] = {position.x + width, position.y + height};
+    const float o[2] = {origin.x, origin.y};
+    const float d[2] = {dir.x, dir.y};
+
+    for (int axis = 0; axis < 2; ++axis) {
+        if (std::abs(d[axis]) < 1e-9f) {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+            continue;
+        }
+        float inv = 1.0f / d[axis];
+        float t0 = (lo[axis] - o[axis]) * inv;
+        float t1 = (hi[axis] - o[axis]) * inv;
+        float side = -1.0f;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+            side = 1.0f;
+        }
+        if (t0 > tNear) {
+            tNear = t0;
+            nearNormal = axis == 0 ? Vec2(side, 0) : Vec2(0, side);
+        }
+        tFar = std::min(tFar, t1);
+        if (tNear > tFar) return false;
+    }
+
+    t = tNear;
+    normal = nearNormal;
+    return true;
+}
@@ -3,13 +3,26 @@
 
 #include "../Shape.hh"
 
-class Rectangle : public Shape {
+class Rectangle final : public Shape {
 public:
     float width, height;
     
     Rectangle(Vec2 pos, float w, float h);
-    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override;
+    // Defined inline so typed loops (ShapeStore) can inline the hot test
+    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override {
+        if (x >= position.x && x <= position.x + width) {
+            minY = position.y;
+            maxY = position.y + height;
+            return true;
+        }
+        return false;
+    }
+    void intersectsVerticalLines(const float* xs, size_t count,
+                                 float* minY, float* maxY, uint8_t* hit) const override;
     std::string getType() const override;
+    void getBounds(Vec2& min, Vec2& max) const override;
+    bool intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                      float& t, Vec2& normal) const override;
 };
 
 #endif // RECTANGLE_HH
\ No newline at end of file
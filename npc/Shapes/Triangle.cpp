@@ -1,39 +1,37 @@
 #include "Triangle.hh"
-#include <vector>
+#include "Line.hh"
 #include <algorithm>
 #include <cmath>
 
-Triangle::Triangle(Vec2 a, Vec2 b, Vec2 c) : p1(a), p2(b), p3(c) {
+Triangle::Triangle(Vec2 a, Vec2 b, Vec2 c) : Shape(ShapeKind::TRIANGLE), p1(a), p2(b), p3(c) {
     position = Vec2((a.x + b.x + c.x) / 3, (a.y + b.y + c.y) / 3);
 }
 
-bool Triangle::intersectsVerticalLine(float x, float& minY, float& maxY) const {
-    std::vector<float> yIntersections;
-    
-    auto checkEdge = [&](Vec2 a, Vec2 b) {
-        if ((a.x <= x && b.x >= x) || (a.x >= x && b.x <= x)) {
-            if (std::abs(b.x - a.x) < 0.001f) {
-                yIntersections.push_back(a.y);
-                yIntersections.push_back(b.y);
-            } else {
-                float t = (x - a.x) / (b.x - a.x);
-                float y = a.y + t * (b.y - a.y);
-                yIntersections.push_back(y);
-            }
-        }
-    };
-    
-    checkEdge(p1, p2);
-    checkEdge(p2, p3);
-    checkEdge(p3, p1);
-    
-    if (yIntersections.empty()) return false;
-    
-    minY = *std::min_element(yIntersections.begin(), yIntersections.end());
-    maxY = *std::max_element(yIntersections.begin(), yIntersections.end());
-    return true;
+void Triangle::intersectsVerticalLines(const float* xs, size_t count,
+                                       float* minY, float* maxY, uint8_t* hit) const {
+    for (size_t i = 0; i < count; ++i) {
+        hit[i] = Triangle::intersectsVerticalLine(xs[i], minY[i], maxY[i]);
+    }
 }
 
 std::string Triangle::getType() const { 
     return "triangle"; 
-}
\ No newline at end of file
+}
+
+void Triangle::getBounds(Vec2& min, Vec2& max) const {
+    min = Vec2(std::min({p1.x, p2.x, p3.x}), std::min({p1.y, p2.y, p3.y}));
+    max = Vec2(std::max({p1.x, p2.x, p3.x}), std::max({p1.y, p2.y, p3.y}));
+}
+
+bool Triangle::intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                            float& t, Vec2& normal) const {
+    bool hit = false;
+    const Vec2* corners[4] = {&p1, &p2, &p3, &p1};
+    for (int i = 0; i < 3; ++i) {
+        if (Line::intersectRaySegment(origin, dir, maxT, *corners[i], *corners[i + 1], t, normal)) {
+            maxT = t;
+            hit = true;
+        }
+    }
+    return hit;
+}
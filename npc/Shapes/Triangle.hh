@@ -2,14 +2,45 @@
 #define TRIANGLE_HH
 
 #include "../Shape.hh"
+#include <cmath>
 
-class Triangle : public Shape {
+class Triangle final : public Shape {
 public:
     Vec2 p1, p2, p3;
     
     Triangle(Vec2 a, Vec2 b, Vec2 c);
-    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override;
+    // Defined inline so typed loops (ShapeStore) can inline the hot test
+    bool intersectsVerticalLine(float x, float& minY, float& maxY) const override {
+        YSpan span;
+        edgeSpan(p1, p2, x, span);
+        edgeSpan(p2, p3, x, span);
+        edgeSpan(p3, p1, x, span);
+        
+        if (span.empty()) return false;
+        
+        minY = span.minY;
+        maxY = span.maxY;
+        return true;
+    }
+    void intersectsVerticalLines(const float* xs, size_t count,
+                                 float* minY, float* maxY, uint8_t* hit) const override;
     std::string getType() const override;
+    void getBounds(Vec2& min, Vec2& max) const override;
+    bool intersectRay(const Vec2& origin, const Vec2& dir, float maxT,
+                      float& t, Vec2& normal) const override;
+
+private:
+    static void edgeSpan(const Vec2& a, const Vec2& b, float x, YSpan& span) {
+        if ((a.x <= x && b.x >= x) || (a.x >= x && b.x <= x)) {
+            if (std::abs(b.x - a.x) < 0.001f) {
+                span.add(a.y);
+                span.add(b.y);
+            } else {
+                float t = (x - a.x) / (b.x - a.x);
+                span.add(a.y + t * (b.y - a.y));
+            }
+        }
+    }
 };
 
 #endif // TRIANGLE_HH
\ No newline at end of file
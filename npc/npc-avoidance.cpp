@@ -0,0 +1,250 @@
+#include "npc-avoidance.hh"
+#include "../engine/thread-pool.hh"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Bodies per parallel chunk
+const size_t AVOIDANCE_GRAIN = 1024;
+
+const float EPSILON = 1e-5f;
+
+// A velocity half-plane: allowed velocities are left of direction, through
+// point
+struct Line {
+    Vec2 point;
+    Vec2 direction;
+};
+
+float dot(const Vec2& a, const Vec2& b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+float det(const Vec2& a, const Vec2& b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+// Optimizes along line lineNo under lines [0, lineNo) and the speed
+// circle. With directionOpt, optVelocity is a direction to go furthest in.
+bool linearProgram1(const Line* lines, size_t lineNo, float radius, const Vec2& optVelocity,
+                    bool directionOpt, Vec2& result) {
+    const Line& line = lines[lineNo];
+    float along = dot(line.point, line.direction);
+    float discriminant = along * along + radius * radius - dot(line.point, line.point);
+    if (discriminant < 0.0f) return false;   // The line misses the speed circle
+
+    float root = std::sqrt(discriminant);
+    float tLeft = -along - root;
+    float tRight = -along + root;
+
+    for (size_t i = 0; i < lineNo; ++i) {
+        float denominator = det(line.direction, lines[i].direction);
+        float numerator = det(lines[i].direction, line.point - lines[i].point);
+        if (std::abs(denominator) <= EPSILON) {
+            // Parallel: either all of this line is allowed by i or none is
+            if (numerator < 0.0f) return false;
+            continue;
+        }
+        float t = numerator / denominator;
+        if (denominator >= 0.0f) {
+            tRight = std::min(tRight, t);
+        } else {
+            tLeft = std::max(tLeft, t);
+        }
+        if (tLeft > tRight) return false;
+    }
+
+    float t;
+    if (directionOpt) {
+        t = dot(optVelocity, line.direction) > 0.0f ? tRight : tLeft;
+    } else {
+        t = std::clamp(dot(line.direction, optVelocity - line.point), tLeft, tRight);
+    }
+    result = line.point + line.direction * t;
+    return true;
+}
+
+// Closest velocity to optVelocity inside every half-plane and the speed
+// circle. Returns count on success, else the first line that could not be
+// met (result then holds the best answer up to it).
+size_t linearProgram2(const Line* lines, size_t count, float radius, const Vec2& optVelocity,
+                      bool directionOpt, Vec2& result) {
+    if (directionOpt) {
+        result = optVelocity * radius;
+    } else if (dot(optVelocity, optVelocity) > radius * radius) {
+        result = optVelocity.normalized() * radius;
+    } else {
+        result = optVelocity;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        if (det(lines[i].direction, lines[i].point - result) > 0.0f) {
+            Vec2 previous = result;
+            if (!linearProgram1(lines, i, radius, optVelocity, directionOpt, result)) {
+                result = previous;
+                return i;
+            }
+        }
+    }
+    return count;
+}
+
+// When the half-planes leave nothing (too crowded), finds the velocity that
+// violates them least, from beginLine on
+void linearProgram3(const Line* lines, size_t count, size_t beginLine, float radius, Vec2& result) {
+    float distance = 0.0f;
+    Line projected[NPCAvoidance::MAX_NEIGHBORS];
+
+    for (size_t i = beginLine; i < count; ++i) {
+        if (det(lines[i].direction, lines[i].point - result) <= distance) continue;
+
+        size_t projectedCount = 0;
+        for (size_t j = 0; j < i; ++j) {
+            Line line;
+            float determinant = det(lines[i].direction, lines[j].direction);
+            if (std::abs(determinant) <= EPSILON) {
+                if (dot(lines[i].direction, lines[j].direction) > 0.0f) continue;
+                line.point = (lines[i].point + lines[j].point) * 0.5f;
+            } else {
+                line.point = lines[i].point + lines[i].direction *
+                    (det(lines[j].direction, lines[i].point - lines[j].point) / determinant);
+            }
+            line.direction = (lines[j].direction - lines[i].direction).normalized();
+            projected[projectedCount++] = line;
+        }
+
+        Vec2 previous = result;
+        Vec2 away(-lines[i].direction.y, lines[i].direction.x);
+        if (linearProgram2(projected, projectedCount, radius, away, true, result) < projectedCount) {
+            // Only rounding can get here; keep the last answer
+            result = previous;
+        }
+        distance = det(lines[i].direction, lines[i].point - result);
+    }
+}
+
+} // namespace
+
+void NPCAvoidance::solve(NPCStore& store, const std::vector<uint32_t>& neighbours,
+                         const std::vector<uint32_t>& bodies, const float* steps, ThreadPool& pool) {
+    size_t count = bodies.size();
+    if (!enabled) {
+        for (uint32_t i : bodies) {
+            store.velX[i] = store.prefVelX[i];
+            store.velY[i] = store.prefVelY[i];
+        }
+        return;
+    }
+    if (count == 0) return;
+
+    hash.build(store, neighbours, neighborDistance);
+    nextVelX.resize(count);
+    nextVelY.resize(count);
+    pool.parallelFor(count, AVOIDANCE_GRAIN, [&](size_t begin, size_t end) {
+        solveRange(store, bodies, steps, begin, end);
+    });
+    // Every body has read its neighbours' old velocities by now
+    for (size_t k = 0; k < count; ++k) {
+        store.velX[bodies[k]] = nextVelX[k];
+        store.velY[bodies[k]] = nextVelY[k];
+    }
+}
+
+void NPCAvoidance::solveRange(const NPCStore& store, const std::vector<uint32_t>& bodies,
+                              const float* steps, size_t begin, size_t end) {
+    size_t cap = std::min(maxNeighbors, MAX_NEIGHBORS);
+    float invHorizon = 1.0f / timeHorizon;
+    float rangeSq = neighborDistance * neighborDistance;
+
+    // Nearest neighbours first, kept sorted by distance
+    uint32_t neighbor[MAX_NEIGHBORS];
+    float neighborDistSq[MAX_NEIGHBORS];
+    Line lines[MAX_NEIGHBORS];
+
+    for (size_t k = begin; k < end; ++k) {
+        uint32_t i = bodies[k];
+        Vec2 position = store.position(i);
+        Vec2 velocity = store.velocity(i);
+        Vec2 preferred = store.preferredVelocity(i);
+        float radius = store.radius[i];
+        float invStep = steps[i] > 0.0f ? 1.0f / steps[i] : 0.0f;
+
+        size_t found = 0;
+        if (cap > 0) {
+            hash.forEachNear(position, neighborDistance, [&](uint32_t j) {
+                if (j == i) return;
+                Vec2 offset = store.position(j) - position;
+                float distSq = dot(offset, offset);
+                if (distSq >= rangeSq) return;
+                if (found == cap && distSq >= neighborDistSq[found - 1]) return;
+
+                size_t slot = found < cap ? found++ : found - 1;
+                while (slot > 0 && neighborDistSq[slot - 1] > distSq) {
+                    neighbor[slot] = neighbor[slot - 1];
+                    neighborDistSq[slot] = neighborDistSq[slot - 1];
+                    --slot;
+                }
+                neighbor[slot] = j;
+                neighborDistSq[slot] = distSq;
+            });
+        }
+
+        // One half-plane per neighbour
+        for (size_t n = 0; n < found; ++n) {
+            uint32_t j = neighbor[n];
+            Vec2 relativePosition = store.position(j) - position;
+            Vec2 relativeVelocity = velocity - store.velocity(j);
+            float distSq = neighborDistSq[n];
+            float combinedRadius = radius + store.radius[j];
+            float combinedRadiusSq = combinedRadius * combinedRadius;
+
+            Line& line = lines[n];
+            Vec2 u;
+            if (distSq > combinedRadiusSq) {
+                // Apart: the obstacle is the truncated cone
+                Vec2 w = relativeVelocity - relativePosition * invHorizon;
+                float wLengthSq = dot(w, w);
+                float wDot = dot(w, relativePosition);
+
+                if (wDot < 0.0f && wDot * wDot > combinedRadiusSq * wLengthSq) {
+                    // Nearest to the rounded front
+                    float wLength = std::sqrt(wLengthSq);
+                    Vec2 unitW = w * (1.0f / wLength);
+                    line.direction = Vec2(unitW.y, -unitW.x);
+                    u = unitW * (combinedRadius * invHorizon - wLength);
+                } else {
+                    // Nearest to one of the legs
+                    float leg = std::sqrt(distSq - combinedRadiusSq);
+                    if (det(relativePosition, w) > 0.0f) {
+                        line.direction = Vec2(relativePosition.x * leg - relativePosition.y * combinedRadius,
+                                              relativePosition.x * combinedRadius + relativePosition.y * leg) * (1.0f / distSq);
+                    } else {
+                        line.direction = Vec2(relativePosition.x * leg + relativePosition.y * combinedRadius,
+                                              -relativePosition.x * combinedRadius + relativePosition.y * leg) * (-1.0f / distSq);
+                    }
+                    u = line.direction * dot(relativeVelocity, line.direction) - relativeVelocity;
+                }
+            } else {
+                // Already overlapping: get apart within this step
+                Vec2 w = relativeVelocity - relativePosition * invStep;
+                float wLength = w.length();
+                Vec2 unitW = wLength > EPSILON ? w * (1.0f / wLength) : Vec2(1.0f, 0.0f);
+                line.direction = Vec2(unitW.y, -unitW.x);
+                u = unitW * (combinedRadius * invStep - wLength);
+            }
+
+            // Take half the avoiding; the neighbour takes the other half
+            line.point = velocity + u * 0.5f;
+        }
+
+        float speedLimit = std::max(maxSpeed, preferred.length());
+        Vec2 result;
+        size_t failed = linearProgram2(lines, found, speedLimit, preferred, false, result);
+        if (failed < found) {
+            linearProgram3(lines, found, failed, speedLimit, result);
+        }
+        nextVelX[k] = result.x;
+        nextVelY[k] = result.y;
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef NPC_AVOIDANCE_HH
+#define NPC_AVOIDANCE_HH
+
+#include "npc-hash.hh"
+#include <cstddef>
+#include <vector>
+
+class ThreadPool;
+
+// Local avoidance between the bodies of an NPCStore, in the style of ORCA
+// (optimal reciprocal collision avoidance, as in the RVO2 library). Each
+// body looks at its nearest neighbours within neighborDistance; each one
+// rules out a half-plane of velocities that would hit it within
+// timeHorizon seconds, assuming the neighbour takes half the avoiding. A
+// small linear program then picks the allowed velocity closest to the
+// preferred one. Bodies only read their neighbours and write their own
+// answer, so the step runs in parallel chunks.
+//
+// Walls are left to NPCCollision. Which bodies take part is up to the
+// caller (see NPCLod): some are solved, more are only avoided.
+class NPCAvoidance {
+public:
+    // Upper bound on maxNeighbors; sizes the per-body scratch
+    static constexpr size_t MAX_NEIGHBORS = 16;
+
+    bool enabled = true;
+    float neighborDistance = 2.5f;
+    size_t maxNeighbors = 10;        // Bounds the cost per body
+    float timeHorizon = 1.5f;        // Seconds of look-ahead
+    float maxSpeed = 2.0f;           // Fastest a body may go to get out of the way
+
+    // Sets store.velX/velY of the listed bodies from their preferred
+    // velocities, for the next steps[i] seconds, avoiding every body in
+    // neighbours (which should include bodies)
+    void solve(NPCStore& store, const std::vector<uint32_t>& neighbours,
+               const std::vector<uint32_t>& bodies, const float* steps, ThreadPool& pool);
+
+private:
+    NPCHash hash;
+    std::vector<float> nextVelX, nextVelY;   // Per listed body
+
+    void solveRange(const NPCStore& store, const std::vector<uint32_t>& bodies,
+                    const float* steps, size_t begin, size_t end);
+};
+
+#endif // NPC_AVOIDANCE_HH
@@ -0,0 +1,42 @@
+#include "npc-hash.hh"
+
+void NPCHash::build(const NPCStore& store, float size) {
+    build(store, nullptr, store.size(), size);
+}
+
+void NPCHash::build(const NPCStore& store, const std::vector<uint32_t>& bodies, float size) {
+    build(store, bodies.data(), bodies.size(), size);
+}
+
+void NPCHash::build(const NPCStore& store, const uint32_t* bodies, size_t count, float size) {
+    cellSize = size > 0 ? size : 1.0f;
+    invCellSize = 1.0f / cellSize;
+
+    // At least 4 x 4, so the 3 x 3 cells around a body are all different
+    width = height = 4;
+    while ((size_t)width * height < count * 2) {
+        if (width == height) width <<= 1; else height <<= 1;
+    }
+    uint32_t tableSize = width * height;
+
+    // Without a list, entry k is body k
+    auto body = [&](size_t k) { return bodies ? bodies[k] : (uint32_t)k; };
+
+    bucket.resize(count);
+    start.assign(tableSize + 1, 0);
+    for (size_t k = 0; k < count; ++k) {
+        uint32_t i = body(k);
+        bucket[k] = bucketOf(cellOf(store.posX[i]), cellOf(store.posY[i]));
+        start[bucket[k] + 1]++;
+    }
+    for (uint32_t b = 1; b <= tableSize; ++b) start[b] += start[b - 1];
+
+    // Fill back to front so each bucket keeps body order
+    items.resize(count);
+    for (size_t k = count; k-- > 0;) {
+        items[--start[bucket[k] + 1]] = body(k);
+    }
+    // The fill left start[b + 1] at the first item of bucket b; shift down
+    for (uint32_t b = 0; b < tableSize; ++b) start[b] = start[b + 1];
+    start[tableSize] = (uint32_t)count;
+}
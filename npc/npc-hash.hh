@@ -0,0 +1,81 @@
+#ifndef NPC_HASH_HH
+#define NPC_HASH_HH
+
+#include "npc-store.hh"
+#include "../Vec2.hh"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Spatial hash over the bodies of an NPCStore, rebuilt from scratch every
+// frame. Bodies are bucketed by the cell their center is in, and cells
+// wrap around a power-of-two table of width x height buckets holding at
+// least twice as many buckets as bodies. The world needs no bounds, the
+// table stays O(n), and cells next to each other never share a bucket.
+// Buckets are packed CSR-style by a counting sort, like SpatialGrid's, so
+// a row of neighbouring cells is one contiguous run of bodies.
+//
+// Cells a table width apart do share a bucket, so queries return a
+// superset of the bodies near a point; callers do the exact distance test.
+class NPCHash {
+public:
+    // cellSize should be about the largest query reach, so a query only
+    // touches the few cells around its point
+    void build(const NPCStore& store, float cellSize);
+
+    // Same, over only the listed bodies
+    void build(const NPCStore& store, const std::vector<uint32_t>& bodies, float cellSize);
+
+    float getCellSize() const { return cellSize; }
+
+    // Calls fn(begin, end) with ranges into getItems() covering every cell
+    // that overlaps the box point +- reach. No body is in two ranges.
+    template <typename Fn>
+    void forEachRun(const Vec2& point, float reach, Fn&& fn) const {
+        if (items.empty()) return;
+        int x0 = cellOf(point.x - reach), x1 = cellOf(point.x + reach);
+        int y0 = cellOf(point.y - reach), y1 = cellOf(point.y + reach);
+        int spanX = std::min(x1 - x0 + 1, (int)width);
+        int spanY = std::min(y1 - y0 + 1, (int)height);
+
+        uint32_t first = (uint32_t)x0 & (width - 1);
+        uint32_t last = first + (uint32_t)spanX;   // One past, may wrap
+        for (int dy = 0; dy < spanY; ++dy) {
+            const uint32_t* row = &start[(((uint32_t)(y0 + dy) & (height - 1)) * width)];
+            if (last <= width) {
+                if (row[first] < row[last]) fn(row[first], row[last]);
+            } else {
+                if (row[first] < row[width]) fn(row[first], row[width]);
+                if (row[0] < row[last - width]) fn(row[0], row[last - width]);
+            }
+        }
+    }
+
+    // Calls fn(body) for every body in the runs above
+    template <typename Fn>
+    void forEachNear(const Vec2& point, float reach, Fn&& fn) const {
+        forEachRun(point, reach, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; ++i) fn(items[i]);
+        });
+    }
+
+    // Body indices, grouped by bucket
+    const std::vector<uint32_t>& getItems() const { return items; }
+
+private:
+    float cellSize = 1.0f;
+    float invCellSize = 1.0f;
+    uint32_t width = 0, height = 0;
+    std::vector<uint32_t> start;    // width * height + 1 offsets into items
+    std::vector<uint32_t> items;
+    std::vector<uint32_t> bucket;   // Scratch: bucket of each body
+
+    void build(const NPCStore& store, const uint32_t* bodies, size_t count, float cellSize);
+    int cellOf(float v) const { return (int)std::floor(v * invCellSize); }
+    uint32_t bucketOf(int cx, int cy) const {
+        return ((uint32_t)cy & (height - 1)) * width + ((uint32_t)cx & (width - 1));
+    }
+};
+
+#endif // NPC_HASH_HH
@@ -0,0 +1,89 @@
+#include "npc-lod.hh"
+#include "npc-store.hh"
+
+void NPCLod::resize(size_t count) {
+    // Bodies added since the last step start NEAR, with nothing to catch up
+    tiers.resize(count, NEAR);
+    pending.resize(count, 0.0f);
+    steps.resize(count);
+    awake.clear();
+    interacting.clear();
+    coarse.clear();
+    ticking.clear();
+}
+
+void NPCLod::schedule(const NPCStore& store, const Vec2& focus, float dt) {
+    size_t count = store.size();
+    resize(count);
+    ++frame;
+
+    float nearSq = nearDistance * nearDistance;
+    float farSq = farDistance * farDistance;
+    uint32_t midEvery = midInterval > 0 ? midInterval : 1;
+    uint32_t farEvery = farInterval > 0 ? farInterval : 1;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        float dx = store.posX[i] - focus.x;
+        float dy = store.posY[i] - focus.y;
+        float distSq = dx * dx + dy * dy;
+        uint8_t tier = distSq < nearSq ? NEAR : distSq < farSq ? MID : FAR;
+
+        bool due;
+        if (tier < tiers[i]) {
+            due = true;   // Coming closer: catch up now
+        } else if (tier == NEAR) {
+            due = true;
+        } else if (tier == MID) {
+            due = (frame + i) % midEvery == 0;
+        } else {
+            due = (frame + i) % farEvery == 0;
+        }
+        tiers[i] = tier;
+
+        pending[i] += dt;
+        if (due) {
+            steps[i] = pending[i];
+            pending[i] = 0.0f;
+            (tier == FAR ? coarse : interacting).push_back(i);
+        } else {
+            steps[i] = 0.0f;
+        }
+        if (tier != FAR) awake.push_back(i);
+    }
+
+    ticking.reserve(interacting.size() + coarse.size());
+    ticking.assign(interacting.begin(), interacting.end());
+    ticking.insert(ticking.end(), coarse.begin(), coarse.end());
+}
+
+void NPCLod::scheduleAll(const NPCStore& store, float dt) {
+    size_t count = store.size();
+    resize(count);
+    ++frame;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        // Whatever LOD left owing is paid now
+        tiers[i] = NEAR;
+        steps[i] = pending[i] + dt;
+        pending[i] = 0.0f;
+        awake.push_back(i);
+    }
+    interacting = awake;
+    ticking = awake;
+}
+
+void NPCLod::remove(uint32_t i, uint32_t last) {
+    // Cover every body the store has, so the one it moves is the one
+    // whose entry moves here
+    if (tiers.size() <= last) {
+        tiers.resize(last + 1, NEAR);
+        pending.resize(last + 1, 0.0f);
+        steps.resize(last + 1, 0.0f);
+    }
+    tiers[i] = tiers[last];
+    pending[i] = pending[last];
+    steps[i] = steps[last];
+    tiers.resize(last);
+    pending.resize(last);
+    steps.resize(last);
+}
@@ -0,0 +1,72 @@
+#ifndef NPC_LOD_HH
+#define NPC_LOD_HH
+
+#include "../Vec2.hh"
+#include <cstdint>
+#include <vector>
+
+class NPCStore;
+
+// Simulation level of detail for the bodies of an NPCStore, by distance
+// from a focus point (the player):
+//   NEAR  within nearDistance: every step, the full pipeline.
+//   MID   within farDistance: every midInterval steps, still with
+//         avoidance and collisions between bodies.
+//   FAR   beyond: every farInterval steps, just walking at the preferred
+//         velocity and kept out of walls.
+// Each body counts the time it has not been simulated for yet, and covers
+// it in one larger step when next due. A body moving into a nearer tier is
+// due at once, so it is caught up to where it would have been before the
+// player gets a close look at it. Ticks within a tier are staggered by
+// body index so that every step costs about the same.
+class NPCLod {
+public:
+    enum Tier : uint8_t { NEAR, MID, FAR };
+
+    float nearDistance = 30.0f;
+    float farDistance = 80.0f;
+    uint32_t midInterval = 4;
+    uint32_t farInterval = 16;
+
+    // Sorts the bodies into tiers around focus and picks the ones due this step
+    void schedule(const NPCStore& store, const Vec2& focus, float dt);
+
+    // Every body NEAR and due, as without LOD
+    void scheduleAll(const NPCStore& store, float dt);
+
+    // NEAR and MID bodies, due or not: what the others avoid and bump into
+    const std::vector<uint32_t>& getAwake() const { return awake; }
+
+    // NEAR and MID bodies due this step
+    const std::vector<uint32_t>& getInteracting() const { return interacting; }
+
+    // FAR bodies due this step
+    const std::vector<uint32_t>& getCoarse() const { return coarse; }
+
+    // Every body due this step: interacting, then coarse
+    const std::vector<uint32_t>& getTicking() const { return ticking; }
+
+    // Per body, the time it advances this step; 0 when not due
+    const float* getSteps() const { return steps.data(); }
+
+    Tier getTier(uint32_t i) const { return (Tier)tiers[i]; }
+
+    // Time body i is owed, to be paid on its next tick
+    float getPending(uint32_t i) const { return pending[i]; }
+
+    // Follows NPCStore::remove(i), where last is the store's last body
+    // before it (the one moved into i). Bodies added since the last
+    // schedule have no entry yet and count as NEAR with nothing owed.
+    void remove(uint32_t i, uint32_t last);
+
+private:
+    std::vector<uint8_t> tiers;
+    std::vector<float> pending;   // Time not simulated yet, this step included
+    std::vector<float> steps;
+    std::vector<uint32_t> awake, interacting, coarse, ticking;
+    uint32_t frame = 0;
+
+    void resize(size_t count);
+};
+
+#endif // NPC_LOD_HH
@@ -0,0 +1,90 @@
+#include "npc-store.hh"
+#include "../engine/thread-pool.hh"
+
+namespace {
+
+// Bodies per parallel chunk: big enough that a chunk is worth a task,
+// small enough to spread a 100k crowd over every core
+const size_t INTEGRATE_GRAIN = 8192;
+
+} // namespace
+
+uint32_t NPCStore::add(const Vec2& position, const Vec2& velocity, float r, uint32_t coldIndex) {
+    posX.push_back(position.x);
+    posY.push_back(position.y);
+    prevPosX.push_back(position.x);
+    prevPosY.push_back(position.y);
+    velX.push_back(velocity.x);
+    velY.push_back(velocity.y);
+    prefVelX.push_back(velocity.x);
+    prefVelY.push_back(velocity.y);
+    radius.push_back(r);
+    cold.push_back(coldIndex);
+    return (uint32_t)(posX.size() - 1);
+}
+
+void NPCStore::clear() {
+    posX.clear(); posY.clear();
+    prevPosX.clear(); prevPosY.clear();
+    velX.clear(); velY.clear();
+    prefVelX.clear(); prefVelY.clear();
+    radius.clear();
+    cold.clear();
+}
+
+void NPCStore::remove(uint32_t i) {
+    size_t last = size() - 1;
+    posX[i] = posX[last]; posY[i] = posY[last];
+    prevPosX[i] = prevPosX[last]; prevPosY[i] = prevPosY[last];
+    velX[i] = velX[last]; velY[i] = velY[last];
+    prefVelX[i] = prefVelX[last]; prefVelY[i] = prefVelY[last];
+    radius[i] = radius[last];
+    cold[i] = cold[last];
+
+    posX.pop_back(); posY.pop_back();
+    prevPosX.pop_back(); prevPosY.pop_back();
+    velX.pop_back(); velY.pop_back();
+    prefVelX.pop_back(); prefVelY.pop_back();
+    radius.pop_back();
+    cold.pop_back();
+}
+
+void NPCStore::reserve(size_t count) {
+    posX.reserve(count); posY.reserve(count);
+    prevPosX.reserve(count); prevPosY.reserve(count);
+    velX.reserve(count); velY.reserve(count);
+    prefVelX.reserve(count); prefVelY.reserve(count);
+    radius.reserve(count);
+    cold.reserve(count);
+}
+
+void NPCStore::integrate(float dt, ThreadPool& pool) {
+    pool.parallelFor(size(), INTEGRATE_GRAIN, [&](size_t begin, size_t end) {
+        integrateRange(dt, begin, end);
+    });
+}
+
+void NPCStore::integrateRange(float dt, size_t begin, size_t end) {
+    // Plain loops over non-aliasing arrays: the compiler turns these into
+    // packed multiply-adds (SSE/AVX/NEON, whatever the build targets)
+    float* __restrict px = posX.data();
+    float* __restrict py = posY.data();
+    const float* __restrict vx = velX.data();
+    const float* __restrict vy = velY.data();
+    for (size_t i = begin; i < end; ++i) {
+        px[i] += vx[i] * dt;
+    }
+    for (size_t i = begin; i < end; ++i) {
+        py[i] += vy[i] * dt;
+    }
+}
+
+void NPCStore::integrate(const std::vector<uint32_t>& bodies, const float* steps, ThreadPool& pool) {
+    pool.parallelFor(bodies.size(), INTEGRATE_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t k = begin; k < end; ++k) {
+            uint32_t i = bodies[k];
+            posX[i] += velX[i] * steps[i];
+            posY[i] += velY[i] * steps[i];
+        }
+    });
+}
@@ -0,0 +1,73 @@
+#ifndef NPC_STORE_HH
+#define NPC_STORE_HH
+
+#include "../Vec2.hh"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// Hot per-NPC simulation state in parallel arrays, one entry per body.
+// Steering sets the preferred velocity; Map::update turns it into the
+// actual velocity (avoiding other bodies) and integrates that.
+// Named NPCs (Map::npcs, with their dialogue, id and shape) each own a
+// body here, and so can any number of ambient crowd members that have no
+// cold data at all. The arrays are what the per-frame systems stream
+// through; nothing in them points anywhere.
+class NPCStore {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<float> posX, posY;
+    std::vector<float> prevPosX, prevPosY;  // Before the last Map::update, for drawing
+    std::vector<float> velX, velY;          // What the body does this step
+    std::vector<float> prefVelX, prefVelY;  // What it would like to do
+    std::vector<float> radius;
+    std::vector<uint32_t> cold;   // Index into Map::npcs, or NONE for crowd
+
+    // Returns the new body's index
+    uint32_t add(const Vec2& position, const Vec2& velocity, float radius, uint32_t cold = NONE);
+    void clear();
+    void reserve(size_t count);
+
+    // Removes body i by moving the last body into its place
+    void remove(uint32_t i);
+
+    size_t size() const { return posX.size(); }
+    Vec2 position(uint32_t i) const { return Vec2(posX[i], posY[i]); }
+
+    // Between the previous position (alpha 0) and the current one (1)
+    Vec2 interpolated(uint32_t i, float alpha) const {
+        return Vec2(prevPosX[i] + (posX[i] - prevPosX[i]) * alpha,
+                    prevPosY[i] + (posY[i] - prevPosY[i]) * alpha);
+    }
+
+    // Makes the current positions the previous ones; once per step
+    void savePositions() {
+        prevPosX = posX;
+        prevPosY = posY;
+    }
+    Vec2 velocity(uint32_t i) const { return Vec2(velX[i], velY[i]); }
+    Vec2 preferredVelocity(uint32_t i) const { return Vec2(prefVelX[i], prefVelY[i]); }
+
+    // Sets both the velocity and the preferred one
+    void setVelocity(uint32_t i, const Vec2& v) {
+        velX[i] = prefVelX[i] = v.x;
+        velY[i] = prefVelY[i] = v.y;
+    }
+
+    // Steering goes here; local avoidance turns it into the velocity
+    void setPreferredVelocity(uint32_t i, const Vec2& v) { prefVelX[i] = v.x; prefVelY[i] = v.y; }
+
+    // position += velocity * dt for every body, in chunks spread over pool
+    void integrate(float dt, ThreadPool& pool);
+
+    // Same, for bodies [begin, end) on the calling thread
+    void integrateRange(float dt, size_t begin, size_t end);
+
+    // position += velocity * steps[i] for each listed body i
+    void integrate(const std::vector<uint32_t>& bodies, const float* steps, ThreadPool& pool);
+};
+
+#endif // NPC_STORE_HH
@@ -3,6 +3,8 @@
 
 #include "Shape.hh"
 #include "../Vec2.hh"
+#include "../engine/handle.hh"
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -15,6 +17,9 @@ struct DialogueNode {
     std::vector<std::string> nextNodeIds;  // Simple linear progression for now
 };
 
+class NPC;
+using NPCHandle = Handle<NPC>;
+
 class NPC {
 public:
     enum ConversationState {
@@ -26,6 +31,15 @@ public:
     std::shared_ptr<Shape> shape;
     Vec2 velocity;
 
+    // This NPC's entry in Map::npcStore, which owns its position and
+    // velocity once added to a map; shape and velocity above are copied
+    // back from it after every Map::update
+    uint32_t body = UINT32_MAX;
+
+    // Stable name for this NPC in its map (see Map::getNPC), unlike its
+    // index in Map::npcs, which changes when others are removed
+    NPCHandle handle;
+
     // Identity
     std::string id;              // Unique identifier from map file
                                  // ALSO used as:
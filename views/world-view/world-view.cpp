@@ -3,9 +3,63 @@
 #include "../../npc/Shapes/Triangle.hh"
 #include "../../npc/Shapes/Circle.hh"
 #include "../../npc/Shapes/Line.hh"
+#include "../../engine/thread-pool.hh"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
+namespace {
+
+// First-person strip settings
+const int EYE_STRIP_HEIGHT = 48;
+const float EYE_FOV = M_PI / 2;          // Same 90 degrees as the minimap cone
+const float EYE_MAX_DISTANCE = 60.0f;    // Anything further fades to background
+const size_t EYE_COLUMNS_PER_TASK = 64;
+
+// Side of one cached minimap tile, in pixels
+const int STATIC_TILE_PIXELS = 512;
+
+Uint32 packColor(float r, float g, float b) {
+    return 0xFF000000u | ((Uint32)r << 16) | ((Uint32)g << 8) | (Uint32)b;
+}
+
+// Static minimap geometry, drawn at screen = offset + world * scale
+void drawShape(SDL_Renderer* renderer, const Rectangle& rect, float offsetX, float offsetY, float scale) {
+    SDL_Rect r = {
+        (int)(offsetX + rect.position.x * scale),
+        (int)(offsetY + rect.position.y * scale),
+        (int)(rect.width * scale),
+        (int)(rect.height * scale)
+    };
+    SDL_RenderFillRect(renderer, &r);
+}
+
+void drawShape(SDL_Renderer* renderer, const Circle& circ, float offsetX, float offsetY, float scale) {
+    int cx = (int)(offsetX + circ.position.x * scale);
+    int cy = (int)(offsetY + circ.position.y * scale);
+    int r = (int)(circ.radius * scale);
+    // Draw circle as octagon approximation
+    for (int i = 0; i < 8; i++) {
+        float angle1 = i * M_PI / 4;
+        float angle2 = (i + 1) * M_PI / 4;
+        SDL_RenderDrawLine(renderer,
+            cx + r * std::cos(angle1), cy + r * std::sin(angle1),
+            cx + r * std::cos(angle2), cy + r * std::sin(angle2));
+    }
+}
+
+void drawShape(SDL_Renderer* renderer, const Triangle& tri, float offsetX, float offsetY, float scale) {
+    SDL_Point points[4] = {
+        {(int)(offsetX + tri.p1.x * scale), (int)(offsetY + tri.p1.y * scale)},
+        {(int)(offsetX + tri.p2.x * scale), (int)(offsetY + tri.p2.y * scale)},
+        {(int)(offsetX + tri.p3.x * scale), (int)(offsetY + tri.p3.y * scale)},
+        {(int)(offsetX + tri.p1.x * scale), (int)(offsetY + tri.p1.y * scale)}
+    };
+    SDL_RenderDrawLines(renderer, points, 4);
+}
+
+} // namespace
+
 WorldView::WorldView(int posX, int posY, int width, int height) : posX(posX), posY(posY), width(width), height(height) {
     // Load a font for the floating prompt
     std::vector<std::string> fontPaths = {
@@ -29,6 +83,8 @@ WorldView::WorldView(int posX, int posY, int width, int height) : posX(posX), po
 
 WorldView::~WorldView() {
     if (promptFont) TTF_CloseFont(promptFont);
+    if (eyeTexture) SDL_DestroyTexture(eyeTexture);
+    releaseStaticLayer();
 }
 
 void WorldView::setPrompt(const std::string& prompt, bool visible) {
@@ -36,26 +92,226 @@ void WorldView::setPrompt(const std::string& prompt, bool visible) {
     showPrompt = visible && !prompt.empty();
 }
 
-const NPC* WorldView::getNPCInCrosshair(const Map& map, const Vec2& playerPos, float viewAngle, float maxDistance) {
+NPCHandle WorldView::getNPCInCrosshair(const Map& map, const Vec2& playerPos, float viewAngle, float maxDistance) {
     Vec2 rayDir(std::cos(viewAngle), std::sin(viewAngle));
-    const float rayStep = 0.1f;
 
-    for (float dist = 0.1f; dist < maxDistance; dist += rayStep) {
-        Vec2 checkPos = playerPos + rayDir * dist;
+    // Walls and shapes in front of an NPC block it from being targeted
+    RayHit hit;
+    if (map.castRay(playerPos, rayDir, maxDistance, hit) && hit.kind == RayHit::NPC) {
+        return map.npcs[hit.index].handle;
+    }
+    return NPCHandle();
+}
+
+void WorldView::renderEye(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle) {
+    if (width <= 0) return;
 
-        for (const auto& npc : map.npcs) {
-            float minY, maxY;
-            if (npc.shape->intersectsVerticalLine(checkPos.x, minY, maxY)) {
-                if (checkPos.y >= minY && checkPos.y <= maxY) {
-                    return &npc;
-                }
+    if (!eyeTexture || eyeTextureWidth != width) {
+        if (eyeTexture) SDL_DestroyTexture(eyeTexture);
+        eyeTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_STREAMING, width, 1);
+        eyeTextureWidth = width;
+        eyePixels.assign(width, 0);
+        if (!eyeTexture) {
+            std::cerr << "WorldView: could not create eye texture: " << SDL_GetError() << std::endl;
+            return;
+        }
+    }
+
+    // Flat projection plane, so columns are evenly spaced on screen
+    Vec2 forward(std::cos(viewAngle), std::sin(viewAngle));
+    Vec2 plane = Vec2(-forward.y, forward.x) * std::tan(EYE_FOV / 2);
+    int columns = width;
+
+    // Every column is an independent ray cast against the map's grid
+    ThreadPool::shared().parallelFor(columns, EYE_COLUMNS_PER_TASK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            float screenX = 2.0f * (i + 0.5f) / columns - 1.0f;
+            Vec2 rayDir = (forward + plane * screenX).normalized();
+
+            RayHit hit;
+            if (!map.castRay(playerPos, rayDir, EYE_MAX_DISTANCE, hit)) {
+                eyePixels[i] = packColor(30, 30, 30);
+                continue;
+            }
+
+            // Perpendicular depth avoids fish-eye bulging; glancing
+            // surfaces are a little darker so corners read clearly
+            float depth = hit.distance * (rayDir.x * forward.x + rayDir.y * forward.y);
+            float fog = std::max(0.0f, 1.0f - depth / EYE_MAX_DISTANCE);
+            float facing = std::abs(hit.normal.x * rayDir.x + hit.normal.y * rayDir.y);
+            float light = fog * (0.6f + 0.4f * facing);
+
+            // Same palette as the minimap
+            float r = 200, g = 200, b = 200;
+            if (hit.kind == RayHit::WALL) {
+                r = 255; g = 255; b = 0;
+            } else if (hit.kind == RayHit::NPC) {
+                r = 255; g = 100; b = 100;
             }
+            eyePixels[i] = packColor(30 + (r - 30) * light, 30 + (g - 30) * light, 30 + (b - 30) * light);
+        }
+    });
+
+    SDL_UpdateTexture(eyeTexture, nullptr, eyePixels.data(), columns * sizeof(Uint32));
+    SDL_Rect stripRect = {posX, posY, width, EYE_STRIP_HEIGHT};
+    SDL_RenderCopy(renderer, eyeTexture, nullptr, &stripRect);
+}
+
+void WorldView::renderVisibility(SDL_Renderer* renderer, float offsetX, float offsetY, float scale) {
+    const auto& vertices = visibility.getVertices();
+    if (vertices.size() < 3) return;
+
+    // Triangle fan around the eye, as a plain triangle list
+    const SDL_Color lit = {60, 60, 70, 255};
+    Vec2 eye = visibility.getEye();
+    SDL_FPoint center = {offsetX + eye.x * scale, offsetY + eye.y * scale};
+    visibilityFan.clear();
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        const Vec2& a = vertices[i];
+        const Vec2& b = vertices[(i + 1) % vertices.size()];
+        visibilityFan.push_back({center, lit, {0, 0}});
+        visibilityFan.push_back({{offsetX + a.x * scale, offsetY + a.y * scale}, lit, {0, 0}});
+        visibilityFan.push_back({{offsetX + b.x * scale, offsetY + b.y * scale}, lit, {0, 0}});
+    }
+    SDL_RenderGeometry(renderer, nullptr, visibilityFan.data(), (int)visibilityFan.size(), nullptr, 0);
+}
+
+void WorldView::releaseStaticLayer() {
+    for (auto& tile : staticTiles) {
+        if (tile.texture) SDL_DestroyTexture(tile.texture);
+    }
+    staticTiles.clear();
+    staticTilesX = staticTilesY = 0;
+}
+
+void WorldView::resetStaticLayer(const Map& map) {
+    releaseStaticLayer();
+    staticRevision = map.revision;
+    staticScale = minimapScale;
+
+    // Tiles cover the bounding box of the walls and shapes
+    bool any = false;
+    Vec2 lo, hi;
+    auto include = [&](const Vec2& min, const Vec2& max) {
+        if (!any) { lo = min; hi = max; any = true; return; }
+        lo = Vec2(std::min(lo.x, min.x), std::min(lo.y, min.y));
+        hi = Vec2(std::max(hi.x, max.x), std::max(hi.y, max.y));
+    };
+    for (size_t i = 0; i < map.segments.size(); ++i) {
+        Vec2 a = map.segments.a(i), b = map.segments.b(i);
+        include(Vec2(std::min(a.x, b.x), std::min(a.y, b.y)), Vec2(std::max(a.x, b.x), std::max(a.y, b.y)));
+    }
+    for (uint32_t i = 0; i < map.staticShapes.size(); ++i) {
+        map.staticShapes.visit(i, [&](const auto& shape) {
+            Vec2 min, max;
+            shape.getBounds(min, max);
+            include(min, max);
+        });
+    }
+    if (!any) return;
+
+    // A pixel of margin so outlines on the far edge are not cut off
+    float tileWorld = STATIC_TILE_PIXELS / staticScale;
+    staticOrigin = lo - Vec2(1.0f, 1.0f) * (1.0f / staticScale);
+    staticTilesX = (int)std::floor((hi.x - staticOrigin.x) / tileWorld) + 1;
+    staticTilesY = (int)std::floor((hi.y - staticOrigin.y) / tileWorld) + 1;
+    staticTiles.resize((size_t)staticTilesX * staticTilesY);
+}
+
+void WorldView::drawStaticTile(SDL_Renderer* renderer, const Map& map, int tileX, int tileY) {
+    StaticTile& tile = staticTiles[(size_t)tileY * staticTilesX + tileX];
+    tile.drawn = true;
+
+    tile.texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET,
+                                     STATIC_TILE_PIXELS, STATIC_TILE_PIXELS);
+    if (!tile.texture) {
+        std::cerr << "WorldView: could not create minimap tile: " << SDL_GetError() << std::endl;
+        return;
+    }
+    SDL_SetTextureBlendMode(tile.texture, SDL_BLENDMODE_BLEND);
+
+    SDL_Texture* previousTarget = SDL_GetRenderTarget(renderer);
+    SDL_SetRenderTarget(renderer, tile.texture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    float scale = staticScale;
+    float tileWorld = STATIC_TILE_PIXELS / scale;
+    Vec2 min = staticOrigin + Vec2(tileX * tileWorld, tileY * tileWorld);
+    Vec2 max = min + Vec2(tileWorld, tileWorld);
+    float offsetX = -min.x * scale;
+    float offsetY = -min.y * scale;
+
+    // The grid lists an item once per cell it touches
+    auto collect = [&](auto&& query) {
+        staticItems.clear();
+        query([&](uint32_t i) { staticItems.push_back(i); return false; });
+        std::sort(staticItems.begin(), staticItems.end());
+        staticItems.erase(std::unique(staticItems.begin(), staticItems.end()), staticItems.end());
+    };
+
+    // Shapes
+    SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
+    collect([&](auto&& fn) { map.grid.forEachShape(min, max, fn); });
+    for (uint32_t i : staticItems) {
+        map.staticShapes.visit(i, [&](const auto& shape) {
+            drawShape(renderer, shape, offsetX, offsetY, scale);
+        });
+    }
+
+    // Lines
+    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+    collect([&](auto&& fn) { map.grid.forEachSegment(min, max, fn); });
+    for (uint32_t i : staticItems) {
+        Vec2 a = map.segments.a(i), b = map.segments.b(i);
+        SDL_RenderDrawLine(renderer,
+            (int)(offsetX + a.x * scale), (int)(offsetY + a.y * scale),
+            (int)(offsetX + b.x * scale), (int)(offsetY + b.y * scale));
+    }
+
+    SDL_SetRenderTarget(renderer, previousTarget);
+}
+
+void WorldView::renderStaticLayer(SDL_Renderer* renderer, const Map& map, float offsetX, float offsetY) {
+    if (map.revision != staticRevision || minimapScale != staticScale) {
+        resetStaticLayer(map);
+    }
+    if (staticTiles.empty()) return;
+
+    // Tiles under the minimap rectangle
+    float tileWorld = STATIC_TILE_PIXELS / staticScale;
+    auto tileRange = [&](float screenMin, float screenMax, float offset, float origin, int count, int& t0, int& t1) {
+        t0 = std::max(0, (int)std::floor(((screenMin - offset) / staticScale - origin) / tileWorld));
+        t1 = std::min(count - 1, (int)std::floor(((screenMax - offset) / staticScale - origin) / tileWorld));
+    };
+    int tx0, tx1, ty0, ty1;
+    tileRange(posX, posX + width, offsetX, staticOrigin.x, staticTilesX, tx0, tx1);
+    tileRange(posY, posY + height, offsetY, staticOrigin.y, staticTilesY, ty0, ty1);
+
+    // All tiles share one rounded corner, so they line up without seams
+    int baseX = (int)std::floor(offsetX + staticOrigin.x * staticScale);
+    int baseY = (int)std::floor(offsetY + staticOrigin.y * staticScale);
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            StaticTile& tile = staticTiles[(size_t)ty * staticTilesX + tx];
+            if (!tile.drawn) drawStaticTile(renderer, map, tx, ty);
+            if (!tile.texture) continue;
+
+            SDL_Rect dst = {baseX + tx * STATIC_TILE_PIXELS, baseY + ty * STATIC_TILE_PIXELS,
+                            STATIC_TILE_PIXELS, STATIC_TILE_PIXELS};
+            SDL_RenderCopy(renderer, tile.texture, nullptr, &dst);
         }
     }
-    return nullptr;
 }
 
-void WorldView::render(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle) {
+void WorldView::render(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle,
+                       float alpha) {
+    // Calculate scale and offset for minimap
+    float scale = minimapScale;
+    float offsetX = posX + width / 2 - playerPos.x * scale;
+    float offsetY = posY + height / 2 - playerPos.y * scale;
+
     // Draw minimap background
     SDL_SetRenderDrawColor(renderer, 30, 30, 30, 255);
     SDL_Rect minimapRect = {posX, posY, width, height};
@@ -64,66 +320,41 @@ void WorldView::render(SDL_Renderer* renderer, const Map& map, const Vec2& playe
     // Enable clipping to minimap area
     SDL_RenderSetClipRect(renderer, &minimapRect);
     
-    // Calculate scale and offset for minimap
-    float scale = 4.0f;  // Larger scale for full-screen view
-    float offsetX = posX + width / 2 - playerPos.x * scale;
-    float offsetY = posY + height / 2 - playerPos.y * scale;
+    // Lit area first, so the geometry draws on top of it
+    visibility.update(map, playerPos);
+    renderVisibility(renderer, offsetX, offsetY, scale);
     
-    // Draw shapes on minimap
-    for (const auto& shape : map.shapes) {
-        SDL_SetRenderDrawColor(renderer, 200, 200, 200, 255);
-        
-        if (auto rect = dynamic_cast<Rectangle*>(shape.get())) {
-            SDL_Rect r = {
-                (int)(offsetX + rect->position.x * scale),
-                (int)(offsetY + rect->position.y * scale),
-                (int)(rect->width * scale),
-                (int)(rect->height * scale)
-            };
-            SDL_RenderFillRect(renderer, &r);
-        } else if (auto circ = dynamic_cast<Circle*>(shape.get())) {
-            int cx = (int)(offsetX + circ->position.x * scale);
-            int cy = (int)(offsetY + circ->position.y * scale);
-            int r = (int)(circ->radius * scale);
-            // Draw circle as octagon approximation
-            for (int i = 0; i < 8; i++) {
-                float angle1 = i * M_PI / 4;
-                float angle2 = (i + 1) * M_PI / 4;
-                SDL_RenderDrawLine(renderer,
-                    cx + r * std::cos(angle1), cy + r * std::sin(angle1),
-                    cx + r * std::cos(angle2), cy + r * std::sin(angle2));
-            }
-        } else if (auto tri = dynamic_cast<Triangle*>(shape.get())) {
-            SDL_Point points[4] = {
-                {(int)(offsetX + tri->p1.x * scale), (int)(offsetY + tri->p1.y * scale)},
-                {(int)(offsetX + tri->p2.x * scale), (int)(offsetY + tri->p2.y * scale)},
-                {(int)(offsetX + tri->p3.x * scale), (int)(offsetY + tri->p3.y * scale)},
-                {(int)(offsetX + tri->p1.x * scale), (int)(offsetY + tri->p1.y * scale)}
-            };
-            SDL_RenderDrawLines(renderer, points, 4);
-        }
-    }
+    // Walls and shapes, from the cached tiles
+    renderStaticLayer(renderer, map, offsetX, offsetY);
     
-    // Draw lines on minimap
-    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
-    for (const auto& line : map.lines) {
-        const auto& points = line->getPoints();
-        for (size_t i = 0; i + 1 < points.size(); ++i) {
-            int x1 = (int)(offsetX + points[i].x * scale);
-            int y1 = (int)(offsetY + points[i].y * scale);
-            int x2 = (int)(offsetX + points[i + 1].x * scale);
-            int y2 = (int)(offsetY + points[i + 1].y * scale);
-            SDL_RenderDrawLine(renderer, x1, y1, x2, y2);
+    // Ambient crowd as single pixels, in one batch
+    const NPCStore& store = map.npcStore;
+    crowdPoints.clear();
+    for (size_t i = 0; i < store.size(); ++i) {
+        if (store.cold[i] != NPCStore::NONE) continue;
+        Vec2 p = store.interpolated((uint32_t)i, alpha);
+        int x = (int)(offsetX + p.x * scale);
+        int y = (int)(offsetY + p.y * scale);
+        if (x >= posX && x < posX + width && y >= posY && y < posY + height) {
+            crowdPoints.push_back({x, y});
         }
     }
-    
-    // Draw NPCs on minimap
-    SDL_SetRenderDrawColor(renderer, 255, 100, 100, 255);
+    SDL_SetRenderDrawColor(renderer, 180, 120, 120, 255);
+    SDL_RenderDrawPoints(renderer, crowdPoints.data(), (int)crowdPoints.size());
+
+    // Draw NPCs on minimap, dimmed when out of sight
     for (const auto& npc : map.npcs) {
-        if (auto circ = dynamic_cast<Circle*>(npc.shape.get())) {
-            int cx = (int)(offsetX + circ->position.x * scale);
-            int cy = (int)(offsetY + circ->position.y * scale);
-            int r = (int)(circ->radius * scale);
+        if (npc.shape->getKind() == ShapeKind::CIRCLE) {
+            const auto& circ = static_cast<const Circle&>(*npc.shape);
+            Vec2 at = store.interpolated(npc.body, alpha);
+            if (visibility.contains(at)) {
+                SDL_SetRenderDrawColor(renderer, 255, 100, 100, 255);
+            } else {
+                SDL_SetRenderDrawColor(renderer, 120, 60, 60, 255);
+            }
+            int cx = (int)(offsetX + at.x * scale);
+            int cy = (int)(offsetY + at.y * scale);
+            int r = (int)(circ.radius * scale);
             SDL_Rect npcRect = {cx - r, cy - r, r * 2, r * 2};
             SDL_RenderFillRect(renderer, &npcRect);
         }
@@ -153,6 +384,9 @@ void WorldView::render(SDL_Renderer* renderer, const Map& map, const Vec2& playe
     
     // Disable clipping
     SDL_RenderSetClipRect(renderer, nullptr);
+
+    // First-person view along the top edge
+    renderEye(renderer, map, playerPos, viewAngle);
     
     // Draw orange crosshair on main view
     int centerX = posX + width / 2;
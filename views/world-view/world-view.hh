@@ -4,7 +4,9 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <string>
+#include <vector>
 #include "../../map/map.hh"
+#include "../../map/visibility-polygon.hh"
 #include "../../Vec2.hh"
 #include "../../npc/npc.hh"
 
@@ -21,13 +23,61 @@ private:
     // Current prompt state
     std::string currentPrompt;
     bool showPrompt = false;
+
+    // First-person 1D strip: one pixel per screen column, shaded on worker
+    // threads into eyePixels and uploaded as a width x 1 texture
+    SDL_Texture* eyeTexture = nullptr;
+    int eyeTextureWidth = 0;
+    std::vector<Uint32> eyePixels;
+
+    // What the player can see, refreshed as they move; shaded on the minimap
+    VisibilityPolygon visibility;
+    std::vector<SDL_Vertex> visibilityFan;
+
+    // Minimap zoom, in pixels per world unit
+    float minimapScale = 4.0f;
+
+    // Walls and shapes are drawn once into square tiles of transparent
+    // target textures, each on first sight, and blitted from then on.
+    // Everything is thrown away when the map is re-indexed or the scale
+    // changes.
+    struct StaticTile {
+        SDL_Texture* texture = nullptr;
+        bool drawn = false;
+    };
+    std::vector<StaticTile> staticTiles;
+    int staticTilesX = 0;
+    int staticTilesY = 0;
+    Vec2 staticOrigin;                // World position of tile (0, 0)'s corner
+    uint64_t staticRevision = 0;
+    float staticScale = 0.0f;
+    std::vector<uint32_t> staticItems;   // Scratch for tile queries
+
+    std::vector<SDL_Point> crowdPoints;  // Ambient NPCs in view, one pixel each
+
+    void renderEye(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle);
+    void renderVisibility(SDL_Renderer* renderer, float offsetX, float offsetY, float scale);
+    void renderStaticLayer(SDL_Renderer* renderer, const Map& map, float offsetX, float offsetY);
+    void resetStaticLayer(const Map& map);
+    void drawStaticTile(SDL_Renderer* renderer, const Map& map, int tileX, int tileY);
+    void releaseStaticLayer();
     
 public:
     WorldView(int posX, int posY, int width, int height);
     ~WorldView();
-    void render(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle);
+    // NPCs are drawn alpha of the way from their previous to their current
+    // position (see NPCStore::interpolated), to go with a playerPos
+    // interpolated the same way
+    void render(SDL_Renderer* renderer, const Map& map, const Vec2& playerPos, float viewAngle,
+                float alpha = 1.0f);
     void setPrompt(const std::string& prompt, bool visible);
-    const NPC* getNPCInCrosshair(const Map& map, const Vec2& playerPos, float viewAngle, float maxDistance = 3.0f);
+    NPCHandle getNPCInCrosshair(const Map& map, const Vec2& playerPos, float viewAngle, float maxDistance = 3.0f);
+
+    void setMinimapScale(float scale) { minimapScale = scale; }
+    float getMinimapScale() const { return minimapScale; }
+
+    // Is point in the player's line of sight, as of the last render()?
+    bool isVisible(const Vec2& point) const { return visibility.contains(point); }
 };
 
 #endif // WORLD_VIEW_HH
\ No newline at end of file